@@ -2,6 +2,9 @@
 #include "cinder/app/RendererGl.h"
 #include "cinder/Surface.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/gl/Fbo.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/scoped.h"
 #include "cinder/Text.h"
 #include "cinder/Utilities.h"
 #include "cinder/ImageIo.h"
@@ -9,6 +12,7 @@
 
 #include "Resources.h"
 #include "MovieHap.h"
+#include "HapDxt.h"
 
 #include "PerfTracker.h"
 
@@ -22,14 +26,23 @@ class HapLoaderApp : public App {
 public:
 	void setup() override;
 	void keyDown( KeyEvent event ) override;
+	void mouseDrag( MouseEvent event ) override;
 	void fileDrop( FileDropEvent event ) override;
 	void update() override;
 	void draw() override;
 	
 	void loadMovieFile( const fs::path &path );
+	void movieLoaded( const fs::path &path );
+	void compareCpuDecode();
 	
 	gl::TextureRef			mInfoTexture;
 	qtime::MovieGlHapRef	mMovie;
+	bool					mBounce;
+	
+	// Movie being opened in the background
+	std::future<qtime::MovieGlHapRef>		mLoadingMovie;
+	qtime::MovieGlHap::OpenProgressRef		mLoadingProgress;
+	fs::path								mLoadingPath;
 	
 	PerfTrackerRef			mPerfTracker;
 };
@@ -45,6 +58,10 @@ void HapLoaderApp::setup()
 												0.85f * getWindowWidth(), 200 ) );
 	setFrameRate(60);
 	setFpsSampleInterval(0.25);
+	mBounce = false;
+	
+	// Multi-chunk Hap frames are decompressed across all cores, by workers pinned to one core each
+	hap::ThreadPool::setShared( hap::ThreadPool::create( hap::ThreadPool::Options().pinThreads() ) );
 }
 
 void HapLoaderApp::keyDown( KeyEvent event )
@@ -58,17 +75,172 @@ void HapLoaderApp::keyDown( KeyEvent event )
 			loadMovieFile( moviePath );
 	}
 	else if( event.getChar() == 'r' ) {
+		if( mLoadingProgress )
+			mLoadingProgress->cancel();
 		mMovie.reset();
 	}
+	else if( event.getChar() == 'u' && mMovie ) {
+		// cycle through the texture upload modes
+		switch( mMovie->getUploadMode() ) {
+			case hap::UploadMode::CLIENT_MEMORY: mMovie->setUploadMode( hap::UploadMode::PBO_ORPHAN ); break;
+			case hap::UploadMode::PBO_ORPHAN: mMovie->setUploadMode( hap::UploadMode::PBO_FENCED ); break;
+			case hap::UploadMode::PBO_FENCED: mMovie->setUploadMode( hap::UploadMode::PERSISTENT ); break;
+			default: mMovie->setUploadMode( hap::UploadMode::CLIENT_MEMORY ); break;
+		}
+	}
+	else if( event.getCode() == KeyEvent::KEY_LEFT && mMovie ) {
+		mMovie->stop();
+		mMovie->stepBackward();
+	}
+	else if( event.getCode() == KeyEvent::KEY_RIGHT && mMovie ) {
+		mMovie->stop();
+		mMovie->stepForward();
+	}
+	else if( event.getChar() == ' ' && mMovie ) {
+		if( mMovie->isPlaying() )
+			mMovie->stop();
+		else
+			mMovie->play();
+	}
+	else if( event.getChar() == 'x' && mMovie ) {
+		// play the other way
+		mMovie->setRate( -mMovie->getRate() );
+	}
+	else if( event.getChar() == '4' && mMovie ) {
+		// toggle between normal and four times the speed, keeping the direction
+		const float rate = mMovie->getRate();
+		mMovie->setRate( std::abs( rate ) > 1 ? ( rate < 0 ? -1.0f : 1.0f ) : rate * 4 );
+	}
+	else if( event.getChar() == 'b' && mMovie ) {
+		// toggle between looping and bouncing back and forth
+		mBounce = ! mBounce;
+		mMovie->setLoop( true, mBounce );
+	}
+	else if( event.getChar() == 'm' && mMovie ) {
+		// cycle through keeping nothing, the compressed or the decoded movie in memory
+		switch( mMovie->getResidentMode() ) {
+			case hap::ResidentMode::NONE: mMovie->setResidentMode( hap::ResidentMode::COMPRESSED ); break;
+			case hap::ResidentMode::COMPRESSED: mMovie->setResidentMode( hap::ResidentMode::DECODED ); break;
+			default: mMovie->setResidentMode( hap::ResidentMode::NONE ); break;
+		}
+	}
+	else if( event.getChar() == 'k' && mMovie && mMovie->getSampleTable() ) {
+		// measure how fast the CPU decodes frames of this movie's size and format to RGBA, HapQ converted to RGB, on one thread and on the pool
+		const hap::PixelFormat format = hap::getPixelFormatForCodec( mMovie->getSampleTable()->getCodecType() );
+		for( hap::dxt::Kernel kernel : { hap::dxt::Kernel::SCALAR, hap::dxt::Kernel::SSE2, hap::dxt::Kernel::AVX2, hap::dxt::Kernel::NEON } ) {
+			if( ! hap::dxt::isSupported( kernel ) )
+				continue;
+			const double single = hap::dxt::benchmark( format, mMovie->getWidth(), mMovie->getHeight(), kernel );
+			const double pooled = hap::dxt::benchmark( format, mMovie->getWidth(), mMovie->getHeight(), kernel, hap::ThreadPool::getShared() );
+			console() << hap::dxt::toString( kernel ) << ": " << single << " Gpix/s (" << 1.0 / single << " ms per megapixel), "
+					  << pooled << " Gpix/s on the thread pool" << std::endl;
+		}
+		// and how fast it would encode them back, as hap::Encoder does, with the fastest kernel
+		for( hap::dxt::Quality quality : { hap::dxt::Quality::FAST, hap::dxt::Quality::NORMAL, hap::dxt::Quality::HIGH } ) {
+			const double single = hap::dxt::benchmarkEncode( format, mMovie->getWidth(), mMovie->getHeight(), quality, hap::dxt::Kernel::BEST );
+			const double pooled = hap::dxt::benchmarkEncode( format, mMovie->getWidth(), mMovie->getHeight(), quality, hap::dxt::Kernel::BEST, hap::ThreadPool::getShared() );
+			console() << "encode " << hap::dxt::toString( quality ) << ": " << single * 1000 << " Mpix/s, " << pooled * 1000 << " Mpix/s on the thread pool" << std::endl;
+		}
+	}
+	else if( event.getChar() == 'v' && mMovie && mMovie->getSampleTable() ) {
+		mMovie->stop();
+		compareCpuDecode();
+	}
+}
+
+void HapLoaderApp::compareCpuDecode()
+{
+	// draw the current frame 1:1 into an FBO the way the movie does, through ScaledCoCgYToRGBA.frag for HapQ
+	const gl::Texture2dRef texture = mMovie->getTexture();
+	const hap::SampleTableRef &table = mMovie->getSampleTable();
+	if( ! texture )
+		return;
+	const size_t index = mMovie->getCurrentFrameIndex();
+	const int32_t width = table->getWidth();
+	const int32_t height = table->getHeight();
+	
+	gl::FboRef fbo = gl::Fbo::create( width, height, gl::Fbo::Format().colorTexture( gl::Texture2d::Format().internalFormat( GL_RGBA8 ) ) );
+	{
+		gl::ScopedFramebuffer scopedFbo( fbo );
+		gl::ScopedViewport scopedViewport( ivec2( 0 ), fbo->getSize() );
+		gl::ScopedMatrices scopedMatrices;
+		gl::setMatricesWindow( fbo->getSize() );
+		gl::ScopedBlend scopedBlend( false );
+		gl::ScopedGlslProg scopedShader( mMovie->isHapQ() ? gl::GlslProg::create( loadResource( RES_HAP_VERT ), loadResource( RES_HAP_FRAG ) )
+														   : gl::getStockShader( gl::ShaderDef().texture() ) );
+		gl::ScopedTextureBind scopedTexture( texture );
+		gl::color( Color::white() );
+		gl::drawSolidRect( Rectf( 0, 0, width, height ), vec2( 0 ), vec2( width / (float)texture->getActualWidth(), height / (float)texture->getActualHeight() ) );
+	}
+	const Surface8u gpu = fbo->readPixels8u( fbo->getBounds() );
+	
+	// and decode the same sample on the CPU
+	const hap::SampleTable::Sample &sample = table->getSample( index );
+	std::vector<uint8_t> frame( sample.mSize ), dxt, cpu( width * height * 4 );
+	hap::FrameInfo info;
+	if( table->getSource()->read( sample.mOffset, frame.data(), frame.size() ) != frame.size()
+		|| hap::Decoder::getFrameInfo( frame.data(), frame.size(), &info ) != hap::DecodeResult::SUCCESS ) {
+		console() << "frame " << index << " couldn't be read" << std::endl;
+		return;
+	}
+	dxt.resize( info.mDecodedSize );
+	hap::Decoder decoder;
+	if( decoder.decode( frame.data(), frame.size(), dxt.data(), dxt.size() ) != hap::DecodeResult::SUCCESS
+		|| hap::dxt::decode( dxt.data(), dxt.size(), info.mPixelFormat, width, height, cpu.data(), width * 4 ) != hap::DecodeResult::SUCCESS ) {
+		console() << "frame " << index << " couldn't be decoded" << std::endl;
+		return;
+	}
+	
+	// alpha only counts for Hap Alpha, the GPU reads the other formats as opaque
+	const int numChannels = info.mPixelFormat == hap::PIXEL_FORMAT_RGBA_DXT5 ? 4 : 3;
+	int maxError = 0;
+	size_t numDiffering = 0;
+	for( int32_t y = 0; y < height; ++y ) {
+		for( int32_t x = 0; x < width; ++x ) {
+			const ColorA8u g = gpu.getPixel( ivec2( x, y ) );
+			const uint8_t gpuPixel[4] = { g.r, g.g, g.b, g.a };
+			const uint8_t *cpuPixel = &cpu[( y * width + x ) * 4];
+			int error = 0;
+			for( int c = 0; c < numChannels; ++c )
+				error = std::max( error, std::abs( gpuPixel[c] - cpuPixel[c] ) );
+			maxError = std::max( maxError, error );
+			numDiffering += error > 0;
+		}
+	}
+	console() << "frame " << index << ", CPU decode vs GPU: max error " << maxError << ", " << numDiffering << " of "
+			  << width * height << " pixels differ" << std::endl;
+}
+
+void HapLoaderApp::mouseDrag( MouseEvent event )
+{
+	// scrub to the frame under the mouse, across the width of the window
+	if( ! mMovie )
+		return;
+	mMovie->stop();
+	const float position = math<float>::clamp( event.getPos().x / (float)getWindowWidth(), 0.0f, 1.0f );
+	mMovie->seekToFrame( int( position * ( mMovie->getNumFrames() - 1 ) + 0.5f ) );
 }
 
 void HapLoaderApp::loadMovieFile( const fs::path &moviePath )
+{
+	// The current movie keeps playing while the new one opens, a previous load still in flight is abandoned
+	if( mLoadingProgress )
+		mLoadingProgress->cancel();
+	mLoadingProgress = std::make_shared<qtime::MovieGlHap::OpenProgress>();
+	mLoadingPath = moviePath;
+	mLoadingMovie = qtime::MovieGlHap::createAsync( moviePath, mLoadingProgress );
+}
+
+void HapLoaderApp::movieLoaded( const fs::path &moviePath )
 {
 	try {
-		mMovie.reset();
-		// load up the movie, set it to loop, and begin playing
-		mMovie = qtime::MovieGlHap::create( moviePath );
-		mMovie->setLoop();
+		qtime::MovieGlHapRef movie = mLoadingMovie.get();
+		if( ! movie )
+			return;
+		
+		// set the movie to loop, and begin playing
+		mMovie = movie;
+		mMovie->setLoop( true, mBounce );
 		mMovie->play();
 		
 		// create a texture for showing some info about the movie
@@ -97,6 +269,10 @@ void HapLoaderApp::fileDrop( FileDropEvent event )
 
 void HapLoaderApp::update()
 {
+	if( mLoadingMovie.valid() && mLoadingMovie.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready ) {
+		mLoadingProgress.reset();
+		movieLoaded( mLoadingPath );
+	}
 }
 
 void HapLoaderApp::draw()
@@ -115,7 +291,8 @@ void HapLoaderApp::draw()
 	
 	mPerfTracker->startFrame();
 	if ( mMovie ) {
-		mMovie->draw();
+		// show the frame due when this one reaches the screen, at the next vsync
+		mMovie->draw( getElapsedSeconds() + 1.0 / getFrameRate() );
 	}
 	mPerfTracker->endFrame();
 	
@@ -132,6 +309,29 @@ void HapLoaderApp::draw()
 	infoFps.setColor( Color::white() );
 	infoFps.addLine( "Movie Framerate: " + tostr( mMovie->getPlaybackFramerate(), 1 ) );
 	infoFps.addLine( "App Framerate: " + tostr( this->getAverageFps(), 1 ) );
+	if( mLoadingProgress )
+		infoFps.addLine( "Loading " + mLoadingPath.filename().string() + ": " + toString( int( mLoadingProgress->getProgress() * 100 ) ) + "%" );
+	if( mMovie && mMovie->isDecodingNatively() )
+		infoFps.addLine( "Decode: " + tostr( mMovie->getLastDecodeSeconds() * 1000.0, 2 ) + " ms, " + toString( mMovie->getDecodeChunkTimings().size() ) + " chunks" );
+	if( mMovie && mMovie->getUploadMode() != hap::UploadMode::CLIENT_MEMORY )
+		infoFps.addLine( "Upload stalls: " + toString( mMovie->getUploadStats().mNumStalls ) );
+	if( mMovie ) {
+		const hap::PlaybackStats &stats = mMovie->getPlaybackStats();
+		auto p95 = [&]( hap::PlaybackStats::Stage stage ) { return tostr( stats.getLatency( stage ).getPercentileSeconds( 0.95 ) * 1000.0, 2 ); };
+		infoFps.addLine( "p95 read / decompress / upload: " + p95( hap::PlaybackStats::STAGE_READ ) + " / " + p95( hap::PlaybackStats::STAGE_DECOMPRESS ) + " / " + p95( hap::PlaybackStats::STAGE_UPLOAD ) + " ms, " + toString( stats.getNumDropped() ) + " dropped" );
+	}
+	if( mMovie && mMovie->getReadAhead() ) {
+		hap::ReadAheadStats readAhead = mMovie->getReadAhead()->getStats();
+		infoFps.addLine( "Read-ahead: " + toString( readAhead.mQueueDepth ) + " queued, " + toString( readAhead.mNumMisses ) + " misses, p99 " + tostr( mMovie->getReadAhead()->getReadLatency().getPercentileSeconds( 0.99 ) * 1000.0, 2 ) + " ms" );
+	}
+	if( mMovie && mMovie->isDecodingNatively() )
+		infoFps.addLine( "Frame " + toString( mMovie->getCurrentFrameIndex() ) + ", rate " + tostr( mMovie->getRate(), 2 ) + ( mBounce ? ", bouncing" : "" ) );
+	if( mMovie && mMovie->getResidentMode() != hap::ResidentMode::NONE )
+		infoFps.addLine( "Resident: " + tostr( mMovie->getResidentMemoryFootprint() / ( 1024.0 * 1024.0 ), 1 ) + " MB" + ( mMovie->getResidentMode() == hap::ResidentMode::DECODED ? " decoded" : " compressed" ) );
+	if( mMovie ) {
+		hap::HandoffStats handoff = mMovie->getHandoffStats();
+		infoFps.addLine( "Frames: " + toString( handoff.mNumAcquired ) + " shown, " + toString( handoff.mNumOverwritten ) + " skipped, " + toString( handoff.mNumLockContentions ) + " lock waits" );
+	}
 	infoFps.setBorder( 4, 2 );
 	gl::draw( gl::Texture::create( infoFps.render( true ) ), ivec2( 20, 20 ) );
 }
@@ -17,6 +17,8 @@ class HapMultiLayeredApp : public App {
 	void draw();
 
 	qtime::MovieGlHapRef	mMovieBg, mMovieFront;
+	// both layers follow the same clock, so they stay on matching frames however long they run
+	hap::PlaybackClockRef	mClock;
 };
 
 void HapMultiLayeredApp::setup()
@@ -27,21 +29,31 @@ void HapMultiLayeredApp::setup()
 	mMovieBg = qtime::MovieGlHap::create( loadAsset( "SampleHapQ.mov" ) );
 	mMovieFront = qtime::MovieGlHap::create( loadAsset( "SampleHapAlpha.mov" ) );
 
-	mMovieBg->setLoop();
-	mMovieBg->play();
+	mClock = hap::PlaybackClock::create();
+	mMovieBg->setPlaybackClock( mClock );
+	mMovieFront->setPlaybackClock( mClock );
 
+	mMovieBg->setLoop();
 	mMovieFront->setLoop();
-	mMovieFront->play();
+	mClock->play();
 
 	gl::enableAlphaBlending();
 }
 
 void HapMultiLayeredApp::mouseDown( MouseEvent event )
 {
+	// pause and resume both layers at once
+	if( mClock->isPlaying() )
+		mClock->stop();
+	else
+		mClock->play();
 }
 
 void HapMultiLayeredApp::update()
 {
+	// a non-zero drift means a layer showed a frame other than the one due
+	if( getElapsedFrames() % 600 == 0 && mClock->getNumFrames() > 0 )
+		console() << "drift: " << mClock->getNumDriftedFrames() << " of " << mClock->getNumFrames() << " frames, max " << mClock->getMaxDrift() * 1000.0 << " ms" << endl;
 }
 
 void HapMultiLayeredApp::draw()
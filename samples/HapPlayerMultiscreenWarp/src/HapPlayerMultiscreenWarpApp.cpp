@@ -19,6 +19,7 @@
 
 // Cinder blocks
 #include "MovieHap.h"
+#include "HapClockSync.h"
 #include "Warp.h"
 
 #include "PerfTracker.h"
@@ -72,8 +73,11 @@ public:
 
 private:
   void loadMovieFile(const fs::path &path);
+  void movieLoaded(const fs::path &path);
   void drawMovie();
   void updateMovieVolume();
+  void setupClockSync();
+  void togglePlayback();
 
   static optional<AppSettings> readSettings(const ci::DataSourceRef &source);
   static void writeSettings(const AppSettings& appSettings, const ci::DataTargetRef &target);
@@ -87,6 +91,15 @@ private:
   qtime::MovieGlHapRef mMovie;
   AppSettings mAppSettings;
 
+  // Movie being opened in the background
+  std::future<qtime::MovieGlHapRef> mLoadingMovie;
+  qtime::MovieGlHap::OpenProgressRef mLoadingProgress;
+  fs::path mLoadingPath;
+
+  // Playback clock shared with the other nodes of the wall, see setupClockSync()
+  hap::PlaybackClockRef mClock;
+  hap::ClockSyncRef mClockSync;
+
   // Performance tracker
   PerfTrackerRef mPerfTracker;
   bool mPerfTrackerVisible;
@@ -124,6 +137,8 @@ void HapPlayerMultiscreenWarpApp::setup()
   setFpsSampleInterval(0.25);
   //disableFrameRate();
 
+  setupClockSync();
+
   // Set app settings path
   mAppSettingsPath = getAssetPath("") / "app.xml";
 
@@ -159,6 +174,11 @@ void HapPlayerMultiscreenWarpApp::cleanup()
 
 void HapPlayerMultiscreenWarpApp::update()
 {
+  if (mLoadingMovie.valid() && mLoadingMovie.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+  {
+    mLoadingProgress.reset();
+    movieLoaded(mLoadingPath);
+  }
 }
 
 void HapPlayerMultiscreenWarpApp::draw()
@@ -197,8 +217,22 @@ void HapPlayerMultiscreenWarpApp::draw()
   infoFps.setColor(Color::white());
   infoFps.addLine("Movie Framerate: " + tostr(mMovie->getPlaybackFramerate(), 1));
   infoFps.addLine("App Framerate: " + tostr(this->getAverageFps(), 1));
+  if (mLoadingProgress)
+    infoFps.addLine("Loading " + mLoadingPath.filename().string() + ": " + toString(int(mLoadingProgress->getProgress() * 100)) + "%");
   if (mMovie)
     infoFps.addLine(mMovie->isPlaying() ? "Playing" : "Not playing");
+  if (mClockSync && mClockSync->isLeader())
+  {
+    const double framerate = mMovie ? mMovie->getFramerate() : 60.0;
+    infoFps.addLine("Leading " + toString(mClockSync->getNumFollowers()) + " followers, skew " +
+                    tostr(mClockSync->getMaxSkew() * framerate, 2) + " frames");
+  }
+  else if (mClockSync)
+  {
+    infoFps.addLine(mClockSync->isConnected() ? "Following, latency " + tostr(mClockSync->getLatency() * 1000.0, 2) + " ms, offset error " +
+                                                    tostr(mClockSync->getClockOffsetError() * 1000.0, 2) + " ms"
+                                              : "Waiting for the leader");
+  }
   infoFps.setBorder(4, 2);
   gl::draw(gl::Texture::create(infoFps.render(true)), ivec2(20, 20));
 }
@@ -295,6 +329,8 @@ void HapPlayerMultiscreenWarpApp::keyDown(KeyEvent event)
     }
     case KeyEvent::KEY_r:
       // reset the movie
+      if (mLoadingProgress)
+        mLoadingProgress->cancel();
       mMovie.reset();
       break;
     case KeyEvent::KEY_v:
@@ -312,6 +348,9 @@ void HapPlayerMultiscreenWarpApp::keyDown(KeyEvent event)
       mAppSettings.mAudioEnabled = !mAppSettings.mAudioEnabled;
       updateMovieVolume();
       break;
+    case KeyEvent::KEY_t:
+      togglePlayback();
+      break;
     //case KeyEvent::KEY_a:
     //  // toggle drawing a random region of the image
     //  if (mSrcArea.getWidth() != mImage->getWidth() || mSrcArea.getHeight() != mImage->getHeight())
@@ -347,15 +386,35 @@ void HapPlayerMultiscreenWarpApp::fileDrop(FileDropEvent event)
 }
 
 void HapPlayerMultiscreenWarpApp::loadMovieFile(const fs::path &moviePath)
+{
+  // The current movie keeps playing while the new one opens, a previous load still in flight is abandoned
+  if (mLoadingProgress)
+    mLoadingProgress->cancel();
+  mLoadingProgress = std::make_shared<qtime::MovieGlHap::OpenProgress>();
+  mLoadingPath = moviePath;
+  mLoadingMovie = qtime::MovieGlHap::createAsync(moviePath, mLoadingProgress);
+}
+
+void HapPlayerMultiscreenWarpApp::movieLoaded(const fs::path &moviePath)
 {
   try
   {
-    // load up the movie, set it to loop, and begin playing
-    mMovie.reset();
-    mMovie = qtime::MovieGlHap::create(moviePath);
+    qtime::MovieGlHapRef movie = mLoadingMovie.get();
+    if (!movie)
+      return;
+
+    // set the movie to loop, and begin playing
+    mMovie = movie;
     updateMovieVolume();
     mMovie->setLoop();
-    mMovie->play();
+    mMovie->setPlaybackClock(mClock);
+    // The new clip starts at its head without pausing a wall that's already playing. Followers play when the leader does
+    if (!mClockSync || mClockSync->isLeader())
+    {
+      mClock->seek(0.0);
+      if (!mClock->isPlaying())
+        togglePlayback();
+    }
 
     // create a texture for showing some info about the movie
     TextLayout infoText;
@@ -460,6 +519,46 @@ void HapPlayerMultiscreenWarpApp::drawMovie()
 #endif
 }
 
+void HapPlayerMultiscreenWarpApp::setupClockSync()
+{
+  // Nodes of a wall spread over several processes or machines play in step when started with
+  // --leader on one of them and --follow <leader host> on the others, --port <port> overriding the default
+  const vector<string>& args = getCommandLineArgs();
+  string leaderHost;
+  bool leader = false;
+  uint16_t port = hap::ClockSync::kDefaultPort;
+  for (size_t i = 1; i < args.size(); ++i)
+  {
+    if (args[i] == "--leader")
+      leader = true;
+    else if (args[i] == "--follow" && i + 1 < args.size())
+      leaderHost = args[++i];
+    else if (args[i] == "--port" && i + 1 < args.size())
+      port = static_cast<uint16_t>(fromString<int>(args[++i]));
+  }
+
+  mClock = hap::PlaybackClock::create();
+  if (leader)
+    mClockSync = hap::ClockSync::createLeader(mClock, port);
+  else if (!leaderHost.empty())
+    mClockSync = hap::ClockSync::createFollower(mClock, leaderHost, port);
+}
+
+void HapPlayerMultiscreenWarpApp::togglePlayback()
+{
+  // Only the leader drives the clock, followers take over its state
+  if (mClockSync && !mClockSync->isLeader())
+    return;
+
+  if (mClock->isPlaying())
+    mClock->stop();
+  else if (mClockSync)
+    // Scheduled so every follower hears of the start before it happens
+    mClock->playIn(mClockSync->getStartDelay());
+  else
+    mClock->play();
+}
+
 void HapPlayerMultiscreenWarpApp::updateMovieVolume()
 {
   if (mMovie)
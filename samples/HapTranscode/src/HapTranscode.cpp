@@ -0,0 +1,197 @@
+/*
+ *  HapTranscode
+ *
+ *  Rewrites a Hap movie with its frames split in more chunks, so they decode in parallel, without touching the
+ *  textures: each frame is decompressed to its DXT data, chunked and compressed with Snappy anew. The new movie has
+ *  4 KiB aligned samples for unbuffered reads and its movie atom up front.
+ *
+ *  HapTranscode <input.mov> <output.mov> [--chunks count] [--no-snappy] [--alignment bytes] [--threads count]
+ */
+
+#include "HapDecoder.h"
+#include "HapEncoder.h"
+#include "HapMovieWriter.h"
+#include "HapSampleTable.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace ci;
+using namespace std;
+
+// Frames from the start of each movie decoded to compare them, once untimed to warm up the pool, then timed
+static const size_t kBenchmarkFrames = 300;
+
+//! Returns the average time Decoder spends per frame on the first kBenchmarkFrames frames of the movie at \a path, read
+//! through MovieSource::create() after a warm-up pass over the same frames. Sets \a maxChunks to the most chunks a frame has.
+static double timeDecode( const fs::path &path, const hap::ThreadPoolRef &pool, uint32_t *maxChunks )
+{
+	hap::SampleTableRef table = hap::SampleTable::create( hap::MovieSource::create( path ) );
+	const size_t numFrames = min( table->getNumSamples(), kBenchmarkFrames );
+	hap::Decoder decoder;
+	decoder.setThreadPool( pool );
+	vector<uint8_t> sample( table->getMaxSampleSize() ), dxt;
+	double seconds = 0;
+	*maxChunks = 0;
+	for( int pass = 0; pass < 2; ++pass ) {
+		for( size_t i = 0; i < numFrames; ++i ) {
+			const hap::SampleTable::Sample &info = table->getSample( i );
+			hap::FrameInfo frameInfo;
+			if( table->getSource()->read( info.mOffset, sample.data(), info.mSize ) != info.mSize
+				|| hap::Decoder::getFrameInfo( sample.data(), info.mSize, &frameInfo ) != hap::DecodeResult::SUCCESS )
+				throw Exception( "Unable to read frame " + to_string( i ) + " of " + path.string() );
+			dxt.resize( frameInfo.mDecodedSize );
+			if( decoder.decode( sample.data(), info.mSize, dxt.data(), dxt.size() ) != hap::DecodeResult::SUCCESS )
+				throw Exception( "Unable to decode frame " + to_string( i ) + " of " + path.string() );
+			if( pass == 1 )
+				seconds += decoder.getLastDecodeSeconds();
+			*maxChunks = max( *maxChunks, frameInfo.mNumChunks );
+		}
+	}
+	return numFrames ? seconds / numFrames : 0;
+}
+
+static void printUsage()
+{
+	cerr << "usage: HapTranscode <input.mov> <output.mov> [--chunks count] [--no-snappy] [--alignment bytes] [--threads count]" << endl
+		 << "  --chunks     chunks per frame, by default one per " << hap::Encoder::kAutoChunkSize / 1024 << " KiB of DXT data" << endl
+		 << "  --no-snappy  stores chunks uncompressed, larger files that decode faster from fast storage" << endl
+		 << "  --alignment  byte multiple samples start at, " << hap::MovieSourceDirect::kAlignment << " by default" << endl
+		 << "  --threads    decode and encode threads besides the main one, one per core by default" << endl;
+}
+
+int main( int argc, char *argv[] )
+{
+	fs::path inputPath, outputPath;
+	uint32_t numChunks = 0;
+	bool snappy = true;
+	size_t alignment = hap::MovieSourceDirect::kAlignment;
+	size_t numThreads = 0;
+	for( int i = 1; i < argc; ++i ) {
+		const bool hasValue = i + 1 < argc;
+		if( ! strcmp( argv[i], "--chunks" ) && hasValue )
+			numChunks = (uint32_t)atoi( argv[++i] );
+		else if( ! strcmp( argv[i], "--no-snappy" ) )
+			snappy = false;
+		else if( ! strcmp( argv[i], "--alignment" ) && hasValue )
+			alignment = (size_t)atoi( argv[++i] );
+		else if( ! strcmp( argv[i], "--threads" ) && hasValue )
+			numThreads = (size_t)atoi( argv[++i] );
+		else if( argv[i][0] != '-' && inputPath.empty() )
+			inputPath = argv[i];
+		else if( argv[i][0] != '-' && outputPath.empty() )
+			outputPath = argv[i];
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	if( inputPath.empty() || outputPath.empty() || numChunks > hap::Encoder::kMaxChunks ) {
+		printUsage();
+		return 1;
+	}
+
+	hap::SampleTableRef table;
+	try {
+		table = hap::SampleTable::create( hap::MovieSource::create( inputPath ) );
+	}
+	catch( const Exception &exc ) {
+		cerr << "Unable to open " << inputPath << ": " << exc.what() << endl;
+		return 1;
+	}
+	const hap::PixelFormat format = hap::getPixelFormatForCodec( table->getCodecType() );
+	if( ! table->isHap() || table->getNumSamples() == 0 ) {
+		cerr << inputPath << " has no Hap video track." << endl;
+		return 1;
+	}
+
+	size_t numDurations = 0;
+	for( size_t i = 0; i < table->getNumSamples(); ++i ) {
+		if( i == 0 || table->getSample( i ).mDuration != table->getSample( i - 1 ).mDuration )
+			++numDurations;
+	}
+
+	hap::MovieWriterRef writer;
+	try {
+		writer = hap::MovieWriter::create( outputPath, hap::MovieWriter::Format()
+			.codecType( table->getCodecType() ).size( table->getWidth(), table->getHeight() ).timeScale( table->getTimeScale() )
+			.sampleAlignment( alignment ).reserve( table->getNumSamples(), numDurations ) );
+	}
+	catch( const Exception &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+
+	hap::ThreadPoolRef pool = hap::ThreadPool::create( numThreads );
+	hap::Decoder decoder;
+	decoder.setThreadPool( pool );
+	hap::Encoder encoder( hap::Encoder::Options().pixelFormat( format ).numChunks( numChunks ).snappy( snappy ) );
+	encoder.setThreadPool( pool );
+
+	const hap::MovieSourceRef &source = table->getSource();
+	vector<uint8_t> sample( table->getMaxSampleSize() ), dxt, redecoded, frame;
+	uint64_t inputBytes = 0;
+	const auto start = chrono::steady_clock::now();
+
+	try {
+		for( size_t i = 0; i < table->getNumSamples(); ++i ) {
+			const hap::SampleTable::Sample &info = table->getSample( i );
+			if( source->read( info.mOffset, sample.data(), info.mSize ) != info.mSize )
+				throw Exception( "Unable to read sample " + to_string( i ) );
+
+			hap::FrameInfo frameInfo;
+			if( hap::Decoder::getFrameInfo( sample.data(), info.mSize, &frameInfo ) != hap::DecodeResult::SUCCESS )
+				throw Exception( "Unsupported frame " + to_string( i ) + ", ie. Hap Q Alpha" );
+			dxt.resize( frameInfo.mDecodedSize );
+			const hap::DecodeResult result = decoder.decode( sample.data(), info.mSize, dxt.data(), dxt.size() );
+			if( result != hap::DecodeResult::SUCCESS )
+				throw Exception( "Unable to decode frame " + to_string( i ) + ": " + hap::toString( result ) );
+			inputBytes += info.mSize;
+
+			if( ! encoder.encodeDxt( dxt.data(), dxt.size(), &frame ) )
+				throw Exception( "Unable to encode frame " + to_string( i ) );
+
+			// The new frame must give back the very same texture
+			redecoded.resize( dxt.size() );
+			if( decoder.decode( frame.data(), frame.size(), redecoded.data(), redecoded.size() ) != hap::DecodeResult::SUCCESS || redecoded != dxt )
+				throw Exception( "Frame " + to_string( i ) + " doesn't decode back to its texture" );
+
+			writer->addSample( frame.data(), frame.size(), info.mDuration );
+			if( ( i + 1 ) % 100 == 0 )
+				cout << "\r" << i + 1 << " / " << table->getNumSamples() << " frames" << flush;
+		}
+		writer->finish();
+	}
+	catch( const Exception &exc ) {
+		cerr << endl << exc.what() << endl;
+		return 1;
+	}
+
+	const double elapsed = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+	cout << "\r" << table->getNumSamples() << " frames transcoded in " << fixed << setprecision( 1 ) << elapsed << " s, "
+		 << table->getNumSamples() / elapsed << " frames per second" << endl
+		 << "size: " << inputBytes / 1048576.0 << " MiB -> " << writer->getSize() / 1048576.0 << " MiB"
+		 << ( writer->isMovieAtomFirst() ? ", movie atom first" : "" ) << endl;
+	writer.reset();
+	table.reset();
+
+	// Each movie is timed in a pass of its own through the same reads and the same pool, so neither finds the other's data in cache
+	double inputSeconds, outputSeconds;
+	uint32_t inputChunks, outputChunks;
+	try {
+		inputSeconds = timeDecode( inputPath, pool, &inputChunks );
+		outputSeconds = timeDecode( outputPath, pool, &outputChunks );
+	}
+	catch( const Exception &exc ) {
+		cerr << exc.what() << endl;
+		return 1;
+	}
+	cout << setprecision( 3 ) << "decode time per frame on " << pool->getNumThreads() + 1 << " threads: "
+		 << inputSeconds * 1000 << " ms with up to " << inputChunks << " chunks -> "
+		 << outputSeconds * 1000 << " ms with up to " << outputChunks << " chunks, speedup "
+		 << setprecision( 2 ) << ( outputSeconds > 0 ? inputSeconds / outputSeconds : 0.0 ) << "x" << endl;
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ *  HapBufferPool.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapBufferPool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#if defined( CINDER_MSW )
+	#include <malloc.h>
+#endif
+
+namespace cinder { namespace hap {
+
+	void* allocateAligned( size_t size, size_t alignment )
+	{
+#if defined( CINDER_MSW )
+		return ::_aligned_malloc( size, alignment );
+#else
+		void *ptr = nullptr;
+		if( ::posix_memalign( &ptr, std::max( alignment, sizeof( void* ) ), size ) != 0 )
+			return nullptr;
+		return ptr;
+#endif
+	}
+
+	void freeAligned( void *ptr )
+	{
+#if defined( CINDER_MSW )
+		::_aligned_free( ptr );
+#else
+		::free( ptr );
+#endif
+	}
+
+	BufferPool::BufferPool( size_t bufferSize, size_t maxBuffers, size_t alignment )
+	: mBufferSize( ( bufferSize + alignment - 1 ) & ~( alignment - 1 ) ), mMaxBuffers( maxBuffers ), mAlignment( alignment ),
+	  mNumAllocated( 0 ), mNumOverflows( 0 )
+	{
+	}
+
+	BufferPool::~BufferPool()
+	{
+		// Buffers still in use hold a reference to the pool, so by now they are all back
+		for( uint8_t *buffer : mFree )
+			freeAligned( buffer );
+	}
+
+	std::shared_ptr<uint8_t> BufferPool::acquire( size_t size )
+	{
+		uint8_t *buffer = nullptr;
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( size <= mBufferSize ) {
+				if( ! mFree.empty() ) {
+					buffer = mFree.back();
+					mFree.pop_back();
+				}
+				else if( mNumAllocated < mMaxBuffers ) {
+					buffer = (uint8_t*)allocateAligned( mBufferSize, mAlignment );
+					if( buffer )
+						++mNumAllocated;
+				}
+			}
+			if( ! buffer )
+				++mNumOverflows;
+		}
+
+		if( buffer ) {
+			BufferPoolRef pool = shared_from_this();
+			return std::shared_ptr<uint8_t>( buffer, [pool]( uint8_t *ptr ) { pool->release( ptr ); } );
+		}
+
+		const size_t alignedSize = ( size + mAlignment - 1 ) & ~( mAlignment - 1 );
+		buffer = (uint8_t*)allocateAligned( std::max<size_t>( alignedSize, mAlignment ), mAlignment );
+		if( ! buffer )
+			throw std::bad_alloc();
+		return std::shared_ptr<uint8_t>( buffer, []( uint8_t *ptr ) { freeAligned( ptr ); } );
+	}
+
+	void BufferPool::release( uint8_t *buffer )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mFree.push_back( buffer );
+	}
+
+	uint64_t BufferPool::getNumOverflows() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mNumOverflows;
+	}
+
+} } // namespace cinder::hap
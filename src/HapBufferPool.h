@@ -0,0 +1,50 @@
+/*
+ *  HapBufferPool.h
+ *
+ *  Recycled, aligned I/O buffers for unbuffered reads.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <mutex>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	//! Allocates \a size bytes aligned to \a alignment, a power of two. Release with freeAligned().
+	void*	allocateAligned( size_t size, size_t alignment );
+	void	freeAligned( void *ptr );
+
+	typedef std::shared_ptr<class BufferPool> BufferPoolRef;
+
+	//! Buffers are allocated on demand up to a maximum count and recycled once their last reference goes away. Thread-safe.
+	class BufferPool : public std::enable_shared_from_this<BufferPool> {
+	public:
+		//! Creates a pool of up to \a maxBuffers buffers of \a bufferSize bytes, aligned to \a alignment.
+		static BufferPoolRef create( size_t bufferSize, size_t maxBuffers, size_t alignment ) { return BufferPoolRef( new BufferPool( bufferSize, maxBuffers, alignment ) ); }
+		~BufferPool();
+
+		//! Returns an aligned buffer of at least \a size bytes. Requests larger than the pool's buffers, or made while all of them are
+		//! in use, get a one-off allocation instead of waiting.
+		std::shared_ptr<uint8_t>	acquire( size_t size );
+
+		size_t		getBufferSize() const { return mBufferSize; }
+		size_t		getAlignment() const { return mAlignment; }
+		//! Returns how many requests couldn't be served from the pool.
+		uint64_t	getNumOverflows() const;
+
+	protected:
+		BufferPool( size_t bufferSize, size_t maxBuffers, size_t alignment );
+		void		release( uint8_t *buffer );
+
+		size_t					mBufferSize, mMaxBuffers, mAlignment;
+		std::vector<uint8_t*>	mFree;
+		size_t					mNumAllocated;
+		uint64_t				mNumOverflows;
+		mutable std::mutex		mMutex;
+	};
+
+} } // namespace cinder::hap
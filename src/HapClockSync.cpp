@@ -0,0 +1,512 @@
+/*
+ *  HapClockSync.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapClockSync.h"
+
+#if defined( CINDER_MSW )
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#pragma comment( lib, "ws2_32.lib" )
+#else
+	#include <arpa/inet.h>
+	#include <netdb.h>
+	#include <netinet/in.h>
+	#include <sys/select.h>
+	#include <sys/socket.h>
+	#include <unistd.h>
+#endif
+
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace cinder { namespace hap {
+
+	namespace {
+		const uint32_t	kMagic = 0x48415053; // 'HAPS'
+		const uint8_t	kVersion = 2;
+		enum MessageType : uint8_t {
+			//! Follower to leader: a round trip request, with the follower's report.
+			PING = 1,
+			//! Leader to follower: the answer to a ping.
+			PONG,
+			//! Leader to followers: the clock's state.
+			STATE
+		};
+
+		const intptr_t	kInvalidSocket = -1;
+		const size_t	kMaxMessageSize = 256;
+		//! How long the thread waits for messages before sending the periodic ones.
+		const double	kPollSeconds = 0.002;
+		const double	kPingInterval = 0.1;
+		const double	kStateInterval = 0.1;
+		//! Nodes not heard from for this long are considered gone.
+		const double	kTimeoutSeconds = 2.0;
+		//! Round trips the clock offset is picked from, a few seconds' worth.
+		const size_t	kNumRoundTrips = 32;
+		//! Followers leave their clock alone while it is this close to the leader's, so the offset estimate's jitter
+		//! doesn't turn into seeks.
+		const double	kSkewTolerance = 0.0005;
+		//! Added to the slowest follower's round trip for scheduled starts.
+		const double	kStartMargin = 0.05;
+
+		//! Messages are big-endian, doubles sent as their bits.
+		class Writer {
+		public:
+			explicit Writer( uint8_t type )
+			{
+				putU32( kMagic );
+				putU8( kVersion );
+				putU8( type );
+			}
+
+			void	putU8( uint8_t value ) { mData.push_back( value ); }
+			void	putU32( uint32_t value )
+			{
+				for( int shift = 24; shift >= 0; shift -= 8 )
+					mData.push_back( uint8_t( value >> shift ) );
+			}
+			void	putF64( double value )
+			{
+				uint64_t bits;
+				std::memcpy( &bits, &value, sizeof( bits ) );
+				for( int shift = 56; shift >= 0; shift -= 8 )
+					mData.push_back( uint8_t( bits >> shift ) );
+			}
+
+			const std::vector<uint8_t>&	getData() const { return mData; }
+
+		private:
+			std::vector<uint8_t>	mData;
+		};
+
+		//! Reads past the end fail once and return 0 from then on, see isValid().
+		class Reader {
+		public:
+			Reader( const uint8_t *data, size_t size ) : mData( data ), mSize( size ), mPos( 0 ), mValid( true ) {}
+
+			uint8_t		getU8() { return has( 1 ) ? mData[mPos++] : 0; }
+			uint32_t	getU32()
+			{
+				if( ! has( 4 ) )
+					return 0;
+				uint32_t value = 0;
+				for( int i = 0; i < 4; ++i )
+					value = ( value << 8 ) | mData[mPos++];
+				return value;
+			}
+			double		getF64()
+			{
+				if( ! has( 8 ) )
+					return 0;
+				uint64_t bits = 0;
+				for( int i = 0; i < 8; ++i )
+					bits = ( bits << 8 ) | mData[mPos++];
+				double value;
+				std::memcpy( &value, &bits, sizeof( value ) );
+				return value;
+			}
+
+			bool	isValid() const { return mValid; }
+
+		private:
+			bool	has( size_t count )
+			{
+				mValid = mValid && mSize - mPos >= count;
+				return mValid;
+			}
+
+			const uint8_t	*mData;
+			size_t			mSize, mPos;
+			bool			mValid;
+		};
+
+		void closeSocket( intptr_t socket )
+		{
+#if defined( CINDER_MSW )
+			::closesocket( (SOCKET)socket );
+#else
+			::close( (int)socket );
+#endif
+		}
+
+		//! Opens a UDP socket bound to \a port on every interface, 0 for any port.
+		intptr_t openSocket( uint16_t port )
+		{
+#if defined( CINDER_MSW )
+			static const bool sStarted = [] {
+				WSADATA data;
+				return ::WSAStartup( MAKEWORD( 2, 2 ), &data ) == 0;
+			}();
+			if( ! sStarted )
+				return kInvalidSocket;
+			const SOCKET s = ::socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+			if( s == INVALID_SOCKET )
+				return kInvalidSocket;
+			const intptr_t result = (intptr_t)s;
+#else
+			const int s = ::socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+			if( s < 0 )
+				return kInvalidSocket;
+			const intptr_t result = s;
+#endif
+			sockaddr_in address;
+			std::memset( &address, 0, sizeof( address ) );
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl( INADDR_ANY );
+			address.sin_port = htons( port );
+			if( ::bind( s, (const sockaddr *)&address, sizeof( address ) ) != 0 ) {
+				closeSocket( result );
+				return kInvalidSocket;
+			}
+			return result;
+		}
+	} // anonymous namespace
+
+	ClockSync::ClockSync( const PlaybackClockRef &clock, bool leader )
+	: mClock( clock ), mLeader( leader ), mSocket( kInvalidSocket ), mOutputLatency( 0 ), mLatency( 0 ), mClockOffset( 0 ),
+	  mClockOffsetError( 0 ), mLastHeard(), mNextPing( Clock::now() ), mHasState( false ), mSentGeneration( 0 ), mNextState( Clock::now() ), mRunning( false )
+	{
+		mLeaderAddress.mHost = 0;
+		mLeaderAddress.mPort = 0;
+	}
+
+	ClockSync::~ClockSync()
+	{
+		mRunning = false;
+		if( mThread.joinable() )
+			mThread.join();
+		if( mSocket != kInvalidSocket )
+			closeSocket( mSocket );
+	}
+
+	ClockSyncRef ClockSync::createLeader( const PlaybackClockRef &clock, uint16_t port )
+	{
+		ClockSyncRef sync( new ClockSync( clock, true ) );
+		sync->mSocket = openSocket( port );
+		if( sync->mSocket == kInvalidSocket ) {
+			CI_LOG_E( "HAP ERROR :: couldn't listen for clock followers on port " << port << "." );
+			return nullptr;
+		}
+		sync->mSentGeneration = clock->getGeneration() - 1;
+		sync->mRunning = true;
+		sync->mThread = std::thread( &ClockSync::run, sync.get() );
+		return sync;
+	}
+
+	ClockSyncRef ClockSync::createFollower( const PlaybackClockRef &clock, const std::string &host, uint16_t port )
+	{
+		ClockSyncRef sync( new ClockSync( clock, false ) );
+		sync->mSocket = openSocket( 0 );
+		if( sync->mSocket == kInvalidSocket ) {
+			CI_LOG_E( "HAP ERROR :: couldn't open a socket to follow the clock at " << host << "." );
+			return nullptr;
+		}
+
+		addrinfo hints, *found = nullptr;
+		std::memset( &hints, 0, sizeof( hints ) );
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+		if( ::getaddrinfo( host.c_str(), nullptr, &hints, &found ) != 0 || ! found ) {
+			CI_LOG_E( "HAP ERROR :: couldn't resolve clock leader " << host << "." );
+			return nullptr;
+		}
+		sync->mLeaderAddress.mHost = ntohl( ( (const sockaddr_in *)found->ai_addr )->sin_addr.s_addr );
+		sync->mLeaderAddress.mPort = port;
+		::freeaddrinfo( found );
+
+		sync->mRunning = true;
+		sync->mThread = std::thread( &ClockSync::run, sync.get() );
+		return sync;
+	}
+
+	void ClockSync::setOutputLatency( double seconds )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mOutputLatency = seconds;
+		if( mHasState && ! mRoundTrips.empty() )
+			followState( mLeaderState );
+	}
+
+	double ClockSync::getOutputLatency() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mOutputLatency;
+	}
+
+	bool ClockSync::isConnected() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mLeader )
+			return ! mPeers.empty();
+		return ! mRoundTrips.empty() && std::chrono::duration<double>( Clock::now() - mLastHeard ).count() < kTimeoutSeconds;
+	}
+
+	double ClockSync::getLatency() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mLatency;
+	}
+
+	double ClockSync::getClockOffset() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mClockOffset;
+	}
+
+	double ClockSync::getClockOffsetError() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mClockOffsetError;
+	}
+
+	std::vector<ClockSync::Follower> ClockSync::getFollowers() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		std::vector<Follower> result;
+		for( const Peer &peer : mPeers )
+			result.push_back( peer.mInfo );
+		return result;
+	}
+
+	size_t ClockSync::getNumFollowers() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mPeers.size();
+	}
+
+	double ClockSync::getMaxSkew() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		double result = 0;
+		for( const Peer &peer : mPeers )
+			result = std::max( result, peer.mInfo.mClockOffsetError + std::abs( peer.mInfo.mStateAgreement ) );
+		return result;
+	}
+
+	double ClockSync::getStartDelay() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		double latency = 0;
+		for( const Peer &peer : mPeers )
+			latency = std::max( latency, peer.mInfo.mLatency );
+		return 2 * latency + kStartMargin;
+	}
+
+	double ClockSync::toSeconds( Clock::time_point timePoint )
+	{
+		return std::chrono::duration<double>( timePoint.time_since_epoch() ).count();
+	}
+
+	ClockSync::Clock::time_point ClockSync::fromSeconds( double seconds )
+	{
+		return Clock::time_point( std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( seconds ) ) );
+	}
+
+	std::string ClockSync::toString( const Address &address )
+	{
+		std::string result;
+		for( int shift = 24; shift >= 0; shift -= 8 )
+			result += std::to_string( ( address.mHost >> shift ) & 0xff ) + ( shift ? "." : ":" );
+		return result + std::to_string( address.mPort );
+	}
+
+	void ClockSync::run()
+	{
+		while( mRunning ) {
+			receive();
+
+			std::lock_guard<std::mutex> lock( mMutex );
+			const Clock::time_point now = Clock::now();
+			if( mLeader ) {
+				mPeers.erase( std::remove_if( mPeers.begin(), mPeers.end(), [now]( const Peer &peer ) {
+					return std::chrono::duration<double>( now - peer.mLastHeard ).count() > kTimeoutSeconds;
+				} ), mPeers.end() );
+				// Changes go out right away, the periodic state covers lost messages
+				if( mClock->getGeneration() != mSentGeneration || now >= mNextState )
+					sendState();
+			}
+			else if( now >= mNextPing ) {
+				sendPing();
+			}
+		}
+	}
+
+	void ClockSync::receive()
+	{
+		fd_set readable;
+		FD_ZERO( &readable );
+		FD_SET( mSocket, &readable );
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = long( kPollSeconds * 1000000 );
+		if( ::select( int( mSocket + 1 ), &readable, nullptr, nullptr, &timeout ) <= 0 )
+			return;
+
+		uint8_t data[kMaxMessageSize];
+		sockaddr_in from;
+		socklen_t fromSize = sizeof( from );
+		const auto size = ::recvfrom( mSocket, (char *)data, sizeof( data ), 0, (sockaddr *)&from, &fromSize );
+		// Stamped before anything else, the round trips are only as precise as this
+		const Clock::time_point received = Clock::now();
+		if( size <= 0 )
+			return;
+
+		Address address;
+		address.mHost = ntohl( from.sin_addr.s_addr );
+		address.mPort = ntohs( from.sin_port );
+		std::lock_guard<std::mutex> lock( mMutex );
+		handleMessage( data, size_t( size ), address, received );
+	}
+
+	void ClockSync::handleMessage( const uint8_t *data, size_t size, const Address &from, Clock::time_point received )
+	{
+		Reader reader( data, size );
+		if( reader.getU32() != kMagic || reader.getU8() != kVersion )
+			return;
+		const uint8_t type = reader.getU8();
+
+		if( mLeader && type == PING ) {
+			const double sentAt = reader.getF64();
+			const bool synced = reader.getU8() != 0;
+			const double leaderTime = reader.getF64();
+			const double clockTime = reader.getF64();
+			const double latency = reader.getF64();
+			const double clockOffsetError = reader.getF64();
+			const double maxDrift = reader.getF64();
+			if( ! reader.isValid() )
+				return;
+
+			Writer pong( PONG );
+			pong.putF64( sentAt );
+			pong.putF64( toSeconds( received ) );
+			pong.putF64( toSeconds( Clock::now() ) );
+			send( pong.getData(), from );
+
+			auto peer = std::find_if( mPeers.begin(), mPeers.end(), [&from]( const Peer &peer ) { return peer.mAddress == from; } );
+			if( peer == mPeers.end() ) {
+				Peer newPeer;
+				newPeer.mAddress = from;
+				newPeer.mInfo.mAddress = toString( from );
+				newPeer.mInfo.mLatency = newPeer.mInfo.mClockOffsetError = newPeer.mInfo.mStateAgreement = newPeer.mInfo.mMaxDrift = 0;
+				mPeers.push_back( newPeer );
+				peer = mPeers.end() - 1;
+				// Newcomers get the state right away
+				mNextState = received;
+			}
+			peer->mLastHeard = received;
+			peer->mInfo.mLatency = latency;
+			peer->mInfo.mClockOffsetError = clockOffsetError;
+			peer->mInfo.mMaxDrift = maxDrift;
+			// Where this clock was when the follower read clockTime, which the follower placed with its own offset estimate
+			if( synced )
+				peer->mInfo.mStateAgreement = clockTime - PlaybackClock::getTime( mClock->getState(), fromSeconds( leaderTime ) );
+		}
+		else if( ! mLeader && type == PONG && from == mLeaderAddress ) {
+			const double sentAt = reader.getF64();
+			const double leaderReceived = reader.getF64();
+			const double leaderSent = reader.getF64();
+			if( ! reader.isValid() )
+				return;
+
+			// The leader's time spent on the ping doesn't count towards the round trip. The fastest trips are the most
+			// symmetric, so their offset is the most trustworthy
+			const double receivedAt = toSeconds( received );
+			const double roundTrip = ( receivedAt - sentAt ) - ( leaderSent - leaderReceived );
+			const double offset = ( ( leaderReceived - sentAt ) + ( leaderSent - receivedAt ) ) / 2;
+			mRoundTrips.emplace_back( roundTrip / 2, offset );
+			if( mRoundTrips.size() > kNumRoundTrips )
+				mRoundTrips.erase( mRoundTrips.begin() );
+			std::vector<std::pair<double, double>> sorted( mRoundTrips );
+			std::sort( sorted.begin(), sorted.end() );
+			mLatency = sorted.front().first;
+			mClockOffset = sorted.front().second;
+			// Offsets wander with the latency, how far a typical trip's lands from the fastest one's tells the estimate's error
+			mClockOffsetError = std::abs( sorted[sorted.size() / 2].second - mClockOffset );
+			mLastHeard = received;
+			if( mHasState )
+				followState( mLeaderState );
+		}
+		else if( ! mLeader && type == STATE && from == mLeaderAddress ) {
+			PlaybackClock::State state;
+			state.mPlaying = reader.getU8() != 0;
+			state.mRate = reader.getF64();
+			state.mAnchorTime = reader.getF64();
+			state.mAnchorClock = fromSeconds( reader.getF64() );
+			state.mSeekDirection = reader.getU8() ? 1 : -1;
+			if( ! reader.isValid() )
+				return;
+
+			mLeaderState = state;
+			mHasState = true;
+			if( ! mRoundTrips.empty() )
+				followState( mLeaderState );
+		}
+	}
+
+	void ClockSync::followState( PlaybackClock::State state )
+	{
+		// Anchored on this node's steady clock, ahead by the output latency
+		const Clock::duration shift = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( mClockOffset + mOutputLatency ) );
+		state.mAnchorClock -= shift;
+
+		// Both run the same once they agree past the later of their anchors, which covers pending starts
+		const PlaybackClock::State current = mClock->getState();
+		if( current.mPlaying == state.mPlaying && current.mRate == state.mRate && current.mSeekDirection == state.mSeekDirection ) {
+			const Clock::time_point at = std::max( { Clock::now(), current.mAnchorClock, state.mAnchorClock } );
+			if( std::abs( PlaybackClock::getTime( current, at ) - PlaybackClock::getTime( state, at ) ) <= kSkewTolerance )
+				return;
+		}
+		mClock->setState( state );
+	}
+
+	void ClockSync::sendState()
+	{
+		mSentGeneration = mClock->getGeneration();
+		const PlaybackClock::State state = mClock->getState();
+		Writer message( STATE );
+		message.putU8( state.mPlaying ? 1 : 0 );
+		message.putF64( state.mRate );
+		message.putF64( state.mAnchorTime );
+		message.putF64( toSeconds( state.mAnchorClock ) );
+		message.putU8( state.mSeekDirection > 0 ? 1 : 0 );
+		for( const Peer &peer : mPeers )
+			send( message.getData(), peer.mAddress );
+		mNextState = Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( kStateInterval ) );
+	}
+
+	void ClockSync::sendPing()
+	{
+		// Reports where this node's display is as of now, on the leader's clock
+		const Clock::time_point now = Clock::now();
+		const Clock::duration outputLatency = std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( mOutputLatency ) );
+		Writer ping( PING );
+		ping.putF64( toSeconds( now ) );
+		ping.putU8( mHasState && ! mRoundTrips.empty() ? 1 : 0 );
+		ping.putF64( toSeconds( now ) + mClockOffset );
+		ping.putF64( PlaybackClock::getTime( mClock->getState(), now - outputLatency ) );
+		ping.putF64( mLatency );
+		ping.putF64( mClockOffsetError );
+		ping.putF64( mClock->getMaxDrift() );
+		send( ping.getData(), mLeaderAddress );
+		mNextPing = now + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( kPingInterval ) );
+	}
+
+	void ClockSync::send( const std::vector<uint8_t> &message, const Address &to )
+	{
+		sockaddr_in address;
+		std::memset( &address, 0, sizeof( address ) );
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl( to.mHost );
+		address.sin_port = htons( to.mPort );
+		// Lost messages are made up for by the next periodic ones
+		::sendto( mSocket, (const char *)message.data(), (int)message.size(), 0, (const sockaddr *)&address, sizeof( address ) );
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,136 @@
+/*
+ *  HapClockSync.h
+ *
+ *  Keeps the playback clocks of several processes or machines in step over UDP, ie. the nodes of a video wall.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapPlaybackClock.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	typedef std::shared_ptr<class ClockSync> ClockSyncRef;
+
+	//! Shares the PlaybackClock of a leader with any number of followers, each in its own process on this machine or another.
+	//! The leader sends the clock's state whenever it changes and a few times a second, anchored on its own steady clock.
+	//! Followers estimate the offset between both steady clocks from round trips, keeping the one of the fastest recent
+	//! trip, and rebuild the leader's state on their own clock, so network latency doesn't delay them. Their movies then
+	//! follow that clock as usual, see MovieGlHap::setPlaybackClock(), and pick the same frames as the leader's on the
+	//! same vsync. Only the leader's clock should be played, stopped or seeked, followers take over any change within one
+	//! message. Followers report the skew of their clock to the leader, see getMaxSkew(). All methods are thread-safe,
+	//! messages are handled on a thread of the ClockSync.
+	class ClockSync {
+	public:
+		static const uint16_t kDefaultPort = 7331;
+
+		//! Shares \a clock with the followers that connect to \a port. Returns null if the port can't be bound.
+		static ClockSyncRef		createLeader( const PlaybackClockRef &clock, uint16_t port = kDefaultPort );
+		//! Makes \a clock follow the leader at \a host, a name or an IPv4 address. Returns null if \a host can't be resolved.
+		static ClockSyncRef		createFollower( const PlaybackClockRef &clock, const std::string &host, uint16_t port = kDefaultPort );
+		~ClockSync();
+
+		bool					isLeader() const { return mLeader; }
+		const PlaybackClockRef&	getClock() const { return mClock; }
+
+		//! Shifts this node's clock ahead by \a seconds, for displays slower than the others to show a frame, ie. a projector
+		//! adding a frame of latency. Followers only.
+		void		setOutputLatency( double seconds );
+		double		getOutputLatency() const;
+
+		//! Returns true while a follower hears from its leader, or while a leader has followers.
+		bool		isConnected() const;
+		//! Returns the one-way latency to the leader, half the fastest recent round trip. Followers only.
+		double		getLatency() const;
+		//! Returns how far the leader's steady clock is ahead of this one's. Followers only.
+		double		getClockOffset() const;
+		//! Returns the estimated error of getClockOffset(), the spread between the offsets of the fastest and the median
+		//! recent round trips. Uneven latencies on the way there and back can make it larger, up to getLatency(). Followers only.
+		double		getClockOffsetError() const;
+
+		//! What the leader knows of one follower, as of its last report.
+		struct Follower {
+			std::string	mAddress;
+			double		mLatency;
+			//! Estimated error of the follower's clock offset, see getClockOffsetError().
+			double		mClockOffsetError;
+			//! How far the follower's clock was ahead of the leader's latest state, seen through the follower's own offset
+			//! estimate. Only shows whether the follower took that state over, never the estimate's error.
+			double		mStateAgreement;
+			//! Largest drift of the frames the follower showed from its clock, see PlaybackClock::getMaxDrift().
+			double		mMaxDrift;
+		};
+		//! Returns the followers heard from recently. Leaders only.
+		std::vector<Follower>	getFollowers() const;
+		size_t		getNumFollowers() const;
+		//! Returns the largest estimated skew between the leader's clock and a follower's, in seconds: the follower's clock
+		//! offset error plus its state agreement. Below half a frame, and with no frame drift on either node, they show the
+		//! same frame on the same vsync. Leaders only.
+		double		getMaxSkew() const;
+		//! Returns how far ahead to schedule a start for every follower to receive it in time, see PlaybackClock::playIn().
+		//! Leaders only.
+		double		getStartDelay() const;
+
+	protected:
+		ClockSync( const PlaybackClockRef &clock, bool leader );
+
+		typedef PlaybackClock::Clock Clock;
+
+		//! IPv4 address and port, in host byte order.
+		struct Address {
+			uint32_t	mHost;
+			uint16_t	mPort;
+			bool		operator==( const Address &other ) const { return mHost == other.mHost && mPort == other.mPort; }
+		};
+		static std::string	toString( const Address &address );
+
+		//! Handles messages and sends the periodic ones until stopped.
+		void		run();
+		void		receive();
+		void		handleMessage( const uint8_t *data, size_t size, const Address &from, Clock::time_point received );
+		void		sendState();
+		void		sendPing();
+		void		send( const std::vector<uint8_t> &message, const Address &to );
+		//! Rebuilds the leader's \a state on this node's clock, unless it already matches.
+		void		followState( PlaybackClock::State state );
+
+		//! Converts between steady clock time points and the seconds sent on the wire.
+		static double				toSeconds( Clock::time_point timePoint );
+		static Clock::time_point	fromSeconds( double seconds );
+
+		PlaybackClockRef	mClock;
+		bool				mLeader;
+		intptr_t			mSocket;
+
+		mutable std::mutex	mMutex;
+		double				mOutputLatency;
+
+		//! Follower side. Round trips as ( latency, offset ), oldest first.
+		Address				mLeaderAddress;
+		std::vector<std::pair<double, double>>	mRoundTrips;
+		double				mLatency, mClockOffset, mClockOffsetError;
+		Clock::time_point	mLastHeard, mNextPing;
+		bool				mHasState;
+		PlaybackClock::State	mLeaderState;
+
+		//! Leader side.
+		struct Peer {
+			Address				mAddress;
+			Follower			mInfo;
+			Clock::time_point	mLastHeard;
+		};
+		std::vector<Peer>	mPeers;
+		uint64_t			mSentGeneration;
+		Clock::time_point	mNextState;
+
+		std::atomic<bool>	mRunning;
+		std::thread			mThread;
+	};
+
+} } // namespace cinder::hap
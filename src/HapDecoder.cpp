@@ -0,0 +1,236 @@
+/*
+ *  HapDecoder.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapDecoder.h"
+#include "HapSnappy.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		// Section types, see the Hap specification
+		enum {
+			COMPRESSOR_NONE					= 0xA,
+			COMPRESSOR_SNAPPY				= 0xB,
+			COMPRESSOR_COMPLEX				= 0xC,
+
+			FORMAT_RGB_DXT1					= 0xB,
+			FORMAT_RGBA_DXT5				= 0xE,
+			FORMAT_YCOCG_DXT5				= 0xF,
+
+			SECTION_MULTIPLE_IMAGES			= 0x0D,
+			SECTION_DECODE_INSTRUCTIONS		= 0x01,
+			SECTION_CHUNK_COMPRESSORS		= 0x02,
+			SECTION_CHUNK_SIZES				= 0x03,
+			SECTION_CHUNK_OFFSETS			= 0x04
+		};
+
+		inline uint32_t readLE32( const uint8_t *p ) { return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ) | ( uint32_t( p[2] ) << 16 ) | ( uint32_t( p[3] ) << 24 ); }
+
+		//! Reads a section header: a 24-bit length and a type byte, or a zero length followed by a 32-bit length.
+		bool readSectionHeader( const uint8_t *data, size_t size, size_t *headerLength, size_t *sectionLength, uint8_t *type )
+		{
+			if( size < 4 )
+				return false;
+			*sectionLength = data[0] | ( data[1] << 8 ) | ( data[2] << 16 );
+			*type = data[3];
+			*headerLength = 4;
+			if( *sectionLength == 0 ) {
+				if( size < 8 )
+					return false;
+				*sectionLength = readLE32( data + 4 );
+				*headerLength = 8;
+			}
+			return *sectionLength <= size - *headerLength;
+		}
+
+		PixelFormat pixelFormatFromSection( uint8_t format )
+		{
+			switch( format ) {
+				case FORMAT_RGB_DXT1: return PIXEL_FORMAT_RGB_DXT1;
+				case FORMAT_RGBA_DXT5: return PIXEL_FORMAT_RGBA_DXT5;
+				case FORMAT_YCOCG_DXT5: return PIXEL_FORMAT_YCOCG_DXT5;
+				default: return PIXEL_FORMAT_UNKNOWN;
+			}
+		}
+
+		//! Returns the decompressed size of a chunk's payload, or false if its compressor is unknown or its header corrupt.
+		bool getChunkOutputSize( uint8_t compressor, const uint8_t *input, size_t inputSize, size_t *outputSize )
+		{
+			if( compressor == COMPRESSOR_NONE ) {
+				*outputSize = inputSize;
+				return true;
+			}
+			if( compressor == COMPRESSOR_SNAPPY )
+				return snappy::getUncompressedLength( input, inputSize, outputSize );
+			return false;
+		}
+
+	} // anonymous namespace
+
+	const char* toString( DecodeResult result )
+	{
+		switch( result ) {
+			case DecodeResult::SUCCESS: return "success";
+			case DecodeResult::BAD_ARGUMENTS: return "bad arguments";
+			case DecodeResult::BUFFER_TOO_SMALL: return "buffer too small";
+			case DecodeResult::BAD_FRAME: return "bad frame";
+			case DecodeResult::UNSUPPORTED_FORMAT: return "unsupported format";
+			default: return "unknown";
+		}
+	}
+
+	DecodeResult Decoder::parseFrame( const uint8_t *frame, size_t frameSize, FrameInfo *info, std::vector<Chunk> *chunks )
+	{
+		if( ! frame )
+			return DecodeResult::BAD_ARGUMENTS;
+
+		size_t headerLength, sectionLength;
+		uint8_t type;
+		if( ! readSectionHeader( frame, frameSize, &headerLength, &sectionLength, &type ) )
+			return DecodeResult::BAD_FRAME;
+		// Hap Q Alpha and other multi-texture frames aren't handled yet
+		if( type == SECTION_MULTIPLE_IMAGES )
+			return DecodeResult::UNSUPPORTED_FORMAT;
+
+		info->mPixelFormat = pixelFormatFromSection( type & 0x0F );
+		if( info->mPixelFormat == PIXEL_FORMAT_UNKNOWN )
+			return DecodeResult::UNSUPPORTED_FORMAT;
+
+		const uint8_t *data = frame + headerLength;
+		const uint8_t compressor = type >> 4;
+		chunks->clear();
+
+		if( compressor != COMPRESSOR_COMPLEX ) {
+			Chunk chunk = { data, sectionLength, compressor, 0, 0 };
+			if( ! getChunkOutputSize( compressor, data, sectionLength, &chunk.mOutputSize ) )
+				return DecodeResult::BAD_FRAME;
+			chunks->push_back( chunk );
+		}
+		else {
+			// The decode instructions container comes first, the chunks follow it
+			size_t instructionsHeader, instructionsLength;
+			uint8_t instructionsType;
+			if( ! readSectionHeader( data, sectionLength, &instructionsHeader, &instructionsLength, &instructionsType ) || instructionsType != SECTION_DECODE_INSTRUCTIONS )
+				return DecodeResult::BAD_FRAME;
+
+			const uint8_t *compressors = nullptr, *sizes = nullptr, *offsets = nullptr;
+			size_t numChunks = 0, numSizes = 0, numOffsets = 0;
+
+			const uint8_t *p = data + instructionsHeader;
+			const uint8_t *end = p + instructionsLength;
+			while( p < end ) {
+				size_t subHeader, subLength;
+				uint8_t subType;
+				if( ! readSectionHeader( p, end - p, &subHeader, &subLength, &subType ) )
+					return DecodeResult::BAD_FRAME;
+				const uint8_t *body = p + subHeader;
+				switch( subType ) {
+					case SECTION_CHUNK_COMPRESSORS: compressors = body; numChunks = subLength; break;
+					case SECTION_CHUNK_SIZES: sizes = body; numSizes = subLength / 4; break;
+					case SECTION_CHUNK_OFFSETS: offsets = body; numOffsets = subLength / 4; break;
+					default: break;
+				}
+				p = body + subLength;
+			}
+
+			if( ! compressors || ! sizes || numChunks == 0 || numSizes != numChunks || ( offsets && numOffsets != numChunks ) )
+				return DecodeResult::BAD_FRAME;
+
+			const uint8_t *chunkData = data + instructionsHeader + instructionsLength;
+			const size_t chunkDataSize = sectionLength - instructionsHeader - instructionsLength;
+
+			chunks->resize( numChunks );
+			size_t runningOffset = 0, outputOffset = 0;
+			for( size_t i = 0; i < numChunks; ++i ) {
+				const size_t size = readLE32( sizes + i * 4 );
+				const size_t offset = offsets ? readLE32( offsets + i * 4 ) : runningOffset;
+				if( offset > chunkDataSize || size > chunkDataSize - offset )
+					return DecodeResult::BAD_FRAME;
+				runningOffset = offset + size;
+
+				Chunk &chunk = (*chunks)[i];
+				chunk.mInput = chunkData + offset;
+				chunk.mInputSize = size;
+				chunk.mCompressor = compressors[i];
+				chunk.mOutputOffset = outputOffset;
+				if( ! getChunkOutputSize( chunk.mCompressor, chunk.mInput, chunk.mInputSize, &chunk.mOutputSize ) )
+					return DecodeResult::BAD_FRAME;
+				outputOffset += chunk.mOutputSize;
+			}
+		}
+
+		info->mNumChunks = (uint32_t)chunks->size();
+		info->mDecodedSize = chunks->back().mOutputOffset + chunks->back().mOutputSize;
+		return DecodeResult::SUCCESS;
+	}
+
+	bool Decoder::decodeChunk( const Chunk &chunk, uint8_t *output )
+	{
+		uint8_t *dst = output + chunk.mOutputOffset;
+		if( chunk.mCompressor == COMPRESSOR_NONE ) {
+			std::memcpy( dst, chunk.mInput, chunk.mInputSize );
+			return true;
+		}
+		return snappy::uncompress( chunk.mInput, chunk.mInputSize, dst, chunk.mOutputSize );
+	}
+
+	DecodeResult Decoder::getFrameInfo( const void *frame, size_t frameSize, FrameInfo *info )
+	{
+		if( ! info )
+			return DecodeResult::BAD_ARGUMENTS;
+		std::vector<Chunk> chunks;
+		return parseFrame( (const uint8_t*)frame, frameSize, info, &chunks );
+	}
+
+	DecodeResult Decoder::decode( const void *frame, size_t frameSize, void *output, size_t outputSize, FrameInfo *info )
+	{
+		FrameInfo localInfo;
+		if( ! info )
+			info = &localInfo;
+		if( ! output )
+			return DecodeResult::BAD_ARGUMENTS;
+
+		DecodeResult result = parseFrame( (const uint8_t*)frame, frameSize, info, &mChunks );
+		if( result != DecodeResult::SUCCESS )
+			return result;
+		if( info->mDecodedSize > outputSize )
+			return DecodeResult::BUFFER_TOO_SMALL;
+
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+		auto secondsSince = [start]( Clock::time_point t ) { return std::chrono::duration<double>( t - start ).count(); };
+
+		// Chunks write to disjoint ranges of the output, so they can decompress concurrently without any copy
+		mChunkTimings.resize( mChunks.size() );
+		std::atomic<bool> failed( false );
+		auto decodeOne = [&]( size_t index, size_t thread ) {
+			ChunkTiming &timing = mChunkTimings[index];
+			timing.mStart = secondsSince( Clock::now() );
+			if( ! decodeChunk( mChunks[index], (uint8_t*)output ) )
+				failed = true;
+			timing.mEnd = secondsSince( Clock::now() );
+			timing.mOutputSize = mChunks[index].mOutputSize;
+			timing.mThread = thread;
+		};
+
+		if( mThreadPool && mChunks.size() > 1 )
+			mThreadPool->parallelFor( mChunks.size(), decodeOne, mPriority );
+		else {
+			for( size_t i = 0; i < mChunks.size(); ++i )
+				decodeOne( i, 0 );
+		}
+
+		mLastDecodeSeconds = secondsSince( Clock::now() );
+		return failed ? DecodeResult::BAD_FRAME : DecodeResult::SUCCESS;
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,91 @@
+/*
+ *  HapDecoder.h
+ *
+ *  Portable Hap frame decoder. Parses the Hap section headers and runs the second-stage
+ *  decompression, producing the DXT payload that MovieGlHap uploads to the GPU.
+ *  See https://github.com/Vidvox/hap/blob/master/documentation/HapVideoDRAFT.md
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapThreadPool.h"
+#include "HapTypes.h"
+
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	enum class DecodeResult {
+		SUCCESS,
+		BAD_ARGUMENTS,
+		BUFFER_TOO_SMALL,
+		BAD_FRAME,
+		UNSUPPORTED_FORMAT
+	};
+
+	const char* toString( DecodeResult result );
+
+	//! Description of a compressed Hap frame, available without decompressing it.
+	struct FrameInfo {
+		FrameInfo() : mPixelFormat( PIXEL_FORMAT_UNKNOWN ), mDecodedSize( 0 ), mNumChunks( 0 ) {}
+
+		PixelFormat		mPixelFormat;
+		//! Size in bytes of the decoded DXT data.
+		size_t			mDecodedSize;
+		//! Number of independently compressed chunks; 1 for frames without decode instructions.
+		uint32_t		mNumChunks;
+	};
+
+	class Decoder {
+	public:
+		//! Time spent decompressing one chunk of the last decoded frame.
+		struct ChunkTiming {
+			//! Offsets from the start of decode(), in seconds.
+			double		mStart, mEnd;
+			size_t		mOutputSize;
+			//! Participant of ThreadPool::parallelFor() that ran the chunk, 0 being the thread calling decode().
+			size_t		mThread;
+		};
+
+		Decoder() : mPriority( TaskPriority::ON_SCREEN ), mLastDecodeSeconds( 0 ) {}
+
+		//! Spreads the chunks of multi-chunk frames over \a pool. A null pool decodes every chunk on the calling thread.
+		void					setThreadPool( const ThreadPoolRef &pool ) { mThreadPool = pool; }
+		const ThreadPoolRef&	getThreadPool() const { return mThreadPool; }
+		//! Sets the priority of the chunk tasks queued on the thread pool.
+		void					setPriority( TaskPriority priority ) { mPriority = priority; }
+		TaskPriority			getPriority() const { return mPriority; }
+
+		//! Parses the headers of \a frame into \a info.
+		static DecodeResult	getFrameInfo( const void *frame, size_t frameSize, FrameInfo *info );
+
+		//! Decodes \a frame into \a output, which must hold at least FrameInfo::mDecodedSize bytes. \a info is optional.
+		DecodeResult		decode( const void *frame, size_t frameSize, void *output, size_t outputSize, FrameInfo *info = nullptr );
+
+		//! Returns the per-chunk timings of the last decode() call.
+		const std::vector<ChunkTiming>&	getChunkTimings() const { return mChunkTimings; }
+		//! Returns the wall-clock duration of the last decode() call, in seconds.
+		double							getLastDecodeSeconds() const { return mLastDecodeSeconds; }
+
+	protected:
+		//! A run of the frame that decompresses independently into [mOutputOffset, mOutputOffset + mOutputSize) of the output.
+		struct Chunk {
+			const uint8_t	*mInput;
+			size_t			mInputSize;
+			uint8_t			mCompressor;
+			size_t			mOutputOffset;
+			size_t			mOutputSize;
+		};
+
+		static DecodeResult	parseFrame( const uint8_t *frame, size_t frameSize, FrameInfo *info, std::vector<Chunk> *chunks );
+		static bool			decodeChunk( const Chunk &chunk, uint8_t *output );
+
+		ThreadPoolRef				mThreadPool;
+		TaskPriority				mPriority;
+		std::vector<Chunk>			mChunks;
+		std::vector<ChunkTiming>	mChunkTimings;
+		double						mLastDecodeSeconds;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,1069 @@
+/*
+ *  HapDxt.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapDxt.h"
+
+#if defined( __x86_64__ ) || defined( _M_X64 ) || defined( __i386__ ) || defined( _M_IX86 )
+	#define HAP_DXT_X86
+	#include <immintrin.h>
+	#if defined( _MSC_VER )
+		#include <intrin.h>
+	#endif
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+	#define HAP_DXT_NEON
+	#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit instructions of the targets enabled for the function, MSVC emits any intrinsic
+#if defined( HAP_DXT_X86 ) && ( defined( __GNUC__ ) || defined( __clang__ ) )
+	#define HAP_TARGET( features ) __attribute__(( target( features ) ))
+#else
+	#define HAP_TARGET( features )
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace cinder { namespace hap { namespace dxt {
+
+	namespace {
+
+		//! Bands of block rows queued per decode thread, so uneven bands even out.
+		const size_t kBandsPerThread = 4;
+		const uint32_t kRgbMask = 0x00FFFFFF;
+
+		//! Layouts of the blocks the kernels decode. YCoCg-DXT5 blocks are DXT5 blocks whose texels convert to RGB.
+		enum BlockFormat {
+			BLOCKS_DXT1,
+			BLOCKS_DXT5,
+			BLOCKS_YCOCG_DXT5
+		};
+
+		//! Offset of the Co and Cg channels in ScaledCoCgYToRGBA.frag.
+		const float kCoCgOffset = -0.50196078431373f;
+
+		inline uint32_t readLE16( const uint8_t *p ) { return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ); }
+		inline uint32_t readLE32( const uint8_t *p ) { return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 ) | ( uint32_t( p[2] ) << 16 ) | ( uint32_t( p[3] ) << 24 ); }
+
+		//! Pixels are RGBA8 in memory, so R is the low byte of their little-endian word.
+		inline uint32_t packRgba( uint32_t r, uint32_t g, uint32_t b, uint32_t a ) { return r | ( g << 8 ) | ( b << 16 ) | ( a << 24 ); }
+
+		//! Builds the palette of the color block at \a block. With \a dxt1, blocks whose first endpoint isn't the larger have
+		//! three colors and transparent black, DXT5's color blocks always have four. Shared by every kernel, so they all
+		//! interpolate alike and only differ in how they pick the colors.
+		inline void buildColors( const uint8_t *block, bool dxt1, uint32_t colors[4] )
+		{
+			const uint32_t c0 = readLE16( block ), c1 = readLE16( block + 2 );
+			// 565 widened to 888 by repeating the top bits
+			const uint32_t r0 = ( ( c0 >> 11 ) << 3 ) | ( c0 >> 13 ), g0 = ( ( ( c0 >> 5 ) & 0x3F ) << 2 ) | ( ( c0 >> 9 ) & 0x3 ), b0 = ( ( c0 & 0x1F ) << 3 ) | ( ( c0 >> 2 ) & 0x7 );
+			const uint32_t r1 = ( ( c1 >> 11 ) << 3 ) | ( c1 >> 13 ), g1 = ( ( ( c1 >> 5 ) & 0x3F ) << 2 ) | ( ( c1 >> 9 ) & 0x3 ), b1 = ( ( c1 & 0x1F ) << 3 ) | ( ( c1 >> 2 ) & 0x7 );
+			colors[0] = packRgba( r0, g0, b0, 0xFF );
+			colors[1] = packRgba( r1, g1, b1, 0xFF );
+			if( dxt1 && c0 <= c1 ) {
+				colors[2] = packRgba( ( r0 + r1 ) / 2, ( g0 + g1 ) / 2, ( b0 + b1 ) / 2, 0xFF );
+				colors[3] = 0;
+			}
+			else {
+				colors[2] = packRgba( ( 2 * r0 + r1 ) / 3, ( 2 * g0 + g1 ) / 3, ( 2 * b0 + b1 ) / 3, 0xFF );
+				colors[3] = packRgba( ( r0 + 2 * r1 ) / 3, ( g0 + 2 * g1 ) / 3, ( b0 + 2 * b1 ) / 3, 0xFF );
+			}
+		}
+
+		//! Builds the eight alphas of the DXT5 alpha block at \a block, already shifted into the alpha byte of a pixel.
+		inline void buildAlphas( const uint8_t *block, uint32_t alphas[8] )
+		{
+			const uint32_t a0 = block[0], a1 = block[1];
+			alphas[0] = a0 << 24;
+			alphas[1] = a1 << 24;
+			if( a0 > a1 ) {
+				for( uint32_t i = 1; i < 7; ++i )
+					alphas[i + 1] = ( ( ( 7 - i ) * a0 + i * a1 ) / 7 ) << 24;
+			}
+			else {
+				for( uint32_t i = 1; i < 5; ++i )
+					alphas[i + 1] = ( ( ( 5 - i ) * a0 + i * a1 ) / 5 ) << 24;
+				alphas[6] = 0;
+				alphas[7] = 0xFFu << 24;
+			}
+		}
+
+		//! Returns the 48 bits of 3-bit alpha indices of the DXT5 alpha block at \a block, the first pixel's lowest.
+		inline uint64_t readAlphaIndices( const uint8_t *block )
+		{
+			return uint64_t( readLE16( block + 2 ) ) | ( uint64_t( readLE32( block + 4 ) ) << 16 );
+		}
+
+		//! Converts [0, 1] to a byte the way a GL_RGBA8 render target stores it.
+		inline uint32_t toUnorm( float value )
+		{
+			return uint32_t( std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+		}
+
+		//! Converts a texel holding Co, Cg, the scale and Y to RGB, as ScaledCoCgYToRGBA.frag does and in the same
+		//! single-precision steps, so the vector kernels below match it bit for bit. The texture unit's byte to [0, 1]
+		//! conversion is a division by 255.
+		inline uint32_t convertYCoCg( uint32_t texel )
+		{
+			const float co = float( texel & 0xFF ) / 255.0f + kCoCgOffset;
+			const float cg = float( ( texel >> 8 ) & 0xFF ) / 255.0f + kCoCgOffset;
+			const float scale = float( ( texel >> 16 ) & 0xFF ) / 255.0f * ( 255.0f / 8.0f ) + 1.0f;
+			const float y = float( texel >> 24 ) / 255.0f;
+			const float coScaled = co / scale, cgScaled = cg / scale;
+			return packRgba( toUnorm( y + coScaled - cgScaled ), toUnorm( y + cgScaled ), toUnorm( y - coScaled - cgScaled ), 0xFF );
+		}
+
+		//! Decodes \a numBlocks consecutive blocks to the 4 x 4 pixels at \a out, rows \a rowBytes apart.
+		typedef void ( *DecodeBlocksFn )( const uint8_t *blocks, size_t numBlocks, uint8_t *out, size_t rowBytes );
+
+		template<int kFormat>
+		void decodeBlocksScalar( const uint8_t *blocks, size_t numBlocks, uint8_t *out, size_t rowBytes )
+		{
+			const bool dxt5 = kFormat != BLOCKS_DXT1;
+			for( size_t i = 0; i < numBlocks; ++i, blocks += dxt5 ? 16 : 8, out += 16 ) {
+				const uint8_t *colorBlock = dxt5 ? blocks + 8 : blocks;
+				uint32_t colors[4], alphas[8];
+				buildColors( colorBlock, ! dxt5, colors );
+				uint32_t indices = readLE32( colorBlock + 4 );
+				uint64_t alphaIndices = 0;
+				if( dxt5 ) {
+					buildAlphas( blocks, alphas );
+					alphaIndices = readAlphaIndices( blocks );
+				}
+
+				for( size_t y = 0; y < 4; ++y ) {
+					for( size_t x = 0; x < 4; ++x ) {
+						uint32_t pixel = colors[indices & 0x3];
+						indices >>= 2;
+						if( dxt5 ) {
+							pixel = ( pixel & kRgbMask ) | alphas[alphaIndices & 0x7];
+							alphaIndices >>= 3;
+						}
+						if( kFormat == BLOCKS_YCOCG_DXT5 )
+							pixel = convertYCoCg( pixel );
+						std::memcpy( out + y * rowBytes + x * 4, &pixel, 4 );
+					}
+				}
+			}
+		}
+
+#if defined( HAP_DXT_X86 )
+		//! convertYCoCg() on four pixels.
+		HAP_TARGET( "sse2" ) inline __m128i convertYCoCgSse2( __m128i texels )
+		{
+			const __m128i byteMask = _mm_set1_epi32( 0xFF );
+			const __m128 offset = _mm_set1_ps( kCoCgOffset ), maxByte = _mm_set1_ps( 255.0f ), zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.0f );
+			const __m128 co = _mm_add_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_and_si128( texels, byteMask ) ), maxByte ), offset );
+			const __m128 cg = _mm_add_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( texels, 8 ), byteMask ) ), maxByte ), offset );
+			const __m128 scale = _mm_add_ps( _mm_mul_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( texels, 16 ), byteMask ) ), maxByte ), _mm_set1_ps( 255.0f / 8.0f ) ), one );
+			const __m128 y = _mm_div_ps( _mm_cvtepi32_ps( _mm_srli_epi32( texels, 24 ) ), maxByte );
+			const __m128 coScaled = _mm_div_ps( co, scale ), cgScaled = _mm_div_ps( cg, scale );
+
+			const __m128 half = _mm_set1_ps( 0.5f );
+			const __m128i r = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_sub_ps( _mm_add_ps( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			const __m128i g = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_add_ps( y, cgScaled ), zero ), one ), maxByte ), half ) );
+			const __m128i b = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_min_ps( _mm_max_ps( _mm_sub_ps( _mm_sub_ps( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			return _mm_or_si128( _mm_or_si128( r, _mm_slli_epi32( g, 8 ) ), _mm_or_si128( _mm_slli_epi32( b, 16 ), _mm_set1_epi32( (int)~kRgbMask ) ) );
+		}
+
+		//! convertYCoCg() on eight pixels.
+		HAP_TARGET( "avx2" ) inline __m256i convertYCoCgAvx2( __m256i texels )
+		{
+			const __m256i byteMask = _mm256_set1_epi32( 0xFF );
+			const __m256 offset = _mm256_set1_ps( kCoCgOffset ), maxByte = _mm256_set1_ps( 255.0f ), zero = _mm256_setzero_ps(), one = _mm256_set1_ps( 1.0f );
+			const __m256 co = _mm256_add_ps( _mm256_div_ps( _mm256_cvtepi32_ps( _mm256_and_si256( texels, byteMask ) ), maxByte ), offset );
+			const __m256 cg = _mm256_add_ps( _mm256_div_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( texels, 8 ), byteMask ) ), maxByte ), offset );
+			const __m256 scale = _mm256_add_ps( _mm256_mul_ps( _mm256_div_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( texels, 16 ), byteMask ) ), maxByte ), _mm256_set1_ps( 255.0f / 8.0f ) ), one );
+			const __m256 y = _mm256_div_ps( _mm256_cvtepi32_ps( _mm256_srli_epi32( texels, 24 ) ), maxByte );
+			const __m256 coScaled = _mm256_div_ps( co, scale ), cgScaled = _mm256_div_ps( cg, scale );
+
+			const __m256 half = _mm256_set1_ps( 0.5f );
+			const __m256i r = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( _mm256_sub_ps( _mm256_add_ps( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			const __m256i g = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( _mm256_add_ps( y, cgScaled ), zero ), one ), maxByte ), half ) );
+			const __m256i b = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( _mm256_min_ps( _mm256_max_ps( _mm256_sub_ps( _mm256_sub_ps( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			return _mm256_or_si256( _mm256_or_si256( r, _mm256_slli_epi32( g, 8 ) ), _mm256_or_si256( _mm256_slli_epi32( b, 16 ), _mm256_set1_epi32( (int)~kRgbMask ) ) );
+		}
+
+		template<int kFormat>
+		HAP_TARGET( "sse2" ) void decodeBlocksSse2( const uint8_t *blocks, size_t numBlocks, uint8_t *out, size_t rowBytes )
+		{
+			const bool dxt5 = kFormat != BLOCKS_DXT1;
+			// Without variable shifts, each lane masks its pixel's index in place and compares it against every value it can take
+			const __m128i indexMask = _mm_setr_epi32( 0x3, 0x3 << 2, 0x3 << 4, 0x3 << 6 );
+			const __m128i indexOne = _mm_setr_epi32( 0x1, 0x1 << 2, 0x1 << 4, 0x1 << 6 );
+			const __m128i indexTwo = _mm_setr_epi32( 0x2, 0x2 << 2, 0x2 << 4, 0x2 << 6 );
+			const __m128i rgbMask = _mm_set1_epi32( (int)kRgbMask );
+			for( size_t i = 0; i < numBlocks; ++i, blocks += dxt5 ? 16 : 8, out += 16 ) {
+				const uint8_t *colorBlock = dxt5 ? blocks + 8 : blocks;
+				uint32_t colors[4], alphas[8];
+				buildColors( colorBlock, ! dxt5, colors );
+				const __m128i c0 = _mm_set1_epi32( (int)colors[0] ), c1 = _mm_set1_epi32( (int)colors[1] );
+				const __m128i c2 = _mm_set1_epi32( (int)colors[2] ), c3 = _mm_set1_epi32( (int)colors[3] );
+				const uint32_t indices = readLE32( colorBlock + 4 );
+				uint64_t alphaIndices = 0;
+				if( dxt5 ) {
+					buildAlphas( blocks, alphas );
+					alphaIndices = readAlphaIndices( blocks );
+				}
+
+				for( size_t y = 0; y < 4; ++y ) {
+					const __m128i index = _mm_and_si128( _mm_set1_epi32( int( indices >> ( 8 * y ) ) ), indexMask );
+					__m128i pixels = _mm_or_si128(
+						_mm_or_si128( _mm_and_si128( _mm_cmpeq_epi32( index, _mm_setzero_si128() ), c0 ), _mm_and_si128( _mm_cmpeq_epi32( index, indexOne ), c1 ) ),
+						_mm_or_si128( _mm_and_si128( _mm_cmpeq_epi32( index, indexTwo ), c2 ), _mm_and_si128( _mm_cmpeq_epi32( index, indexMask ), c3 ) ) );
+					if( dxt5 ) {
+						// Eight alphas would take twice the compares, looking them up is cheaper
+						const uint32_t row = uint32_t( alphaIndices >> ( 12 * y ) );
+						const __m128i alpha = _mm_setr_epi32( (int)alphas[row & 0x7], (int)alphas[( row >> 3 ) & 0x7], (int)alphas[( row >> 6 ) & 0x7], (int)alphas[( row >> 9 ) & 0x7] );
+						pixels = _mm_or_si128( _mm_and_si128( pixels, rgbMask ), alpha );
+					}
+					if( kFormat == BLOCKS_YCOCG_DXT5 )
+						pixels = convertYCoCgSse2( pixels );
+					_mm_storeu_si128( (__m128i *)( out + y * rowBytes ), pixels );
+				}
+			}
+		}
+
+		template<int kFormat>
+		HAP_TARGET( "avx2" ) void decodeBlocksAvx2( const uint8_t *blocks, size_t numBlocks, uint8_t *out, size_t rowBytes )
+		{
+			const bool dxt5 = kFormat != BLOCKS_DXT1;
+			// Two rows at once, each lane shifting its pixel's index down and permuting the palette with it
+			const __m256i colorShifts = _mm256_setr_epi32( 0, 2, 4, 6, 8, 10, 12, 14 );
+			const __m256i alphaShifts = _mm256_setr_epi32( 0, 3, 6, 9, 12, 15, 18, 21 );
+			const __m256i colorMask = _mm256_set1_epi32( 0x3 ), alphaMask = _mm256_set1_epi32( 0x7 );
+			const __m256i rgbMask = _mm256_set1_epi32( (int)kRgbMask );
+			for( size_t i = 0; i < numBlocks; ++i, blocks += dxt5 ? 16 : 8, out += 16 ) {
+				const uint8_t *colorBlock = dxt5 ? blocks + 8 : blocks;
+				uint32_t colors[4], alphas[8];
+				buildColors( colorBlock, ! dxt5, colors );
+				const __m256i palette = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i *)colors ) );
+				const uint32_t indices = readLE32( colorBlock + 4 );
+				__m256i alphaPalette = _mm256_setzero_si256();
+				uint64_t alphaIndices = 0;
+				if( dxt5 ) {
+					buildAlphas( blocks, alphas );
+					alphaPalette = _mm256_loadu_si256( (const __m256i *)alphas );
+					alphaIndices = readAlphaIndices( blocks );
+				}
+
+				for( size_t y = 0; y < 4; y += 2 ) {
+					const __m256i index = _mm256_and_si256( _mm256_srlv_epi32( _mm256_set1_epi32( int( indices >> ( 8 * y ) ) ), colorShifts ), colorMask );
+					__m256i pixels = _mm256_permutevar8x32_epi32( palette, index );
+					if( dxt5 ) {
+						const __m256i alphaIndex = _mm256_and_si256( _mm256_srlv_epi32( _mm256_set1_epi32( int( alphaIndices >> ( 12 * y ) ) ), alphaShifts ), alphaMask );
+						pixels = _mm256_or_si256( _mm256_and_si256( pixels, rgbMask ), _mm256_permutevar8x32_epi32( alphaPalette, alphaIndex ) );
+					}
+					if( kFormat == BLOCKS_YCOCG_DXT5 )
+						pixels = convertYCoCgAvx2( pixels );
+					_mm_storeu_si128( (__m128i *)( out + y * rowBytes ), _mm256_castsi256_si128( pixels ) );
+					_mm_storeu_si128( (__m128i *)( out + ( y + 1 ) * rowBytes ), _mm256_extracti128_si256( pixels, 1 ) );
+				}
+			}
+		}
+
+		bool cpuHasSse2()
+		{
+	#if defined( __x86_64__ ) || defined( _M_X64 )
+			return true;
+	#elif defined( _MSC_VER )
+			int info[4];
+			__cpuid( info, 1 );
+			return ( info[3] & ( 1 << 26 ) ) != 0;
+	#else
+			return __builtin_cpu_supports( "sse2" );
+	#endif
+		}
+
+		bool cpuHasAvx2()
+		{
+	#if defined( _MSC_VER )
+			int info[4];
+			__cpuid( info, 0 );
+			if( info[0] < 7 )
+				return false;
+			// The OS must also save the YMM registers across context switches
+			__cpuid( info, 1 );
+			const bool avx = ( info[2] & ( 1 << 27 ) ) && ( info[2] & ( 1 << 28 ) ) && ( _xgetbv( 0 ) & 0x6 ) == 0x6;
+			__cpuidex( info, 7, 0 );
+			return avx && ( info[1] & ( 1 << 5 ) );
+	#else
+			return __builtin_cpu_supports( "avx2" );
+	#endif
+		}
+#endif
+
+#if defined( HAP_DXT_NEON )
+		//! convertYCoCg() on four pixels.
+		inline uint32x4_t convertYCoCgNeon( uint32x4_t texels )
+		{
+			const uint32x4_t byteMask = vdupq_n_u32( 0xFF );
+			const float32x4_t offset = vdupq_n_f32( kCoCgOffset ), maxByte = vdupq_n_f32( 255.0f ), zero = vdupq_n_f32( 0.0f ), one = vdupq_n_f32( 1.0f );
+			const float32x4_t co = vaddq_f32( vdivq_f32( vcvtq_f32_u32( vandq_u32( texels, byteMask ) ), maxByte ), offset );
+			const float32x4_t cg = vaddq_f32( vdivq_f32( vcvtq_f32_u32( vandq_u32( vshrq_n_u32( texels, 8 ), byteMask ) ), maxByte ), offset );
+			const float32x4_t scale = vaddq_f32( vmulq_f32( vdivq_f32( vcvtq_f32_u32( vandq_u32( vshrq_n_u32( texels, 16 ), byteMask ) ), maxByte ), vdupq_n_f32( 255.0f / 8.0f ) ), one );
+			const float32x4_t y = vdivq_f32( vcvtq_f32_u32( vshrq_n_u32( texels, 24 ) ), maxByte );
+			const float32x4_t coScaled = vdivq_f32( co, scale ), cgScaled = vdivq_f32( cg, scale );
+
+			const float32x4_t half = vdupq_n_f32( 0.5f );
+			const uint32x4_t r = vcvtq_u32_f32( vaddq_f32( vmulq_f32( vminq_f32( vmaxq_f32( vsubq_f32( vaddq_f32( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			const uint32x4_t g = vcvtq_u32_f32( vaddq_f32( vmulq_f32( vminq_f32( vmaxq_f32( vaddq_f32( y, cgScaled ), zero ), one ), maxByte ), half ) );
+			const uint32x4_t b = vcvtq_u32_f32( vaddq_f32( vmulq_f32( vminq_f32( vmaxq_f32( vsubq_f32( vsubq_f32( y, coScaled ), cgScaled ), zero ), one ), maxByte ), half ) );
+			return vorrq_u32( vorrq_u32( r, vshlq_n_u32( g, 8 ) ), vorrq_u32( vshlq_n_u32( b, 16 ), vdupq_n_u32( ~kRgbMask ) ) );
+		}
+
+		template<int kFormat>
+		void decodeBlocksNeon( const uint8_t *blocks, size_t numBlocks, uint8_t *out, size_t rowBytes )
+		{
+			const bool dxt5 = kFormat != BLOCKS_DXT1;
+			// Each lane shifts its pixel's index down and turns it into the byte offsets of its palette entry for a table lookup
+			const int32_t colorShiftValues[4] = { 0, -2, -4, -6 }, alphaShiftValues[4] = { 0, -3, -6, -9 };
+			const int32x4_t colorShifts = vld1q_s32( colorShiftValues ), alphaShifts = vld1q_s32( alphaShiftValues );
+			const uint32x4_t byteOffsets = vdupq_n_u32( 0x03020100 );
+			const uint32x4_t rgbMask = vdupq_n_u32( kRgbMask );
+			for( size_t i = 0; i < numBlocks; ++i, blocks += dxt5 ? 16 : 8, out += 16 ) {
+				const uint8_t *colorBlock = dxt5 ? blocks + 8 : blocks;
+				uint32_t colors[4], alphas[8];
+				buildColors( colorBlock, ! dxt5, colors );
+				const uint8x16_t palette = vreinterpretq_u8_u32( vld1q_u32( colors ) );
+				const uint32_t indices = readLE32( colorBlock + 4 );
+				uint8_t alphaTable[16] = {};
+				uint64_t alphaIndices = 0;
+				if( dxt5 ) {
+					buildAlphas( blocks, alphas );
+					for( size_t a = 0; a < 8; ++a )
+						alphaTable[a] = uint8_t( alphas[a] >> 24 );
+					alphaIndices = readAlphaIndices( blocks );
+				}
+				const uint8x16_t alphaPalette = vld1q_u8( alphaTable );
+
+				for( size_t y = 0; y < 4; ++y ) {
+					const uint32x4_t index = vandq_u32( vshlq_u32( vdupq_n_u32( indices >> ( 8 * y ) ), colorShifts ), vdupq_n_u32( 0x3 ) );
+					uint32x4_t pixels = vreinterpretq_u32_u8( vqtbl1q_u8( palette, vreinterpretq_u8_u32( vmlaq_n_u32( byteOffsets, index, 0x04040404 ) ) ) );
+					if( dxt5 ) {
+						// Only the alpha byte indexes the table, the others are out of range and look up 0
+						const uint32x4_t alphaIndex = vandq_u32( vshlq_u32( vdupq_n_u32( uint32_t( alphaIndices >> ( 12 * y ) ) ), alphaShifts ), vdupq_n_u32( 0x7 ) );
+						const uint32x4_t alpha = vreinterpretq_u32_u8( vqtbl1q_u8( alphaPalette, vreinterpretq_u8_u32( vorrq_u32( vshlq_n_u32( alphaIndex, 24 ), rgbMask ) ) ) );
+						pixels = vorrq_u32( vandq_u32( pixels, rgbMask ), alpha );
+					}
+					if( kFormat == BLOCKS_YCOCG_DXT5 )
+						pixels = convertYCoCgNeon( pixels );
+					vst1q_u8( out + y * rowBytes, vreinterpretq_u8_u32( pixels ) );
+				}
+			}
+		}
+#endif
+
+		DecodeBlocksFn getDecodeBlocks( Kernel kernel, PixelFormat format )
+		{
+			const BlockFormat blocks = format == PIXEL_FORMAT_RGB_DXT1 ? BLOCKS_DXT1 : format == PIXEL_FORMAT_RGBA_DXT5 ? BLOCKS_DXT5 : BLOCKS_YCOCG_DXT5;
+			switch( kernel ) {
+#if defined( HAP_DXT_X86 )
+				case Kernel::SSE2: {
+					static const DecodeBlocksFn sKernels[] = { decodeBlocksSse2<BLOCKS_DXT1>, decodeBlocksSse2<BLOCKS_DXT5>, decodeBlocksSse2<BLOCKS_YCOCG_DXT5> };
+					return sKernels[blocks];
+				}
+				case Kernel::AVX2: {
+					static const DecodeBlocksFn sKernels[] = { decodeBlocksAvx2<BLOCKS_DXT1>, decodeBlocksAvx2<BLOCKS_DXT5>, decodeBlocksAvx2<BLOCKS_YCOCG_DXT5> };
+					return sKernels[blocks];
+				}
+#endif
+#if defined( HAP_DXT_NEON )
+				case Kernel::NEON: {
+					static const DecodeBlocksFn sKernels[] = { decodeBlocksNeon<BLOCKS_DXT1>, decodeBlocksNeon<BLOCKS_DXT5>, decodeBlocksNeon<BLOCKS_YCOCG_DXT5> };
+					return sKernels[blocks];
+				}
+#endif
+				default: {
+					static const DecodeBlocksFn sKernels[] = { decodeBlocksScalar<BLOCKS_DXT1>, decodeBlocksScalar<BLOCKS_DXT5>, decodeBlocksScalar<BLOCKS_YCOCG_DXT5> };
+					return sKernels[blocks];
+				}
+			}
+		}
+
+
+		//! Picks the nearest of \a palette's 4 colors, or 8 alphas with \a alpha, for each of a block's 16 \a pixels, writes its
+		//! index to \a indices and returns the summed squared error. Encoders fit endpoints alike whatever the kernel and only
+		//! differ in how they run this part.
+		typedef uint32_t ( *SelectIndicesFn )( const uint32_t pixels[16], const uint32_t *palette, uint8_t indices[16] );
+
+		struct Selectors {
+			SelectIndicesFn	mColors, mAlphas;
+		};
+
+		template<bool kAlpha>
+		uint32_t selectIndicesScalar( const uint32_t pixels[16], const uint32_t *palette, uint8_t indices[16] )
+		{
+			const size_t paletteSize = kAlpha ? 8 : 4;
+			uint32_t error = 0;
+			for( size_t i = 0; i < 16; ++i ) {
+				uint32_t best = UINT32_MAX;
+				for( size_t k = 0; k < paletteSize; ++k ) {
+					uint32_t distance = 0;
+					for( int shift = kAlpha ? 24 : 0; shift < ( kAlpha ? 32 : 24 ); shift += 8 ) {
+						const int d = int( ( pixels[i] >> shift ) & 0xFF ) - int( ( palette[k] >> shift ) & 0xFF );
+						distance += uint32_t( d * d );
+					}
+					// Ties go to the lowest index, as in the vector kernels
+					if( distance < best ) {
+						best = distance;
+						indices[i] = uint8_t( k );
+					}
+				}
+				error += best;
+			}
+			return error;
+		}
+
+#if defined( HAP_DXT_X86 )
+		//! selectIndicesScalar() on four pixels at a time. Channels sit in the low half of 32-bit lanes, so the 16-bit
+		//! difference of a channel is its lane's low half and multiplying-adding it with itself squares it.
+		template<bool kAlpha>
+		HAP_TARGET( "sse2" ) uint32_t selectIndicesSse2( const uint32_t pixels[16], const uint32_t *palette, uint8_t indices[16] )
+		{
+			const size_t paletteSize = kAlpha ? 8 : 4, numChannels = kAlpha ? 1 : 3;
+			const __m128i byteMask = _mm_set1_epi32( 0xFF );
+			__m128i entries[8][3];
+			for( size_t k = 0; k < paletteSize; ++k ) {
+				for( size_t c = 0; c < numChannels; ++c )
+					entries[k][c] = _mm_set1_epi32( int( ( palette[k] >> ( kAlpha ? 24 : 8 * c ) ) & 0xFF ) );
+			}
+
+			__m128i error = _mm_setzero_si128();
+			for( size_t i = 0; i < 16; i += 4 ) {
+				const __m128i p = _mm_loadu_si128( (const __m128i *)( pixels + i ) );
+				__m128i channels[3];
+				for( size_t c = 0; c < numChannels; ++c )
+					channels[c] = _mm_and_si128( _mm_srli_epi32( p, kAlpha ? 24 : int( 8 * c ) ), byteMask );
+
+				__m128i best = _mm_set1_epi32( INT32_MAX ), index = _mm_setzero_si128();
+				for( size_t k = 0; k < paletteSize; ++k ) {
+					__m128i distance = _mm_setzero_si128();
+					for( size_t c = 0; c < numChannels; ++c ) {
+						const __m128i d = _mm_sub_epi16( channels[c], entries[k][c] );
+						distance = _mm_add_epi32( distance, _mm_madd_epi16( d, d ) );
+					}
+					const __m128i closer = _mm_cmplt_epi32( distance, best );
+					best = _mm_or_si128( _mm_and_si128( closer, distance ), _mm_andnot_si128( closer, best ) );
+					index = _mm_or_si128( _mm_and_si128( closer, _mm_set1_epi32( int( k ) ) ), _mm_andnot_si128( closer, index ) );
+				}
+				error = _mm_add_epi32( error, best );
+				// Indices fit a byte, packing twice gathers the four of them in the low 32 bits
+				const __m128i packed16 = _mm_packs_epi32( index, index );
+				const __m128i packed = _mm_packus_epi16( packed16, packed16 );
+				const uint32_t four = uint32_t( _mm_cvtsi128_si32( packed ) );
+				std::memcpy( indices + i, &four, 4 );
+			}
+			error = _mm_add_epi32( error, _mm_shuffle_epi32( error, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+			error = _mm_add_epi32( error, _mm_shuffle_epi32( error, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+			return uint32_t( _mm_cvtsi128_si32( error ) );
+		}
+
+		//! selectIndicesScalar() on eight pixels at a time.
+		template<bool kAlpha>
+		HAP_TARGET( "avx2" ) uint32_t selectIndicesAvx2( const uint32_t pixels[16], const uint32_t *palette, uint8_t indices[16] )
+		{
+			const size_t paletteSize = kAlpha ? 8 : 4, numChannels = kAlpha ? 1 : 3;
+			const __m256i byteMask = _mm256_set1_epi32( 0xFF );
+			__m256i entries[8][3];
+			for( size_t k = 0; k < paletteSize; ++k ) {
+				for( size_t c = 0; c < numChannels; ++c )
+					entries[k][c] = _mm256_set1_epi32( int( ( palette[k] >> ( kAlpha ? 24 : 8 * c ) ) & 0xFF ) );
+			}
+
+			__m256i error = _mm256_setzero_si256();
+			for( size_t i = 0; i < 16; i += 8 ) {
+				const __m256i p = _mm256_loadu_si256( (const __m256i *)( pixels + i ) );
+				__m256i channels[3];
+				for( size_t c = 0; c < numChannels; ++c )
+					channels[c] = _mm256_and_si256( _mm256_srli_epi32( p, kAlpha ? 24 : int( 8 * c ) ), byteMask );
+
+				__m256i best = _mm256_set1_epi32( INT32_MAX ), index = _mm256_setzero_si256();
+				for( size_t k = 0; k < paletteSize; ++k ) {
+					__m256i distance = _mm256_setzero_si256();
+					for( size_t c = 0; c < numChannels; ++c ) {
+						const __m256i d = _mm256_sub_epi32( channels[c], entries[k][c] );
+						distance = _mm256_add_epi32( distance, _mm256_mullo_epi32( d, d ) );
+					}
+					const __m256i closer = _mm256_cmpgt_epi32( best, distance );
+					best = _mm256_min_epi32( best, distance );
+					index = _mm256_blendv_epi8( index, _mm256_set1_epi32( int( k ) ), closer );
+				}
+				error = _mm256_add_epi32( error, best );
+				const __m128i packed16 = _mm_packs_epi32( _mm256_castsi256_si128( index ), _mm256_extracti128_si256( index, 1 ) );
+				_mm_storel_epi64( (__m128i *)( indices + i ), _mm_packus_epi16( packed16, packed16 ) );
+			}
+			__m128i sum = _mm_add_epi32( _mm256_castsi256_si128( error ), _mm256_extracti128_si256( error, 1 ) );
+			sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+			sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+			return uint32_t( _mm_cvtsi128_si32( sum ) );
+		}
+#endif
+
+#if defined( HAP_DXT_NEON )
+		//! selectIndicesScalar() on four pixels at a time.
+		template<bool kAlpha>
+		uint32_t selectIndicesNeon( const uint32_t pixels[16], const uint32_t *palette, uint8_t indices[16] )
+		{
+			const size_t paletteSize = kAlpha ? 8 : 4, numChannels = kAlpha ? 1 : 3;
+			const uint32x4_t byteMask = vdupq_n_u32( 0xFF );
+			int32x4_t entries[8][3];
+			for( size_t k = 0; k < paletteSize; ++k ) {
+				for( size_t c = 0; c < numChannels; ++c )
+					entries[k][c] = vdupq_n_s32( int32_t( ( palette[k] >> ( kAlpha ? 24 : 8 * c ) ) & 0xFF ) );
+			}
+
+			uint32x4_t error = vdupq_n_u32( 0 );
+			for( size_t i = 0; i < 16; i += 4 ) {
+				const uint32x4_t p = vld1q_u32( pixels + i );
+				int32x4_t channels[3];
+				channels[0] = vreinterpretq_s32_u32( vandq_u32( kAlpha ? vshrq_n_u32( p, 24 ) : p, byteMask ) );
+				if( ! kAlpha ) {
+					channels[1] = vreinterpretq_s32_u32( vandq_u32( vshrq_n_u32( p, 8 ), byteMask ) );
+					channels[2] = vreinterpretq_s32_u32( vandq_u32( vshrq_n_u32( p, 16 ), byteMask ) );
+				}
+
+				uint32x4_t best = vdupq_n_u32( UINT32_MAX ), index = vdupq_n_u32( 0 );
+				for( size_t k = 0; k < paletteSize; ++k ) {
+					int32x4_t distance = vdupq_n_s32( 0 );
+					for( size_t c = 0; c < numChannels; ++c ) {
+						const int32x4_t d = vsubq_s32( channels[c], entries[k][c] );
+						distance = vmlaq_s32( distance, d, d );
+					}
+					const uint32x4_t closer = vcltq_u32( vreinterpretq_u32_s32( distance ), best );
+					best = vminq_u32( best, vreinterpretq_u32_s32( distance ) );
+					index = vbslq_u32( closer, vdupq_n_u32( uint32_t( k ) ), index );
+				}
+				error = vaddq_u32( error, best );
+				const uint8x8_t packed = vmovn_u16( vcombine_u16( vmovn_u32( index ), vdup_n_u16( 0 ) ) );
+				const uint32_t four = vget_lane_u32( vreinterpret_u32_u8( packed ), 0 );
+				std::memcpy( indices + i, &four, 4 );
+			}
+			return vaddvq_u32( error );
+		}
+#endif
+
+		Selectors getSelectors( Kernel kernel )
+		{
+			switch( kernel ) {
+#if defined( HAP_DXT_X86 )
+				case Kernel::SSE2: return { selectIndicesSse2<false>, selectIndicesSse2<true> };
+				case Kernel::AVX2: return { selectIndicesAvx2<false>, selectIndicesAvx2<true> };
+#endif
+#if defined( HAP_DXT_NEON )
+				case Kernel::NEON: return { selectIndicesNeon<false>, selectIndicesNeon<true> };
+#endif
+				default: return { selectIndicesScalar<false>, selectIndicesScalar<true> };
+			}
+		}
+
+		inline void writeLE16( uint8_t *p, uint32_t v ) { p[0] = uint8_t( v ); p[1] = uint8_t( v >> 8 ); }
+
+		//! Rounds an endpoint channel to \a maxValue + 1 levels, the inverse of buildColors()' widening.
+		inline uint32_t quantizeChannel( float value, uint32_t maxValue )
+		{
+			const uint32_t c = uint32_t( std::min( std::max( value, 0.0f ), 255.0f ) + 0.5f );
+			return ( c * maxValue + 127 ) / 255;
+		}
+
+		inline uint32_t quantize565( const float color[3] )
+		{
+			return ( quantizeChannel( color[0], 31 ) << 11 ) | ( quantizeChannel( color[1], 63 ) << 5 ) | quantizeChannel( color[2], 31 );
+		}
+
+		//! Endpoints of a color block being fitted, with the indices they give and their error.
+		struct ColorFit {
+			uint32_t	mC0, mC1;
+			uint8_t		mIndices[16];
+			uint32_t	mError;
+		};
+
+		//! Keeps \a c0 and \a c1 in \a best if they fit \a pixels better. Palettes are always built with four colors, which
+		//! doesn't depend on the order of the endpoints, the block is put in that mode once fitted.
+		void tryColors( const uint32_t pixels[16], uint32_t c0, uint32_t c1, const Selectors &select, ColorFit *best )
+		{
+			uint8_t block[4];
+			writeLE16( block, c0 );
+			writeLE16( block + 2, c1 );
+			uint32_t colors[4];
+			buildColors( block, false, colors );
+			uint8_t indices[16];
+			const uint32_t error = select.mColors( pixels, colors, indices );
+			if( error < best->mError ) {
+				best->mC0 = c0;
+				best->mC1 = c1;
+				best->mError = error;
+				std::memcpy( best->mIndices, indices, 16 );
+			}
+		}
+
+		//! Solves for the endpoints that best fit \a pixels in the least squares sense, given the palette entries \a indices
+		//! picked. Returns false if the indices don't constrain both endpoints.
+		bool refineColors( const uint32_t pixels[16], const uint8_t indices[16], float e0[3], float e1[3] )
+		{
+			// Weight of the first endpoint in each palette entry
+			static const float kWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+			for( size_t i = 0; i < 16; ++i ) {
+				const float a = kWeights[indices[i]], b = 1.0f - a;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for( size_t c = 0; c < 3; ++c ) {
+					const float x = float( ( pixels[i] >> ( 8 * c ) ) & 0xFF );
+					ax[c] += a * x;
+					bx[c] += b * x;
+				}
+			}
+			const float det = aa * bb - ab * ab;
+			if( std::abs( det ) < 1e-4f )
+				return false;
+			for( size_t c = 0; c < 3; ++c ) {
+				e0[c] = ( bb * ax[c] - ab * bx[c] ) / det;
+				e1[c] = ( aa * bx[c] - ab * ax[c] ) / det;
+			}
+			return true;
+		}
+
+		//! Picks initial endpoints along the principal axis of \a pixels, found by power iteration on their covariance.
+		void principalEndpoints( const uint32_t pixels[16], float e0[3], float e1[3] )
+		{
+			float mean[3] = {}, points[16][3];
+			for( size_t i = 0; i < 16; ++i ) {
+				for( size_t c = 0; c < 3; ++c ) {
+					points[i][c] = float( ( pixels[i] >> ( 8 * c ) ) & 0xFF );
+					mean[c] += points[i][c] / 16.0f;
+				}
+			}
+			float covariance[3][3] = {};
+			for( size_t i = 0; i < 16; ++i ) {
+				for( size_t c = 0; c < 3; ++c ) {
+					for( size_t d = 0; d < 3; ++d )
+						covariance[c][d] += ( points[i][c] - mean[c] ) * ( points[i][d] - mean[d] );
+				}
+			}
+
+			// Start from the row of the widest channel, it can't be orthogonal to the axis
+			size_t widest = 0;
+			for( size_t c = 1; c < 3; ++c ) {
+				if( covariance[c][c] > covariance[widest][widest] )
+					widest = c;
+			}
+			float axis[3] = { covariance[widest][0], covariance[widest][1], covariance[widest][2] };
+			for( int iteration = 0; iteration < 8; ++iteration ) {
+				float next[3], length = 0;
+				for( size_t c = 0; c < 3; ++c ) {
+					next[c] = covariance[c][0] * axis[0] + covariance[c][1] * axis[1] + covariance[c][2] * axis[2];
+					length = std::max( length, std::abs( next[c] ) );
+				}
+				if( length < 1e-6f )
+					break;
+				for( size_t c = 0; c < 3; ++c )
+					axis[c] = next[c] / length;
+			}
+			const float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			if( lengthSquared < 1e-6f ) {
+				// A flat block
+				std::copy( mean, mean + 3, e0 );
+				std::copy( mean, mean + 3, e1 );
+				return;
+			}
+
+			float minT = 0, maxT = 0;
+			for( size_t i = 0; i < 16; ++i ) {
+				const float t = ( ( points[i][0] - mean[0] ) * axis[0] + ( points[i][1] - mean[1] ) * axis[1] + ( points[i][2] - mean[2] ) * axis[2] ) / lengthSquared;
+				minT = std::min( minT, t );
+				maxT = std::max( maxT, t );
+			}
+			for( size_t c = 0; c < 3; ++c ) {
+				e0[c] = mean[c] + maxT * axis[c];
+				e1[c] = mean[c] + minT * axis[c];
+			}
+		}
+
+		//! Picks endpoints at the corners of the bounding box of \a pixels, inset a little and flipped along the diagonal
+		//! the colors lie on.
+		void boundingBoxEndpoints( const uint32_t pixels[16], float e0[3], float e1[3] )
+		{
+			int minimum[3] = { 255, 255, 255 }, maximum[3] = { 0, 0, 0 }, sum[3] = {};
+			for( size_t i = 0; i < 16; ++i ) {
+				for( size_t c = 0; c < 3; ++c ) {
+					const int value = ( pixels[i] >> ( 8 * c ) ) & 0xFF;
+					minimum[c] = std::min( minimum[c], value );
+					maximum[c] = std::max( maximum[c], value );
+					sum[c] += value;
+				}
+			}
+			for( size_t c = 0; c < 3; ++c ) {
+				const int inset = ( maximum[c] - minimum[c] ) >> 4;
+				e0[c] = float( maximum[c] - inset );
+				e1[c] = float( minimum[c] + inset );
+			}
+			// Red and blue falling as green rises swap ends
+			int covariance[3] = {};
+			for( size_t i = 0; i < 16; ++i ) {
+				const int g = 16 * int( ( pixels[i] >> 8 ) & 0xFF ) - sum[1];
+				covariance[0] += ( 16 * int( pixels[i] & 0xFF ) - sum[0] ) * g;
+				covariance[2] += ( 16 * int( ( pixels[i] >> 16 ) & 0xFF ) - sum[2] ) * g;
+			}
+			for( size_t c : { 0, 2 } ) {
+				if( covariance[c] < 0 )
+					std::swap( e0[c], e1[c] );
+			}
+		}
+
+		//! Writes the 8-byte color block that best fits \a pixels to \a out, four colors and no transparency.
+		void fitColors( const uint32_t pixels[16], Quality quality, const Selectors &select, uint8_t *out )
+		{
+			float e0[3], e1[3];
+			if( quality == Quality::FAST )
+				boundingBoxEndpoints( pixels, e0, e1 );
+			else
+				principalEndpoints( pixels, e0, e1 );
+			ColorFit best;
+			best.mError = UINT32_MAX;
+			tryColors( pixels, quantize565( e0 ), quantize565( e1 ), select, &best );
+
+			if( quality != Quality::FAST ) {
+				// Refit the endpoints to the indices they gave for as long as it helps
+				const int numPasses = quality == Quality::HIGH ? 8 : 1;
+				for( int pass = 0; pass < numPasses && best.mError; ++pass ) {
+					const uint32_t error = best.mError;
+					if( ! refineColors( pixels, best.mIndices, e0, e1 ) )
+						break;
+					tryColors( pixels, quantize565( e0 ), quantize565( e1 ), select, &best );
+					if( best.mError >= error )
+						break;
+				}
+			}
+			if( quality == Quality::HIGH && best.mError ) {
+				// Rounding to 565 can miss, try each endpoint channel one step either way
+				static const uint32_t kFields[3][2] = { { 11, 31 }, { 5, 63 }, { 0, 31 } };
+				const uint32_t c0 = best.mC0, c1 = best.mC1;
+				for( const auto &field : kFields ) {
+					for( int endpoint = 0; endpoint < 2; ++endpoint ) {
+						const uint32_t color = endpoint ? c1 : c0;
+						const uint32_t value = ( color >> field[0] ) & field[1];
+						for( int step : { -1, 1 } ) {
+							if( ( step < 0 && value == 0 ) || ( step > 0 && value == field[1] ) )
+								continue;
+							const uint32_t moved = ( color & ~( field[1] << field[0] ) ) | ( ( value + step ) << field[0] );
+							tryColors( pixels, endpoint ? c0 : moved, endpoint ? moved : c1, select, &best );
+						}
+					}
+				}
+			}
+
+			// Four colors need the larger endpoint first, swapping them swaps the indices of both pairs
+			uint32_t c0 = best.mC0, c1 = best.mC1, indices = 0;
+			const bool swapped = c0 < c1;
+			if( swapped )
+				std::swap( c0, c1 );
+			if( c0 != c1 ) {
+				for( size_t i = 0; i < 16; ++i )
+					indices |= uint32_t( swapped ? best.mIndices[i] ^ 1 : best.mIndices[i] ) << ( 2 * i );
+			}
+			writeLE16( out, c0 );
+			writeLE16( out + 2, c1 );
+			writeLE16( out + 4, indices );
+			writeLE16( out + 6, indices >> 16 );
+		}
+
+		//! Writes the DXT5 alpha block that best fits the alpha of \a pixels to \a out.
+		void fitAlphas( const uint32_t pixels[16], Quality quality, const Selectors &select, uint8_t *out )
+		{
+			// Eight alphas spanning the block, and with HIGH six spanning the values other than 0 and 255, which the other
+			// mode has exactly
+			uint32_t minimum = 255, maximum = 0, innerMinimum = 255, innerMaximum = 0;
+			for( size_t i = 0; i < 16; ++i ) {
+				const uint32_t alpha = pixels[i] >> 24;
+				minimum = std::min( minimum, alpha );
+				maximum = std::max( maximum, alpha );
+				if( alpha != 0 && alpha != 255 ) {
+					innerMinimum = std::min( innerMinimum, alpha );
+					innerMaximum = std::max( innerMaximum, alpha );
+				}
+			}
+
+			uint8_t block[2] = { uint8_t( maximum ), uint8_t( minimum ) }, indices[16];
+			uint32_t alphas[8];
+			buildAlphas( block, alphas );
+			uint32_t error = select.mAlphas( pixels, alphas, indices );
+			if( quality == Quality::HIGH && error && innerMinimum <= innerMaximum ) {
+				const uint8_t sixBlock[2] = { uint8_t( innerMinimum ), uint8_t( innerMaximum ) };
+				uint8_t sixIndices[16];
+				buildAlphas( sixBlock, alphas );
+				if( select.mAlphas( pixels, alphas, sixIndices ) < error ) {
+					std::memcpy( block, sixBlock, 2 );
+					std::memcpy( indices, sixIndices, 16 );
+				}
+			}
+
+			uint64_t bits = 0;
+			for( size_t i = 0; i < 16; ++i )
+				bits |= uint64_t( indices[i] ) << ( 3 * i );
+			out[0] = block[0];
+			out[1] = block[1];
+			for( size_t i = 0; i < 6; ++i )
+				out[2 + i] = uint8_t( bits >> ( 8 * i ) );
+		}
+
+		//! Converts a block's RGB \a pixels to the Co, Cg, scale and Y texels ScaledCoCgYToRGBA.frag converts back, in place.
+		//! The chroma of the whole block is scaled up as far as it fits a byte, so pale blocks keep more of it.
+		void convertToYCoCg( uint32_t pixels[16] )
+		{
+			int co[16], cg[16], range = 0;
+			for( size_t i = 0; i < 16; ++i ) {
+				const int r = pixels[i] & 0xFF, g = ( pixels[i] >> 8 ) & 0xFF, b = ( pixels[i] >> 16 ) & 0xFF;
+				// Twice and four times the chroma, kept whole
+				co[i] = r - b;
+				cg[i] = 2 * g - r - b;
+				range = std::max( range, std::max( std::abs( co[i] ) * 2, std::abs( cg[i] ) ) );
+			}
+			// The shader's scale is stored / 8 + 1, range is four times the largest chroma
+			const int scale = range < 128 ? 4 : range < 256 ? 2 : 1;
+			for( size_t i = 0; i < 16; ++i ) {
+				const int r = pixels[i] & 0xFF, g = ( pixels[i] >> 8 ) & 0xFF, b = ( pixels[i] >> 16 ) & 0xFF;
+				const uint32_t y = uint32_t( r + 2 * g + b + 2 ) / 4;
+				// Both numerators stay positive, so the divisions round to nearest
+				const uint32_t coByte = uint32_t( std::min( ( 256 + co[i] * scale + 1 ) / 2, 255 ) );
+				const uint32_t cgByte = uint32_t( std::min( ( 512 + cg[i] * scale + 2 ) / 4, 255 ) );
+				pixels[i] = packRgba( coByte, cgByte, uint32_t( scale - 1 ) * 8, y );
+			}
+		}
+
+		//! Encodes the 16 \a pixels of a block of \a format to \a out.
+		void encodeBlock( uint32_t pixels[16], BlockFormat format, Quality quality, const Selectors &select, uint8_t *out )
+		{
+			if( format == BLOCKS_YCOCG_DXT5 )
+				convertToYCoCg( pixels );
+			if( format == BLOCKS_DXT1 ) {
+				fitColors( pixels, quality, select, out );
+				return;
+			}
+			fitAlphas( pixels, quality, select, out );
+			fitColors( pixels, quality, select, out + 8 );
+		}
+
+	} // anonymous namespace
+
+	const char* toString( Kernel kernel )
+	{
+		switch( kernel ) {
+			case Kernel::SCALAR: return "scalar";
+			case Kernel::SSE2: return "SSE2";
+			case Kernel::AVX2: return "AVX2";
+			case Kernel::NEON: return "NEON";
+			case Kernel::BEST: return "best";
+			default: return "unknown";
+		}
+	}
+
+	const char* toString( Quality quality )
+	{
+		switch( quality ) {
+			case Quality::FAST: return "fast";
+			case Quality::NORMAL: return "normal";
+			case Quality::HIGH: return "high";
+			default: return "unknown";
+		}
+	}
+
+	bool isSupported( Kernel kernel )
+	{
+		switch( kernel ) {
+			case Kernel::SCALAR:
+			case Kernel::BEST:
+				return true;
+#if defined( HAP_DXT_X86 )
+			case Kernel::SSE2: {
+				static const bool sSupported = cpuHasSse2();
+				return sSupported;
+			}
+			case Kernel::AVX2: {
+				static const bool sSupported = cpuHasAvx2();
+				return sSupported;
+			}
+#endif
+#if defined( HAP_DXT_NEON )
+			case Kernel::NEON:
+				return true;
+#endif
+			default:
+				return false;
+		}
+	}
+
+	Kernel getBestKernel()
+	{
+		for( Kernel kernel : { Kernel::AVX2, Kernel::NEON, Kernel::SSE2 } ) {
+			if( isSupported( kernel ) )
+				return kernel;
+		}
+		return Kernel::SCALAR;
+	}
+
+	DecodeResult decode( const void *dxt, size_t dxtSize, PixelFormat format, int32_t width, int32_t height, void *rgba, size_t rowBytes,
+						 const ThreadPoolRef &pool, Kernel kernel )
+	{
+		if( ! dxt || ! rgba || width <= 0 || height <= 0 || rowBytes < size_t( width ) * 4 || ! isSupported( kernel ) )
+			return DecodeResult::BAD_ARGUMENTS;
+		if( format != PIXEL_FORMAT_RGB_DXT1 && format != PIXEL_FORMAT_RGBA_DXT5 && format != PIXEL_FORMAT_YCOCG_DXT5 )
+			return DecodeResult::UNSUPPORTED_FORMAT;
+		if( dxtSize < getDxtImageSize( format, width, height ) )
+			return DecodeResult::BUFFER_TOO_SMALL;
+
+		const bool dxt5 = format != PIXEL_FORMAT_RGB_DXT1;
+		const DecodeBlocksFn decodeBlocks = getDecodeBlocks( kernel == Kernel::BEST ? getBestKernel() : kernel, format );
+		const size_t blockSize = dxt5 ? 16 : 8;
+		const size_t blocksWide = ( size_t( width ) + 3 ) / 4, blocksHigh = ( size_t( height ) + 3 ) / 4;
+		const uint8_t *input = (const uint8_t *)dxt;
+		uint8_t *output = (uint8_t *)rgba;
+
+		auto decodeBlockRows = [=]( size_t begin, size_t end ) {
+			// Whole blocks go straight to the output, the ragged right and bottom edges through a scratch block
+			uint8_t scratch[4 * 16];
+			for( size_t blockY = begin; blockY < end; ++blockY ) {
+				const uint8_t *blocks = input + blockY * blocksWide * blockSize;
+				uint8_t *out = output + blockY * 4 * rowBytes;
+				const size_t rows = std::min<size_t>( 4, size_t( height ) - blockY * 4 );
+				const size_t numWhole = rows == 4 ? size_t( width ) / 4 : 0;
+				decodeBlocks( blocks, numWhole, out, rowBytes );
+				for( size_t blockX = numWhole; blockX < blocksWide; ++blockX ) {
+					decodeBlocks( blocks + blockX * blockSize, 1, scratch, 16 );
+					const size_t columns = std::min<size_t>( 4, size_t( width ) - blockX * 4 );
+					for( size_t y = 0; y < rows; ++y )
+						std::memcpy( out + y * rowBytes + blockX * 16, scratch + y * 16, columns * 4 );
+				}
+			}
+		};
+
+		if( ! pool || blocksHigh < 2 ) {
+			decodeBlockRows( 0, blocksHigh );
+			return DecodeResult::SUCCESS;
+		}
+		const size_t numBands = std::min( blocksHigh, ( pool->getNumThreads() + 1 ) * kBandsPerThread );
+		pool->parallelFor( numBands, [&]( size_t band, size_t ) {
+			decodeBlockRows( blocksHigh * band / numBands, blocksHigh * ( band + 1 ) / numBands );
+		} );
+		return DecodeResult::SUCCESS;
+	}
+
+	bool encode( const void *rgba, size_t rowBytes, int32_t width, int32_t height, PixelFormat format, void *dxt, size_t dxtSize,
+				 Quality quality, const ThreadPoolRef &pool, Kernel kernel )
+	{
+		if( ! rgba || ! dxt || width <= 0 || height <= 0 || rowBytes < size_t( width ) * 4 || ! isSupported( kernel ) || ! getBitsPerPixel( format ) )
+			return false;
+		if( dxtSize < getDxtImageSize( format, width, height ) )
+			return false;
+
+		const BlockFormat blockFormat = format == PIXEL_FORMAT_RGB_DXT1 ? BLOCKS_DXT1 : format == PIXEL_FORMAT_RGBA_DXT5 ? BLOCKS_DXT5 : BLOCKS_YCOCG_DXT5;
+		const Selectors select = getSelectors( kernel == Kernel::BEST ? getBestKernel() : kernel );
+		const size_t blockSize = blockFormat == BLOCKS_DXT1 ? 8 : 16;
+		const size_t blocksWide = ( size_t( width ) + 3 ) / 4, blocksHigh = ( size_t( height ) + 3 ) / 4;
+		const uint8_t *input = (const uint8_t *)rgba;
+		uint8_t *output = (uint8_t *)dxt;
+
+		auto encodeBlockRows = [=]( size_t begin, size_t end ) {
+			// Blocks past the right and bottom edges repeat the last column and row, which keeps their endpoints tight
+			uint32_t pixels[16];
+			for( size_t blockY = begin; blockY < end; ++blockY ) {
+				uint8_t *out = output + blockY * blocksWide * blockSize;
+				for( size_t blockX = 0; blockX < blocksWide; ++blockX, out += blockSize ) {
+					for( size_t y = 0; y < 4; ++y ) {
+						const uint8_t *row = input + std::min<size_t>( blockY * 4 + y, size_t( height ) - 1 ) * rowBytes;
+						if( blockX * 4 + 4 <= size_t( width ) ) {
+							std::memcpy( pixels + y * 4, row + blockX * 16, 16 );
+							continue;
+						}
+						for( size_t x = 0; x < 4; ++x )
+							std::memcpy( pixels + y * 4 + x, row + std::min<size_t>( blockX * 4 + x, size_t( width ) - 1 ) * 4, 4 );
+					}
+					encodeBlock( pixels, blockFormat, quality, select, out );
+				}
+			}
+		};
+
+		if( ! pool || blocksHigh < 2 ) {
+			encodeBlockRows( 0, blocksHigh );
+			return true;
+		}
+		const size_t numBands = std::min( blocksHigh, ( pool->getNumThreads() + 1 ) * kBandsPerThread );
+		pool->parallelFor( numBands, [&]( size_t band, size_t ) {
+			encodeBlockRows( blocksHigh * band / numBands, blocksHigh * ( band + 1 ) / numBands );
+		} );
+		return true;
+	}
+
+	double benchmark( PixelFormat format, int32_t width, int32_t height, Kernel kernel, const ThreadPoolRef &pool, double seconds )
+	{
+		if( ! isSupported( kernel ) || width <= 0 || height <= 0 || ! getBitsPerPixel( format ) )
+			return 0;
+
+		// Random blocks use every index, and both color modes of DXT1
+		std::vector<uint8_t> dxt( getDxtImageSize( format, width, height ) );
+		uint32_t seed = 1;
+		for( uint8_t &byte : dxt ) {
+			seed = seed * 1664525 + 1013904223;
+			byte = uint8_t( seed >> 24 );
+		}
+		const size_t rowBytes = size_t( width ) * 4;
+		std::vector<uint8_t> rgba( rowBytes * size_t( height ) );
+
+		// The first decode pages the output in and warms the caches, it doesn't count
+		decode( dxt.data(), dxt.size(), format, width, height, rgba.data(), rowBytes, pool, kernel );
+
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+		uint64_t numImages = 0;
+		double elapsed;
+		do {
+			decode( dxt.data(), dxt.size(), format, width, height, rgba.data(), rowBytes, pool, kernel );
+			++numImages;
+			elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+		} while( elapsed < seconds );
+		return double( numImages ) * width * height / elapsed * 1e-9;
+	}
+
+	double benchmarkEncode( PixelFormat format, int32_t width, int32_t height, Quality quality, Kernel kernel, const ThreadPoolRef &pool, double seconds )
+	{
+		if( ! isSupported( kernel ) || width <= 0 || height <= 0 || ! getBitsPerPixel( format ) )
+			return 0;
+
+		// Gradients with a little noise, random pixels would make every block a worst case
+		const size_t rowBytes = size_t( width ) * 4;
+		std::vector<uint8_t> rgba( rowBytes * size_t( height ) );
+		uint32_t seed = 1;
+		for( int32_t y = 0; y < height; ++y ) {
+			for( int32_t x = 0; x < width; ++x ) {
+				seed = seed * 1664525 + 1013904223;
+				const uint32_t noise = seed >> 28;
+				uint8_t *pixel = rgba.data() + y * rowBytes + x * 4;
+				pixel[0] = uint8_t( x * 255 / width + noise );
+				pixel[1] = uint8_t( y * 255 / height + noise );
+				pixel[2] = uint8_t( ( x + y ) * 127 / ( width + height ) + noise );
+				pixel[3] = uint8_t( 255 - x * 255 / width );
+			}
+		}
+		std::vector<uint8_t> dxt( getDxtImageSize( format, width, height ) );
+
+		encode( rgba.data(), rowBytes, width, height, format, dxt.data(), dxt.size(), quality, pool, kernel );
+
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+		uint64_t numImages = 0;
+		double elapsed;
+		do {
+			encode( rgba.data(), rowBytes, width, height, format, dxt.data(), dxt.size(), quality, pool, kernel );
+			++numImages;
+			elapsed = std::chrono::duration<double>( Clock::now() - start ).count();
+		} while( elapsed < seconds );
+		return double( numImages ) * width * height / elapsed * 1e-9;
+	}
+
+} } } // namespace cinder::hap::dxt
@@ -0,0 +1,61 @@
+/*
+ *  HapDxt.h
+ *
+ *  CPU compression of RGBA8 to the DXT payloads of Hap frames and back, for encoding, machines without S3TC, previews and QA.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapDecoder.h"
+
+namespace cinder { namespace hap { namespace dxt {
+
+	//! Implementations of decode() and encode(), all producing the exact same output.
+	enum class Kernel {
+		//! Portable reference.
+		SCALAR,
+		SSE2,
+		AVX2,
+		//! AArch64 only.
+		NEON,
+		//! The fastest kernel this build runs on this CPU.
+		BEST
+	};
+
+	//! How hard encode() searches for the endpoints of each block.
+	enum class Quality {
+		//! Corners of the colors' bounding box, several times faster than NORMAL.
+		FAST,
+		//! Principal axis of the colors, refit once to the indices they give.
+		NORMAL,
+		//! NORMAL refit until it stops improving, then nudged a 565 step at a time, and both DXT5 alpha modes tried.
+		HIGH
+	};
+
+	const char*	toString( Kernel kernel );
+	const char*	toString( Quality quality );
+	//! Returns true if \a kernel is compiled in and the CPU runs it. Always true for SCALAR and BEST.
+	bool		isSupported( Kernel kernel );
+	//! Returns the kernel BEST stands for.
+	Kernel		getBestKernel();
+
+	//! Decodes the \a width x \a height DXT image \a dxt of \a format, as Decoder outputs it, to RGBA8 rows \a rowBytes apart.
+	//! YCoCg-DXT5 images are converted to opaque RGB as they decode, the way ScaledCoCgYToRGBA.frag does; HapLoader's 'v'
+	//! key diffs a frame against the GPU's. Block rows are spread over \a pool, a null pool decodes them on the calling thread.
+	DecodeResult	decode( const void *dxt, size_t dxtSize, PixelFormat format, int32_t width, int32_t height, void *rgba, size_t rowBytes,
+							const ThreadPoolRef &pool = ThreadPoolRef(), Kernel kernel = Kernel::BEST );
+
+	//! Encodes the \a width x \a height RGBA8 image \a rgba, rows \a rowBytes apart, to the DXT image of \a format at \a dxt, as
+	//! Decoder outputs it. YCoCg-DXT5 images are converted from RGB for ScaledCoCgYToRGBA.frag, DXT1 ignores alpha. Block
+	//! rows are spread over \a pool, a null pool encodes them on the calling thread. Returns false on bad arguments.
+	bool		encode( const void *rgba, size_t rowBytes, int32_t width, int32_t height, PixelFormat format, void *dxt, size_t dxtSize,
+						Quality quality = Quality::NORMAL, const ThreadPoolRef &pool = ThreadPoolRef(), Kernel kernel = Kernel::BEST );
+
+	//! Returns the throughput of decode() with \a kernel and \a pool on a synthetic image, in gigapixels per second,
+	//! after decoding it repeatedly for \a seconds. Returns 0 if \a kernel isn't supported.
+	double		benchmark( PixelFormat format, int32_t width, int32_t height, Kernel kernel, const ThreadPoolRef &pool = ThreadPoolRef(), double seconds = 1.0 );
+	//! Returns the throughput of encode() at \a quality with \a kernel and \a pool on a synthetic image, like benchmark().
+	double		benchmarkEncode( PixelFormat format, int32_t width, int32_t height, Quality quality, Kernel kernel, const ThreadPoolRef &pool = ThreadPoolRef(), double seconds = 1.0 );
+
+} } } // namespace cinder::hap::dxt
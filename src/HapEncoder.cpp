@@ -0,0 +1,170 @@
+/*
+ *  HapEncoder.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapEncoder.h"
+#include "HapSnappy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		// Section types, see the Hap specification
+		enum {
+			COMPRESSOR_NONE					= 0xA,
+			COMPRESSOR_SNAPPY				= 0xB,
+			COMPRESSOR_COMPLEX				= 0xC,
+
+			FORMAT_RGB_DXT1					= 0xB,
+			FORMAT_RGBA_DXT5				= 0xE,
+			FORMAT_YCOCG_DXT5				= 0xF,
+
+			SECTION_DECODE_INSTRUCTIONS		= 0x01,
+			SECTION_CHUNK_COMPRESSORS		= 0x02,
+			SECTION_CHUNK_SIZES				= 0x03
+		};
+
+		inline void writeLE32( uint8_t *p, uint32_t v ) { p[0] = uint8_t( v ); p[1] = uint8_t( v >> 8 ); p[2] = uint8_t( v >> 16 ); p[3] = uint8_t( v >> 24 ); }
+
+		//! Returns the size of the header of a section of \a length bytes.
+		inline size_t getSectionHeaderSize( size_t length ) { return length && length <= 0xFFFFFF ? 4 : 8; }
+
+		//! Writes a section header at \a out and returns the byte past it. Lengths that don't fit 24 bits, and 0 which
+		//! stands for them, are written in the 32 bits after a zero length.
+		uint8_t* writeSectionHeader( uint8_t *out, size_t length, uint8_t type )
+		{
+			if( getSectionHeaderSize( length ) == 4 ) {
+				writeLE32( out, uint32_t( length ) );
+				out[3] = type;
+				return out + 4;
+			}
+			writeLE32( out, 0 );
+			out[3] = type;
+			writeLE32( out + 4, uint32_t( length ) );
+			return out + 8;
+		}
+
+		uint8_t sectionFormat( PixelFormat format )
+		{
+			switch( format ) {
+				case PIXEL_FORMAT_RGB_DXT1: return FORMAT_RGB_DXT1;
+				case PIXEL_FORMAT_RGBA_DXT5: return FORMAT_RGBA_DXT5;
+				case PIXEL_FORMAT_YCOCG_DXT5: return FORMAT_YCOCG_DXT5;
+				default: return 0;
+			}
+		}
+
+	} // anonymous namespace
+
+	uint32_t Encoder::getNumChunks( size_t dxtSize ) const
+	{
+		const uint32_t numChunks = mOptions.mNumChunks ? mOptions.mNumChunks : uint32_t( std::min<size_t>( dxtSize / kAutoChunkSize, kMaxChunks ) );
+		// Chunks split the blocks, so there can't be more of them than blocks
+		const size_t numBlocks = dxtSize / ( getBitsPerPixel( mOptions.mPixelFormat ) * 2 );
+		return uint32_t( std::max<size_t>( 1, std::min<size_t>( { numChunks, kMaxChunks, numBlocks } ) ) );
+	}
+
+	bool Encoder::encode( const void *rgba, size_t rowBytes, int32_t width, int32_t height, std::vector<uint8_t> *frame )
+	{
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+		if( ! frame || ! sectionFormat( mOptions.mPixelFormat ) || width <= 0 || height <= 0 )
+			return false;
+
+		mDxt.resize( getDxtImageSize( mOptions.mPixelFormat, width, height ) );
+		if( ! dxt::encode( rgba, rowBytes, width, height, mOptions.mPixelFormat, mDxt.data(), mDxt.size(), mOptions.mQuality, mThreadPool, mOptions.mKernel ) )
+			return false;
+		if( ! encodeDxt( mDxt.data(), mDxt.size(), frame ) )
+			return false;
+		mLastEncodeSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+		return true;
+	}
+
+	bool Encoder::encodeDxt( const void *dxt, size_t dxtSize, std::vector<uint8_t> *frame )
+	{
+		typedef std::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+		const uint8_t format = sectionFormat( mOptions.mPixelFormat );
+		if( ! dxt || ! frame || ! format || dxtSize == 0 || dxtSize > 0xFFFFFFFF )
+			return false;
+
+		// Chunks start on block boundaries, so each decodes to whole blocks
+		const uint32_t numChunks = getNumChunks( dxtSize );
+		const size_t blockSize = getBitsPerPixel( mOptions.mPixelFormat ) * 2;
+		const size_t numBlocks = dxtSize / blockSize;
+		const uint8_t *input = (const uint8_t *)dxt;
+		auto getChunkOffset = [=]( size_t chunk ) { return chunk == numChunks ? dxtSize : numBlocks * chunk / numChunks * blockSize; };
+
+		mChunks.resize( numChunks );
+		mChunkSizes.resize( numChunks );
+		mChunkCompressors.resize( numChunks );
+		auto compressChunk = [&]( size_t chunk, size_t ) {
+			const uint8_t *data = input + getChunkOffset( chunk );
+			const size_t size = getChunkOffset( chunk + 1 ) - getChunkOffset( chunk );
+			std::vector<uint8_t> &compressed = mChunks[chunk];
+			if( mOptions.mSnappy ) {
+				compressed.resize( snappy::getMaxCompressedLength( size ) );
+				size_t compressedSize;
+				if( snappy::compress( data, size, compressed.data(), compressed.size(), &compressedSize ) && compressedSize < size ) {
+					mChunkSizes[chunk] = compressedSize;
+					mChunkCompressors[chunk] = COMPRESSOR_SNAPPY;
+					return;
+				}
+			}
+			compressed.assign( data, data + size );
+			mChunkSizes[chunk] = size;
+			mChunkCompressors[chunk] = COMPRESSOR_NONE;
+		};
+
+		if( mThreadPool && numChunks > 1 )
+			mThreadPool->parallelFor( numChunks, compressChunk, mPriority );
+		else {
+			for( size_t i = 0; i < numChunks; ++i )
+				compressChunk( i, 0 );
+		}
+
+		size_t payloadSize = 0;
+		for( size_t size : mChunkSizes )
+			payloadSize += size;
+
+		if( numChunks == 1 ) {
+			frame->resize( getSectionHeaderSize( payloadSize ) + payloadSize );
+			uint8_t *out = writeSectionHeader( frame->data(), payloadSize, uint8_t( ( mChunkCompressors[0] << 4 ) | format ) );
+			std::memcpy( out, mChunks[0].data(), payloadSize );
+		}
+		else {
+			// Decode instructions list each chunk's compressor and size, the chunks follow back to back
+			const size_t compressorsSize = getSectionHeaderSize( numChunks ) + numChunks;
+			const size_t sizesSize = getSectionHeaderSize( numChunks * 4 ) + numChunks * 4;
+			const size_t instructionsLength = compressorsSize + sizesSize;
+			const size_t sectionLength = getSectionHeaderSize( instructionsLength ) + instructionsLength + payloadSize;
+			frame->resize( getSectionHeaderSize( sectionLength ) + sectionLength );
+
+			uint8_t *out = writeSectionHeader( frame->data(), sectionLength, uint8_t( ( COMPRESSOR_COMPLEX << 4 ) | format ) );
+			out = writeSectionHeader( out, instructionsLength, SECTION_DECODE_INSTRUCTIONS );
+			out = writeSectionHeader( out, numChunks, SECTION_CHUNK_COMPRESSORS );
+			std::memcpy( out, mChunkCompressors.data(), numChunks );
+			out += numChunks;
+			out = writeSectionHeader( out, numChunks * 4, SECTION_CHUNK_SIZES );
+			for( size_t size : mChunkSizes ) {
+				writeLE32( out, uint32_t( size ) );
+				out += 4;
+			}
+			for( size_t i = 0; i < numChunks; ++i ) {
+				std::memcpy( out, mChunks[i].data(), mChunkSizes[i] );
+				out += mChunkSizes[i];
+			}
+		}
+
+		mLastEncodeSeconds = std::chrono::duration<double>( Clock::now() - start ).count();
+		return true;
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,74 @@
+/*
+ *  HapEncoder.h
+ *
+ *  Portable Hap frame encoder, the counterpart of Decoder. Compresses RGBA8 images to Hap, Hap Alpha and HapQ frames
+ *  split in chunks that decode in parallel, each with Snappy as the second stage.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapDxt.h"
+
+namespace cinder { namespace hap {
+
+	class Encoder {
+	public:
+		struct Options {
+			Options() : mPixelFormat( PIXEL_FORMAT_RGB_DXT1 ), mQuality( dxt::Quality::NORMAL ), mNumChunks( 0 ), mSnappy( true ), mKernel( dxt::Kernel::BEST ) {}
+
+			//! DXT1 for Hap, DXT5 for Hap Alpha, YCoCg-DXT5 for HapQ.
+			Options&	pixelFormat( PixelFormat format ) { mPixelFormat = format; return *this; }
+			Options&	quality( dxt::Quality quality ) { mQuality = quality; return *this; }
+			//! Number of chunks each frame is split in, at most kMaxChunks. 0 picks one per kAutoChunkSize bytes of DXT data.
+			Options&	numChunks( uint32_t numChunks ) { mNumChunks = numChunks; return *this; }
+			//! Compresses chunks with Snappy, chunks it doesn't shrink are stored as they are.
+			Options&	snappy( bool snappy = true ) { mSnappy = snappy; return *this; }
+			Options&	kernel( dxt::Kernel kernel ) { mKernel = kernel; return *this; }
+
+			PixelFormat		mPixelFormat;
+			dxt::Quality	mQuality;
+			uint32_t		mNumChunks;
+			bool			mSnappy;
+			dxt::Kernel		mKernel;
+		};
+
+		static const uint32_t	kMaxChunks = 64;
+		static const size_t		kAutoChunkSize = 128 * 1024;
+
+		Encoder( const Options &options = Options() ) : mOptions( options ), mPriority( TaskPriority::PREROLL ), mLastEncodeSeconds( 0 ) {}
+
+		void				setOptions( const Options &options ) { mOptions = options; }
+		const Options&		getOptions() const { return mOptions; }
+		//! Spreads the blocks and chunks of each frame over \a pool. A null pool encodes everything on the calling thread.
+		void					setThreadPool( const ThreadPoolRef &pool ) { mThreadPool = pool; }
+		const ThreadPoolRef&	getThreadPool() const { return mThreadPool; }
+		//! Sets the priority of the chunk tasks queued on the thread pool.
+		void				setPriority( TaskPriority priority ) { mPriority = priority; }
+		TaskPriority		getPriority() const { return mPriority; }
+
+		//! Returns the number of chunks frames of \a dxtSize bytes of DXT data are split in with the current options.
+		uint32_t			getNumChunks( size_t dxtSize ) const;
+
+		//! Encodes the \a width x \a height RGBA8 image \a rgba, rows \a rowBytes apart, to a Hap frame in \a frame.
+		bool				encode( const void *rgba, size_t rowBytes, int32_t width, int32_t height, std::vector<uint8_t> *frame );
+		//! Wraps \a dxtSize bytes of DXT data of the options' pixel format, ie. decoded from another frame, in a Hap frame in
+		//! \a frame, chunked and compressed anew.
+		bool				encodeDxt( const void *dxt, size_t dxtSize, std::vector<uint8_t> *frame );
+
+		//! Returns the wall-clock duration of the last encode() or encodeDxt() call, in seconds.
+		double				getLastEncodeSeconds() const { return mLastEncodeSeconds; }
+
+	protected:
+		Options						mOptions;
+		ThreadPoolRef				mThreadPool;
+		TaskPriority				mPriority;
+		std::vector<uint8_t>		mDxt;
+		//! Compressed chunks of the last frame, with their sizes and compressors.
+		std::vector<std::vector<uint8_t>>	mChunks;
+		std::vector<size_t>			mChunkSizes;
+		std::vector<uint8_t>		mChunkCompressors;
+		double						mLastEncodeSeconds;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,179 @@
+/*
+ *  HapFrameCache.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapFrameCache.h"
+
+#include "cinder/Log.h"
+
+#include <algorithm>
+
+#if defined( CINDER_MSW )
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+#endif
+
+namespace cinder { namespace hap {
+
+	FrameCache::FrameCache( size_t first, size_t count, bool decoded )
+	: mFirst( first ), mCount( count ), mDecoded( decoded ), mLocked( false ), mReady( false ), mFailed( false )
+	{
+	}
+
+	FrameCache::~FrameCache()
+	{
+		if( mLocked ) {
+#if defined( CINDER_MSW )
+			::VirtualUnlock( mArena.data(), mArena.size() );
+#else
+			::munlock( mArena.data(), mArena.size() );
+#endif
+		}
+	}
+
+	FrameCacheRef FrameCache::create( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded, bool wait )
+	{
+		first = std::min( first, sampleTable->getNumSamples() );
+		count = std::min( count, sampleTable->getNumSamples() - first );
+		FrameCacheRef cache( new FrameCache( first, count, decoded ) );
+
+		MovieSourceRef source = sampleTable->getSource();
+		if( wait ) {
+			build( cache, sampleTable, source );
+			return cache;
+		}
+
+		std::weak_ptr<FrameCache> weakCache = cache;
+		ThreadPool::getShared()->submit( [weakCache, sampleTable, source] {
+			build( weakCache, sampleTable, source );
+		}, TaskPriority::PREROLL );
+		return cache;
+	}
+
+	size_t FrameCache::getArenaSize( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded )
+	{
+		first = std::min( first, sampleTable->getNumSamples() );
+		count = std::min( count, sampleTable->getNumSamples() - first );
+		std::vector<Entry> entries;
+		return layoutEntries( sampleTable, first, count, decoded, &entries );
+	}
+
+	size_t FrameCache::layoutEntries( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded, std::vector<Entry> *entries )
+	{
+		const size_t frameSize = getDxtImageSize( getPixelFormatForCodec( sampleTable->getCodecType() ), sampleTable->getWidth(), sampleTable->getHeight() );
+		entries->resize( count );
+		size_t offset = 0;
+		for( size_t i = 0; i < count; ++i ) {
+			Entry &entry = (*entries)[i];
+			entry.mOffset = offset;
+			entry.mSize = decoded ? frameSize : sampleTable->getSample( first + i ).mSize;
+			offset += entry.mSize;
+		}
+		return offset;
+	}
+
+	void FrameCache::build( const std::weak_ptr<FrameCache> &weakCache, const SampleTableRef &sampleTable, const MovieSourceRef &source )
+	{
+		size_t first, count;
+		bool decoded;
+		{
+			FrameCacheRef cache = weakCache.lock();
+			if( ! cache )
+				return;
+			first = cache->mFirst;
+			count = cache->mCount;
+			decoded = cache->mDecoded;
+		}
+		auto fail = [&weakCache] {
+			if( FrameCacheRef cache = weakCache.lock() )
+				cache->mFailed.store( true, std::memory_order_release );
+		};
+
+		// Every frame gets its slot up front, so they are filled in parallel straight into the arena. Built aside and handed
+		// over at once, readers never see a partial cache
+		std::vector<Entry> entries;
+		std::vector<uint8_t> arena;
+		try {
+			arena.resize( layoutEntries( sampleTable, first, count, decoded, &entries ) );
+		}
+		catch( const std::bad_alloc & ) {
+			CI_LOG_W( "HAP WARNING :: not enough memory to cache " << count << " frames." );
+			fail();
+			return;
+		}
+
+		const ThreadPoolRef pool = ThreadPool::getShared();
+		const size_t numParticipants = pool->getNumThreads() + 1;
+		std::vector<std::vector<uint8_t>> samples( decoded ? numParticipants : 0 );
+		std::vector<Decoder> decoders( decoded ? numParticipants : 0 );
+		std::atomic<bool> failed( false );
+		pool->parallelFor( count, [&]( size_t i, size_t thread ) {
+			if( failed || weakCache.expired() )
+				return;
+
+			const SampleTable::Sample &sample = sampleTable->getSample( first + i );
+			Entry &entry = entries[i];
+			if( ! decoded ) {
+				if( source->read( sample.mOffset, arena.data() + entry.mOffset, entry.mSize ) != entry.mSize ) {
+					CI_LOG_W( "HAP WARNING :: couldn't read sample " << first + i << " into the frame cache." );
+					failed = true;
+				}
+				return;
+			}
+
+			std::vector<uint8_t> &buffer = samples[thread];
+			buffer.resize( sample.mSize );
+			if( source->read( sample.mOffset, buffer.data(), buffer.size() ) != buffer.size() ) {
+				CI_LOG_W( "HAP WARNING :: couldn't read sample " << first + i << " into the frame cache." );
+				failed = true;
+			}
+			else if( decoders[thread].decode( buffer.data(), buffer.size(), arena.data() + entry.mOffset, entry.mSize, &entry.mInfo ) != DecodeResult::SUCCESS ) {
+				CI_LOG_W( "HAP WARNING :: couldn't decode sample " << first + i << " into the frame cache." );
+				failed = true;
+			}
+			else {
+				entry.mSize = entry.mInfo.mDecodedSize;
+			}
+		}, TaskPriority::PREROLL );
+		if( failed ) {
+			fail();
+			return;
+		}
+
+		FrameCacheRef cache = weakCache.lock();
+		if( ! cache )
+			return;
+		cache->mArena.swap( arena );
+		cache->mEntries.swap( entries );
+		// Best effort, locking fails past the process' limit and the cache then simply stays pageable
+#if defined( CINDER_MSW )
+		cache->mLocked = cache->mArena.empty() ? false : ::VirtualLock( cache->mArena.data(), cache->mArena.size() ) != 0;
+#else
+		cache->mLocked = cache->mArena.empty() ? false : ::mlock( cache->mArena.data(), cache->mArena.size() ) == 0;
+#endif
+		cache->mReady.store( true, std::memory_order_release );
+	}
+
+	const uint8_t* FrameCache::getSample( size_t index, size_t *size ) const
+	{
+		if( mDecoded || ! contains( index ) )
+			return nullptr;
+		const Entry &entry = mEntries[index - mFirst];
+		*size = entry.mSize;
+		return mArena.data() + entry.mOffset;
+	}
+
+	const uint8_t* FrameCache::getFrame( size_t index, FrameInfo *info ) const
+	{
+		if( ! mDecoded || ! contains( index ) )
+			return nullptr;
+		const Entry &entry = mEntries[index - mFirst];
+		*info = entry.mInfo;
+		return mArena.data() + entry.mOffset;
+	}
+
+} } // namespace cinder::hap
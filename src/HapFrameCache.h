@@ -0,0 +1,78 @@
+/*
+ *  HapFrameCache.h
+ *
+ *  A run of frames kept resident in memory, compressed or already decoded, so looping back to them never waits on storage.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapDecoder.h"
+#include "HapSampleTable.h"
+
+#include <atomic>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	//! How much of a movie MovieGlHap keeps in memory, see MovieGlHap::setResidentMode().
+	enum class ResidentMode {
+		NONE,
+		//! Compressed samples, decompressed as they play.
+		COMPRESSED,
+		//! Samples decoded to DXT, only uploaded as they play.
+		DECODED
+	};
+
+	typedef std::shared_ptr<class FrameCache> FrameCacheRef;
+
+	//! Holds samples [first, first + count) of a movie in one locked arena, filled in parallel on ThreadPool::getShared().
+	//! Lookups fail until the cache is ready, the caller then reads the frame the usual way. Thread-safe.
+	class FrameCache {
+	public:
+		//! Caches \a count samples of \a sampleTable starting at \a first, compressed, or decoded to DXT when \a decoded is true.
+		//! Fills the cache in the background, or before returning when \a wait is true.
+		static FrameCacheRef create( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded, bool wait = false );
+		//! Returns the size of the arena create() would allocate for the same arguments.
+		static size_t	getArenaSize( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded );
+		~FrameCache();
+
+		size_t		getFirst() const { return mFirst; }
+		size_t		getCount() const { return mCount; }
+		bool		isDecoded() const { return mDecoded; }
+		//! Returns true once every frame is resident.
+		bool		isReady() const { return mReady.load( std::memory_order_acquire ); }
+		//! Returns true if filling the cache failed, it then stays empty.
+		bool		hasFailed() const { return mFailed.load( std::memory_order_acquire ); }
+		//! Returns the bytes held, compressed or decoded.
+		size_t		getMemoryFootprint() const { return isReady() ? mArena.size() : 0; }
+
+		//! Returns compressed sample \a index and sets \a size, or null if it isn't cached. Compressed caches only.
+		const uint8_t*	getSample( size_t index, size_t *size ) const;
+		//! Returns the decoded DXT of sample \a index and sets \a info, or null if it isn't cached. Decoded caches only.
+		const uint8_t*	getFrame( size_t index, FrameInfo *info ) const;
+
+	protected:
+		FrameCache( size_t first, size_t count, bool decoded );
+
+		//! Fills the arena from \a source, giving up once \a cache expires.
+		static void		build( const std::weak_ptr<FrameCache> &cache, const SampleTableRef &sampleTable, const MovieSourceRef &source );
+		bool			contains( size_t index ) const { return isReady() && index >= mFirst && index - mFirst < mCount; }
+
+		//! Slot of one frame in the arena, decoded frames each get room for a full frame of the movie's pixel format.
+		struct Entry {
+			size_t		mOffset, mSize;
+			FrameInfo	mInfo;
+		};
+		//! Lays out the slots of samples [first, first + count), returning the arena size.
+		static size_t	layoutEntries( const SampleTableRef &sampleTable, size_t first, size_t count, bool decoded, std::vector<Entry> *entries );
+
+		size_t					mFirst, mCount;
+		bool					mDecoded;
+		std::vector<uint8_t>	mArena;
+		std::vector<Entry>		mEntries;
+		bool					mLocked;
+		std::atomic<bool>		mReady, mFailed;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,332 @@
+/*
+ *  HapMovieSource.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapMovieSource.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "cinder/Log.h"
+
+#if defined( CINDER_MSW )
+	#include <Windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+namespace cinder { namespace hap {
+
+	MovieSourceRef MovieSource::create( const fs::path &path )
+	{
+		// Mapping fails for empty files and, in 32-bit builds, for files larger than the address space
+		try {
+			return MovieSourceRef( new MovieSourceMapped( path ) );
+		}
+		catch( const MovieSourceExc &exc ) {
+			CI_LOG_W( "HAP WARNING :: " << exc.what() << ", reading it without a mapping." );
+		}
+		return MovieSourceRef( new MovieSourceFile( path ) );
+	}
+
+	MovieSourceRef MovieSource::create( const void *data, size_t dataSize )
+	{
+		return MovieSourceRef( new MovieSourceMemory( data, dataSize ) );
+	}
+
+	MovieSourceRef MovieSource::createUnbuffered( const fs::path &path )
+	{
+		// tmpfs and some network file systems refuse O_DIRECT
+		try {
+			return MovieSourceRef( new MovieSourceDirect( path ) );
+		}
+		catch( const MovieSourceExc &exc ) {
+			CI_LOG_W( "HAP WARNING :: " << exc.what() << ", reading it through the OS cache." );
+		}
+		return create( path );
+	}
+
+	MovieSourceRef MovieSource::create( const DataSourceRef &dataSource )
+	{
+		if( dataSource->isFilePath() )
+			return create( dataSource->getFilePath() );
+		else
+			return MovieSourceRef( new MovieSourceMemory( dataSource->getBuffer() ) );
+	}
+
+	// MOVIE SOURCE FILE /////////////////////////////////////////
+	//////////////////////////////////////////////////////////////
+
+#if defined( CINDER_MSW )
+
+	MovieSourceFile::MovieSourceFile( const fs::path &path )
+	: MovieSourceFile( path, false )
+	{
+	}
+
+	MovieSourceFile::MovieSourceFile( const fs::path &path, bool unbuffered )
+	: mPath( path ), mSize( 0 )
+	{
+		mHandle = ::CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL, NULL );
+		if( mHandle == INVALID_HANDLE_VALUE )
+			throw MovieSourceExc( std::string( unbuffered ? "Unable to open unbuffered " : "Unable to open " ) + path.string() );
+
+		LARGE_INTEGER size;
+		::GetFileSizeEx( (HANDLE)mHandle, &size );
+		mSize = size.QuadPart;
+	}
+
+	MovieSourceFile::~MovieSourceFile()
+	{
+		::CloseHandle( (HANDLE)mHandle );
+	}
+
+	size_t MovieSourceFile::read( uint64_t offset, void *dst, size_t size )
+	{
+		// ReadFile with an explicit offset does not touch a shared file pointer, so concurrent reads are safe
+		uint8_t *out = (uint8_t*)dst;
+		size_t total = 0;
+		while( total < size ) {
+			OVERLAPPED overlapped = {};
+			uint64_t pos = offset + total;
+			overlapped.Offset = (DWORD)( pos & 0xFFFFFFFF );
+			overlapped.OffsetHigh = (DWORD)( pos >> 32 );
+			DWORD toRead = (DWORD)std::min<size_t>( size - total, 0x40000000 );
+			DWORD bytesRead = 0;
+			if( ! ::ReadFile( (HANDLE)mHandle, out + total, toRead, &bytesRead, &overlapped ) || bytesRead == 0 )
+				break;
+			total += bytesRead;
+		}
+		return total;
+	}
+
+#else
+
+	MovieSourceFile::MovieSourceFile( const fs::path &path )
+	: MovieSourceFile( path, false )
+	{
+	}
+
+	MovieSourceFile::MovieSourceFile( const fs::path &path, bool unbuffered )
+	: mPath( path ), mSize( 0 )
+	{
+		int flags = O_RDONLY;
+#if defined( O_DIRECT )
+		if( unbuffered )
+			flags |= O_DIRECT;
+#endif
+		mFd = ::open( path.string().c_str(), flags );
+		if( mFd < 0 )
+			throw MovieSourceExc( std::string( unbuffered ? "Unable to open unbuffered " : "Unable to open " ) + path.string() );
+#if defined( CINDER_MAC )
+		if( unbuffered )
+			::fcntl( mFd, F_NOCACHE, 1 );
+#endif
+
+		struct stat st;
+		if( ::fstat( mFd, &st ) == 0 )
+			mSize = (uint64_t)st.st_size;
+	}
+
+	MovieSourceFile::~MovieSourceFile()
+	{
+		::close( mFd );
+	}
+
+	size_t MovieSourceFile::read( uint64_t offset, void *dst, size_t size )
+	{
+		// pread() does not touch the shared file offset, so concurrent reads are safe
+		uint8_t *out = (uint8_t*)dst;
+		size_t total = 0;
+		while( total < size ) {
+			ssize_t bytesRead = ::pread( mFd, out + total, size - total, (off_t)( offset + total ) );
+			if( bytesRead <= 0 )
+				break;
+			total += (size_t)bytesRead;
+		}
+		return total;
+	}
+
+#endif
+
+	// MOVIE SOURCE DIRECT ///////////////////////////////////////
+	//////////////////////////////////////////////////////////////
+
+	MovieSourceDirect::MovieSourceDirect( const fs::path &path )
+	: MovieSourceFile( path, true ), mBouncePool( BufferPool::create( 1024 * 1024, 4, kAlignment ) )
+	{
+	}
+
+	size_t MovieSourceDirect::read( uint64_t offset, void *dst, size_t size )
+	{
+		const uint64_t mask = kAlignment - 1;
+		if( ( offset & mask ) == 0 && ( size & mask ) == 0 && ( (uintptr_t)dst & mask ) == 0 )
+			return MovieSourceFile::read( offset, dst, size );
+
+		// Widen to whole blocks; a read running past the end of the file simply comes back short
+		const uint64_t alignedOffset = offset & ~mask;
+		const size_t alignedSize = (size_t)( ( ( offset + size + mask ) & ~mask ) - alignedOffset );
+		std::shared_ptr<uint8_t> bounce = mBouncePool->acquire( alignedSize );
+		const size_t bytesRead = MovieSourceFile::read( alignedOffset, bounce.get(), alignedSize );
+		const size_t head = (size_t)( offset - alignedOffset );
+		if( bytesRead <= head )
+			return 0;
+		const size_t count = std::min( size, bytesRead - head );
+		std::memcpy( dst, bounce.get() + head, count );
+		return count;
+	}
+
+	// MOVIE SOURCE MAPPED ///////////////////////////////////////
+	//////////////////////////////////////////////////////////////
+
+#if defined( CINDER_MSW )
+
+	MovieSourceMapped::MovieSourceMapped( const fs::path &path )
+	: mPath( path ), mData( nullptr ), mSize( 0 ), mMapping( NULL )
+	{
+		mHandle = ::CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL );
+		if( mHandle == INVALID_HANDLE_VALUE )
+			throw MovieSourceExc( "Unable to open " + path.string() );
+
+		LARGE_INTEGER size;
+		::GetFileSizeEx( (HANDLE)mHandle, &size );
+		mSize = size.QuadPart;
+		if( mSize > 0 && mSize <= SIZE_MAX ) {
+			mMapping = ::CreateFileMappingW( (HANDLE)mHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+			if( mMapping )
+				mData = (const uint8_t*)::MapViewOfFile( (HANDLE)mMapping, FILE_MAP_READ, 0, 0, 0 );
+		}
+		if( ! mData ) {
+			if( mMapping )
+				::CloseHandle( (HANDLE)mMapping );
+			::CloseHandle( (HANDLE)mHandle );
+			throw MovieSourceExc( "Unable to map " + path.string() );
+		}
+	}
+
+	MovieSourceMapped::~MovieSourceMapped()
+	{
+		::UnmapViewOfFile( mData );
+		::CloseHandle( (HANDLE)mMapping );
+		::CloseHandle( (HANDLE)mHandle );
+	}
+
+	void MovieSourceMapped::adviseWillNeed( uint64_t offset, uint64_t size )
+	{
+		// PrefetchVirtualMemory() needs Windows 8, older systems rely on the cache manager's own read-ahead
+	}
+
+	void MovieSourceMapped::adviseDontNeed( uint64_t offset, uint64_t size )
+	{
+	}
+
+#else
+
+	MovieSourceMapped::MovieSourceMapped( const fs::path &path )
+	: mPath( path ), mData( nullptr ), mSize( 0 ), mPageSize( (size_t)::sysconf( _SC_PAGESIZE ) )
+	{
+		mFd = ::open( path.string().c_str(), O_RDONLY );
+		if( mFd < 0 )
+			throw MovieSourceExc( "Unable to open " + path.string() );
+
+		struct stat st;
+		if( ::fstat( mFd, &st ) == 0 )
+			mSize = (uint64_t)st.st_size;
+		void *data = MAP_FAILED;
+		if( mSize > 0 && mSize <= SIZE_MAX )
+			data = ::mmap( nullptr, (size_t)mSize, PROT_READ, MAP_SHARED, mFd, 0 );
+		if( data == MAP_FAILED ) {
+			::close( mFd );
+			throw MovieSourceExc( "Unable to map " + path.string() );
+		}
+		mData = (const uint8_t*)data;
+
+		// Playback mostly moves forward; adviseWillNeed() covers what the kernel's read-ahead can't guess, ie. after a seek
+		::madvise( (void*)mData, (size_t)mSize, MADV_SEQUENTIAL );
+	}
+
+	MovieSourceMapped::~MovieSourceMapped()
+	{
+		::munmap( (void*)mData, (size_t)mSize );
+		::close( mFd );
+	}
+
+	void MovieSourceMapped::adviseWillNeed( uint64_t offset, uint64_t size )
+	{
+		if( offset >= mSize )
+			return;
+		const uint64_t start = offset & ~uint64_t( mPageSize - 1 );
+		const uint64_t end = std::min( offset + size, mSize );
+		::madvise( (void*)( mData + start ), (size_t)( end - start ), MADV_WILLNEED );
+	}
+
+	void MovieSourceMapped::adviseDontNeed( uint64_t offset, uint64_t size )
+	{
+		if( offset >= mSize )
+			return;
+		// Only whole pages inside the range, so neighbouring samples sharing a page stay resident
+		const uint64_t start = ( offset + mPageSize - 1 ) & ~uint64_t( mPageSize - 1 );
+		const uint64_t end = std::min( offset + size, mSize ) & ~uint64_t( mPageSize - 1 );
+		if( end <= start )
+			return;
+		::madvise( (void*)( mData + start ), (size_t)( end - start ), MADV_DONTNEED );
+#if ! defined( CINDER_MAC )
+		// Dropping our view doesn't evict the page cache, which is what relieves the rest of the system
+		::posix_fadvise( mFd, (off_t)start, (off_t)( end - start ), POSIX_FADV_DONTNEED );
+#endif
+	}
+
+#endif
+
+	size_t MovieSourceMapped::read( uint64_t offset, void *dst, size_t size )
+	{
+		if( offset >= mSize )
+			return 0;
+		size_t count = (size_t)std::min<uint64_t>( size, mSize - offset );
+		std::memcpy( dst, mData + offset, count );
+		return count;
+	}
+
+	const uint8_t* MovieSourceMapped::getPointer( uint64_t offset, size_t size )
+	{
+		if( offset > mSize || size > mSize - offset )
+			return nullptr;
+		return mData + offset;
+	}
+
+	// MOVIE SOURCE MEMORY ///////////////////////////////////////
+	//////////////////////////////////////////////////////////////
+
+	MovieSourceMemory::MovieSourceMemory( const void *data, size_t dataSize )
+	: mData( (const uint8_t*)data ), mDataSize( dataSize )
+	{
+	}
+
+	MovieSourceMemory::MovieSourceMemory( const BufferRef &buffer )
+	: mBuffer( buffer ), mData( (const uint8_t*)buffer->getData() ), mDataSize( buffer->getSize() )
+	{
+	}
+
+	const uint8_t* MovieSourceMemory::getPointer( uint64_t offset, size_t size )
+	{
+		if( offset > mDataSize || size > mDataSize - offset )
+			return nullptr;
+		return mData + offset;
+	}
+
+	size_t MovieSourceMemory::read( uint64_t offset, void *dst, size_t size )
+	{
+		if( offset >= mDataSize )
+			return 0;
+		size_t count = (size_t)std::min<uint64_t>( size, mDataSize - offset );
+		std::memcpy( dst, mData + offset, count );
+		return count;
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,140 @@
+/*
+ *  HapMovieSource.h
+ *
+ *  Random-access byte sources used by the native Hap container parser and frame reader.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/DataSource.h"
+#include "cinder/Exception.h"
+
+#include "HapBufferPool.h"
+
+namespace cinder { namespace hap {
+
+	typedef std::shared_ptr<class MovieSource> MovieSourceRef;
+
+	//! Positional, thread-safe reader over the bytes of a movie file.
+	class MovieSource {
+	public:
+		virtual ~MovieSource() {}
+
+		//! Reads up to \a size bytes starting at \a offset into \a dst. Returns the number of bytes read.
+		virtual size_t		read( uint64_t offset, void *dst, size_t size ) = 0;
+		//! Returns the total size of the source in bytes.
+		virtual uint64_t	getSize() const = 0;
+		//! Returns the block size that offsets, sizes and destination addresses of read() should be multiples of to avoid an extra copy.
+		virtual size_t		getReadAlignment() const { return 1; }
+		//! Returns the \a size bytes at \a offset in place, valid as long as the source, or null if the source isn't memory resident or mapped.
+		virtual const uint8_t*	getPointer( uint64_t offset, size_t size ) { return nullptr; }
+
+		//! Hints that [\a offset, \a offset + \a size) is about to be read, so it can be paged in ahead of time.
+		virtual void		adviseWillNeed( uint64_t offset, uint64_t size ) {}
+		//! Hints that [\a offset, \a offset + \a size) won't be read again soon, so its pages can be evicted.
+		virtual void		adviseDontNeed( uint64_t offset, uint64_t size ) {}
+
+		//! Maps the file at \a path, falling back to positional reads if it can't be mapped.
+		static MovieSourceRef create( const fs::path &path );
+		//! Wraps \a data without copying it. The caller must keep \a data alive, as with MovieBase::initFromMemory().
+		static MovieSourceRef create( const void *data, size_t dataSize );
+		//! Reads from the file behind \a dataSource if it has one, otherwise from its buffer.
+		static MovieSourceRef create( const DataSourceRef &dataSource );
+		//! Opens the file at \a path for reads that bypass the OS cache, falling back to a mapping if the file system doesn't allow it.
+		static MovieSourceRef createUnbuffered( const fs::path &path );
+	};
+
+	class MovieSourceFile : public MovieSource {
+	public:
+		MovieSourceFile( const fs::path &path );
+		~MovieSourceFile();
+
+		size_t		read( uint64_t offset, void *dst, size_t size ) override;
+		uint64_t	getSize() const override { return mSize; }
+
+		const fs::path&	getFilePath() const { return mPath; }
+#if ! defined( CINDER_MSW )
+		int				getFileDescriptor() const { return mFd; }
+#endif
+
+	protected:
+		//! Opens \a path with the OS cache bypassed when \a unbuffered is true.
+		MovieSourceFile( const fs::path &path, bool unbuffered );
+
+		fs::path	mPath;
+		uint64_t	mSize;
+#if defined( CINDER_MSW )
+		void		*mHandle;
+#else
+		int			mFd;
+#endif
+	};
+
+	//! Unbuffered file reads (O_DIRECT on Linux, F_NOCACHE on OS X, FILE_FLAG_NO_BUFFERING on Windows). Sustained playback bandwidth
+	//! stays predictable and doesn't evict the rest of the page cache. Reads aligned to getReadAlignment() go straight to the
+	//! destination, others bounce through a pooled aligned buffer.
+	class MovieSourceDirect : public MovieSourceFile {
+	public:
+		MovieSourceDirect( const fs::path &path );
+
+		size_t		read( uint64_t offset, void *dst, size_t size ) override;
+		size_t		getReadAlignment() const override { return kAlignment; }
+
+		//! Block size all unbuffered reads are aligned to; a multiple of the logical sector size of any common device.
+		static const size_t kAlignment = 4096;
+
+	protected:
+		BufferPoolRef	mBouncePool;
+	};
+
+	//! Whole file mapped read-only, so samples decode straight from the page cache without being copied.
+	class MovieSourceMapped : public MovieSource {
+	public:
+		MovieSourceMapped( const fs::path &path );
+		~MovieSourceMapped();
+
+		size_t			read( uint64_t offset, void *dst, size_t size ) override;
+		uint64_t		getSize() const override { return mSize; }
+		const uint8_t*	getPointer( uint64_t offset, size_t size ) override;
+		void			adviseWillNeed( uint64_t offset, uint64_t size ) override;
+		void			adviseDontNeed( uint64_t offset, uint64_t size ) override;
+
+		const fs::path&	getFilePath() const { return mPath; }
+
+	protected:
+		fs::path		mPath;
+		const uint8_t	*mData;
+		uint64_t		mSize;
+#if defined( CINDER_MSW )
+		void			*mHandle, *mMapping;
+#else
+		int				mFd;
+		size_t			mPageSize;
+#endif
+	};
+
+	class MovieSourceMemory : public MovieSource {
+	public:
+		MovieSourceMemory( const void *data, size_t dataSize );
+		MovieSourceMemory( const BufferRef &buffer );
+
+		size_t		read( uint64_t offset, void *dst, size_t size ) override;
+		uint64_t	getSize() const override { return mDataSize; }
+		const uint8_t*	getPointer( uint64_t offset, size_t size ) override;
+
+		const uint8_t*	getData() const { return mData; }
+
+	protected:
+		BufferRef		mBuffer; // only set when the source owns its bytes
+		const uint8_t	*mData;
+		size_t			mDataSize;
+	};
+
+	class MovieSourceExc : public Exception {
+	public:
+		MovieSourceExc( const std::string &description ) : Exception( description ) {}
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,380 @@
+/*
+ *  HapMovieWriter.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapMovieWriter.h"
+
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		const size_t kFreeHeaderSize = 8;
+
+		//! Appends big-endian fields and atoms to a buffer.
+		class AtomBuilder {
+		public:
+			AtomBuilder( std::vector<uint8_t> *data ) : mData( data ) {}
+
+			void u8( uint32_t v ) { mData->push_back( uint8_t( v ) ); }
+			void u16( uint32_t v ) { u8( v >> 8 ); u8( v ); }
+			void u32( uint32_t v ) { u16( v >> 16 ); u16( v ); }
+			void u64( uint64_t v ) { u32( uint32_t( v >> 32 ) ); u32( uint32_t( v ) ); }
+			void fourCC( const char *s ) { u32( makeFourCC( s ) ); }
+			void zeros( size_t count ) { mData->insert( mData->end(), count, 0 ); }
+			//! Version and flags of a full atom.
+			void versionFlags( uint32_t version, uint32_t flags ) { u32( ( version << 24 ) | flags ); }
+			//! Identity transform, in 16.16 and 2.30 fixed point.
+			void matrix()
+			{
+				const uint32_t identity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+				for( uint32_t v : identity )
+					u32( v );
+			}
+			//! Appends a time or duration of a full atom of \a version, 64 bits for version 1.
+			void time( uint32_t version, uint64_t v )
+			{
+				if( version == 1 )
+					u64( v );
+				else
+					u32( uint32_t( v ) );
+			}
+
+			//! Starts an atom of \a type, returns what end() takes to fill in its size.
+			size_t begin( const char *type ) { return begin( makeFourCC( type ) ); }
+			size_t begin( uint32_t type )
+			{
+				const size_t start = mData->size();
+				u32( 0 );
+				u32( type );
+				return start;
+			}
+			void end( size_t start )
+			{
+				const uint32_t size = uint32_t( mData->size() - start );
+				for( size_t i = 0; i < 4; ++i )
+					(*mData)[start + i] = uint8_t( size >> ( 24 - 8 * i ) );
+			}
+
+		private:
+			std::vector<uint8_t>	*mData;
+		};
+
+		const char* getCompressorName( uint32_t codecType )
+		{
+			switch( codecType ) {
+				case CODEC_HAP_A: return "Hap Alpha";
+				case CODEC_HAP_Q: return "Hap Q";
+				default: return "Hap";
+			}
+		}
+
+	} // anonymous namespace
+
+	MovieWriterRef MovieWriter::create( const fs::path &path, const Format &format )
+	{
+		return MovieWriterRef( new MovieWriter( path, format ) );
+	}
+
+	MovieWriter::MovieWriter( const fs::path &path, const Format &format )
+	: mPath( path ), mFormat( format ), mPosition( 0 ), mReservedOffset( 0 ), mReservedSize( 0 ), mMdatOffset( 0 ), mDuration( 0 ),
+	  mFinished( false ), mMovieAtomFirst( false )
+	{
+		if( ! isHapCodec( format.mCodecType ) || format.mWidth <= 0 || format.mHeight <= 0 || format.mWidth > 0xFFFF || format.mHeight > 0xFFFF || ! format.mTimeScale )
+			throw MovieWriterExc( "Invalid movie format" );
+		mFormat.mSampleAlignment = std::max<size_t>( format.mSampleAlignment, 1 );
+
+		mFile.open( path.string().c_str(), std::ios::binary | std::ios::trunc );
+		if( ! mFile )
+			throw MovieWriterExc( "Unable to create " + path.string() );
+
+		std::vector<uint8_t> ftyp;
+		AtomBuilder atom( &ftyp );
+		const size_t start = atom.begin( "ftyp" );
+		atom.fourCC( "qt  " );
+		atom.u32( 0x20050300 );
+		atom.fourCC( "qt  " );
+		atom.end( start );
+		write( ftyp.data(), ftyp.size() );
+
+		// Room for the largest movie atom the reserved samples can need, which stays a free atom if they outgrow it
+		if( format.mReservedSamples ) {
+			mReservedOffset = mPosition;
+			mReservedSize = buildMovieAtom( true ).size() + format.mReservedSamples * ( 4 + 8 ) + format.mReservedDurations * 8 + kFreeHeaderSize;
+			std::vector<uint8_t> free;
+			AtomBuilder freeAtom( &free );
+			freeAtom.u32( uint32_t( mReservedSize ) );
+			freeAtom.fourCC( "free" );
+			write( free.data(), free.size() );
+			writeZeros( mReservedSize - kFreeHeaderSize );
+		}
+
+		// A 64-bit header, so the media data can outgrow 4 GiB without moving the samples. finish() fills in its size.
+		mMdatOffset = mPosition;
+		std::vector<uint8_t> mdat;
+		AtomBuilder mdatAtom( &mdat );
+		mdatAtom.u32( 1 );
+		mdatAtom.fourCC( "mdat" );
+		mdatAtom.u64( 0 );
+		write( mdat.data(), mdat.size() );
+	}
+
+	MovieWriter::~MovieWriter()
+	{
+		if( mFinished )
+			return;
+		try {
+			finish();
+		}
+		catch( const MovieWriterExc &exc ) {
+			CI_LOG_E( "HAP ERROR :: " << exc.what() );
+		}
+	}
+
+	void MovieWriter::addSample( const void *data, size_t size, uint32_t duration )
+	{
+		if( mFinished )
+			throw MovieWriterExc( "Movie already finished" );
+		if( ! data || ! size || size > 0xFFFFFFFF )
+			throw MovieWriterExc( "Invalid sample" );
+
+		// Padding between samples is part of the media data, no sample refers to it
+		writeZeros( ( mFormat.mSampleAlignment - mPosition % mFormat.mSampleAlignment ) % mFormat.mSampleAlignment );
+		mSampleOffsets.push_back( mPosition );
+		mSampleSizes.push_back( uint32_t( size ) );
+		write( data, size );
+
+		if( mTimeToSamples.empty() || mTimeToSamples.back().mDuration != duration )
+			mTimeToSamples.push_back( { 0, duration } );
+		++mTimeToSamples.back().mCount;
+		mDuration += duration;
+	}
+
+	void MovieWriter::finish()
+	{
+		if( mFinished )
+			return;
+		mFinished = true;
+
+		std::vector<uint8_t> mdatSize;
+		AtomBuilder( &mdatSize ).u64( mPosition - mMdatOffset );
+		mFile.seekp( std::streamoff( mMdatOffset + 8 ) );
+		mFile.write( (const char *)mdatSize.data(), mdatSize.size() );
+
+		const std::vector<uint8_t> moov = buildMovieAtom( false );
+		if( moov.size() == mReservedSize || moov.size() + kFreeHeaderSize <= mReservedSize ) {
+			// What the movie atom leaves of the reserved room stays free
+			std::vector<uint8_t> reserved( moov );
+			const uint64_t left = mReservedSize - moov.size();
+			if( left ) {
+				AtomBuilder freeAtom( &reserved );
+				freeAtom.u32( uint32_t( left ) );
+				freeAtom.fourCC( "free" );
+			}
+			mFile.seekp( std::streamoff( mReservedOffset ) );
+			mFile.write( (const char *)reserved.data(), reserved.size() );
+			mMovieAtomFirst = true;
+		}
+		else {
+			if( mReservedSize )
+				CI_LOG_W( "HAP WARNING :: " << mSampleSizes.size() << " samples outgrew the room reserved for the movie atom, writing it last." );
+			mFile.seekp( std::streamoff( mPosition ) );
+			mFile.write( (const char *)moov.data(), moov.size() );
+			mPosition += moov.size();
+		}
+
+		mFile.close();
+		if( mFile.fail() )
+			throw MovieWriterExc( "Unable to write " + mPath.string() );
+	}
+
+	std::vector<uint8_t> MovieWriter::buildMovieAtom( bool wide ) const
+	{
+		// Versions 1 of the headers hold 64-bit times, co64 64-bit offsets
+		const uint32_t version = wide || mDuration > 0xFFFFFFFF ? 1 : 0;
+		const bool wideOffsets = wide || ( ! mSampleOffsets.empty() && mSampleOffsets.back() > 0xFFFFFFFF );
+		const bool alpha = mFormat.mCodecType == CODEC_HAP_A;
+
+		std::vector<uint8_t> data;
+		AtomBuilder atom( &data );
+		const size_t moov = atom.begin( "moov" );
+
+		// The movie's time scale is the media's, so durations carry over
+		const size_t mvhd = atom.begin( "mvhd" );
+		atom.versionFlags( version, 0 );
+		atom.time( version, 0 );
+		atom.time( version, 0 );
+		atom.u32( mFormat.mTimeScale );
+		atom.time( version, mDuration );
+		atom.u32( 0x00010000 );
+		atom.u16( 0x0100 );
+		atom.zeros( 10 );
+		atom.matrix();
+		atom.zeros( 6 * 4 );
+		atom.u32( 2 );
+		atom.end( mvhd );
+
+		const size_t trak = atom.begin( "trak" );
+		const size_t tkhd = atom.begin( "tkhd" );
+		// Enabled, in the movie, in the preview and in the poster
+		atom.versionFlags( version, 0xF );
+		atom.time( version, 0 );
+		atom.time( version, 0 );
+		atom.u32( 1 );
+		atom.zeros( 4 );
+		atom.time( version, mDuration );
+		atom.zeros( 8 + 2 + 2 + 2 + 2 );
+		atom.matrix();
+		atom.u32( uint32_t( mFormat.mWidth ) << 16 );
+		atom.u32( uint32_t( mFormat.mHeight ) << 16 );
+		atom.end( tkhd );
+
+		const size_t mdia = atom.begin( "mdia" );
+		const size_t mdhd = atom.begin( "mdhd" );
+		atom.versionFlags( version, 0 );
+		atom.time( version, 0 );
+		atom.time( version, 0 );
+		atom.u32( mFormat.mTimeScale );
+		atom.time( version, mDuration );
+		atom.u16( 0 );
+		atom.u16( 0 );
+		atom.end( mdhd );
+
+		const size_t mediaHandler = atom.begin( "hdlr" );
+		atom.versionFlags( 0, 0 );
+		atom.fourCC( "mhlr" );
+		atom.fourCC( "vide" );
+		atom.zeros( 12 );
+		// Empty Pascal string name
+		atom.u8( 0 );
+		atom.end( mediaHandler );
+
+		const size_t minf = atom.begin( "minf" );
+		const size_t vmhd = atom.begin( "vmhd" );
+		atom.versionFlags( 0, 1 );
+		// Dither copy, with the default op color
+		atom.u16( 0x40 );
+		atom.u16( 0x8000 );
+		atom.u16( 0x8000 );
+		atom.u16( 0x8000 );
+		atom.end( vmhd );
+
+		const size_t dataHandler = atom.begin( "hdlr" );
+		atom.versionFlags( 0, 0 );
+		atom.fourCC( "dhlr" );
+		atom.fourCC( "alis" );
+		atom.zeros( 12 );
+		atom.u8( 0 );
+		atom.end( dataHandler );
+
+		const size_t dinf = atom.begin( "dinf" );
+		const size_t dref = atom.begin( "dref" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( 1 );
+		// The media data is in this very file
+		const size_t alis = atom.begin( "alis" );
+		atom.versionFlags( 0, 1 );
+		atom.end( alis );
+		atom.end( dref );
+		atom.end( dinf );
+
+		const size_t stbl = atom.begin( "stbl" );
+		const size_t stsd = atom.begin( "stsd" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( 1 );
+		const size_t description = atom.begin( mFormat.mCodecType );
+		atom.zeros( 6 );
+		atom.u16( 1 );
+		atom.u16( 0 );
+		atom.u16( 0 );
+		atom.zeros( 4 );
+		// Temporal and spatial quality, normal
+		atom.u32( 0 );
+		atom.u32( 0x200 );
+		atom.u16( uint32_t( mFormat.mWidth ) );
+		atom.u16( uint32_t( mFormat.mHeight ) );
+		atom.u32( 72 << 16 );
+		atom.u32( 72 << 16 );
+		atom.u32( 0 );
+		atom.u16( 1 );
+		const char *name = getCompressorName( mFormat.mCodecType );
+		const size_t nameLength = std::strlen( name );
+		atom.u8( uint32_t( nameLength ) );
+		for( size_t i = 0; i < 31; ++i )
+			atom.u8( i < nameLength ? name[i] : 0 );
+		atom.u16( alpha ? 32 : 24 );
+		// No color table
+		atom.u16( 0xFFFF );
+		atom.end( description );
+		atom.end( stsd );
+
+		const size_t stts = atom.begin( "stts" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( uint32_t( mTimeToSamples.size() ) );
+		for( const TimeToSample &entry : mTimeToSamples ) {
+			atom.u32( entry.mCount );
+			atom.u32( entry.mDuration );
+		}
+		atom.end( stts );
+
+		// One sample per chunk, so each sample has its own offset and can be aligned
+		const size_t stsc = atom.begin( "stsc" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( 1 );
+		atom.u32( 1 );
+		atom.u32( 1 );
+		atom.u32( 1 );
+		atom.end( stsc );
+
+		const size_t stsz = atom.begin( "stsz" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( 0 );
+		atom.u32( uint32_t( mSampleSizes.size() ) );
+		for( uint32_t size : mSampleSizes )
+			atom.u32( size );
+		atom.end( stsz );
+
+		const size_t stco = atom.begin( wideOffsets ? "co64" : "stco" );
+		atom.versionFlags( 0, 0 );
+		atom.u32( uint32_t( mSampleOffsets.size() ) );
+		for( uint64_t offset : mSampleOffsets ) {
+			if( wideOffsets )
+				atom.u64( offset );
+			else
+				atom.u32( uint32_t( offset ) );
+		}
+		atom.end( stco );
+
+		atom.end( stbl );
+		atom.end( minf );
+		atom.end( mdia );
+		atom.end( trak );
+		atom.end( moov );
+		return data;
+	}
+
+	void MovieWriter::write( const void *data, size_t size )
+	{
+		if( ! mFile.write( (const char *)data, size ) )
+			throw MovieWriterExc( "Unable to write " + mPath.string() );
+		mPosition += size;
+	}
+
+	void MovieWriter::writeZeros( uint64_t size )
+	{
+		static const char kZeros[4096] = {};
+		while( size ) {
+			const size_t chunk = (size_t)std::min<uint64_t>( size, sizeof( kZeros ) );
+			write( kZeros, chunk );
+			size -= chunk;
+		}
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,96 @@
+/*
+ *  HapMovieWriter.h
+ *
+ *  Portable QuickTime writer for movies with one Hap video track, the counterpart of SampleTable.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "cinder/Cinder.h"
+#include "cinder/Exception.h"
+
+#include "HapTypes.h"
+
+#include <fstream>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	typedef std::shared_ptr<class MovieWriter> MovieWriterRef;
+
+	//! Writes compressed Hap frames, ie. from Encoder, to a QuickTime movie as they come. The movie atom is written by
+	//! finish(), in front of the samples when room was reserved for it, so players open the movie without reading its end.
+	class MovieWriter {
+	public:
+		struct Format {
+			Format() : mCodecType( CODEC_HAP ), mWidth( 0 ), mHeight( 0 ), mTimeScale( 30 ), mSampleAlignment( 1 ), mReservedSamples( 0 ), mReservedDurations( 0 ) {}
+
+			//! CODEC_HAP, CODEC_HAP_A or CODEC_HAP_Q, matching the pixel format of the frames.
+			Format&		codecType( uint32_t codecType ) { mCodecType = codecType; return *this; }
+			Format&		size( int32_t width, int32_t height ) { mWidth = width; mHeight = height; return *this; }
+			//! Units per second of the sample durations.
+			Format&		timeScale( uint32_t timeScale ) { mTimeScale = timeScale; return *this; }
+			//! Starts every sample at a multiple of \a alignment bytes into the file, ie. MovieSourceDirect::kAlignment so
+			//! unbuffered reads of whole samples need no bounce buffer.
+			Format&		sampleAlignment( size_t alignment ) { mSampleAlignment = alignment; return *this; }
+			//! Reserves room ahead of the samples for the movie atom of \a numSamples samples, whose durations change
+			//! \a numDurations - 1 times. Movies that outgrow it get their movie atom after the samples.
+			Format&		reserve( size_t numSamples, size_t numDurations = 1 ) { mReservedSamples = numSamples; mReservedDurations = numDurations; return *this; }
+
+			uint32_t	mCodecType;
+			int32_t		mWidth, mHeight;
+			uint32_t	mTimeScale;
+			size_t		mSampleAlignment;
+			size_t		mReservedSamples, mReservedDurations;
+		};
+
+		//! Creates the movie at \a path, replacing any file there. Throws MovieWriterExc if it can't be written.
+		static MovieWriterRef	create( const fs::path &path, const Format &format );
+		//! Finishes the movie if finish() wasn't called, logging rather than throwing errors.
+		~MovieWriter();
+
+		//! Appends the \a size byte frame \a data, shown for \a duration time scale units. Throws MovieWriterExc on failure.
+		void		addSample( const void *data, size_t size, uint32_t duration );
+		//! Writes the movie atom and closes the file. Throws MovieWriterExc on failure.
+		void		finish();
+
+		const Format&	getFormat() const { return mFormat; }
+		size_t		getNumSamples() const { return mSampleSizes.size(); }
+		//! Returns the size of the file so far.
+		uint64_t	getSize() const { return mPosition; }
+		//! Returns true once finish() wrote the movie atom in the room reserved for it, ahead of the samples.
+		bool		isMovieAtomFirst() const { return mMovieAtomFirst; }
+
+	protected:
+		MovieWriter( const fs::path &path, const Format &format );
+
+		//! A run of samples of equal duration.
+		struct TimeToSample {
+			uint32_t	mCount, mDuration;
+		};
+
+		//! Builds the movie atom of the samples so far. \a wide forces 64-bit times and offsets, for the largest it can get.
+		std::vector<uint8_t>	buildMovieAtom( bool wide ) const;
+		void		write( const void *data, size_t size );
+		void		writeZeros( uint64_t size );
+
+		fs::path				mPath;
+		Format					mFormat;
+		std::ofstream			mFile;
+		uint64_t				mPosition;
+		uint64_t				mReservedOffset, mReservedSize;
+		uint64_t				mMdatOffset;
+		std::vector<uint32_t>	mSampleSizes;
+		std::vector<uint64_t>	mSampleOffsets;
+		std::vector<TimeToSample>	mTimeToSamples;
+		uint64_t				mDuration;
+		bool					mFinished, mMovieAtomFirst;
+	};
+
+	class MovieWriterExc : public Exception {
+	public:
+		MovieWriterExc( const std::string &description ) : Exception( description ) {}
+	};
+
+} } // namespace cinder::hap
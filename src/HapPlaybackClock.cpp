@@ -0,0 +1,167 @@
+/*
+ *  HapPlaybackClock.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapPlaybackClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cinder { namespace hap {
+
+	PlaybackClock::PlaybackClock()
+	: mGeneration( 0 ), mMaxDrift( 0 ), mNumFrames( 0 ), mNumDriftedFrames( 0 )
+	{
+		mState.mPlaying = false;
+		mState.mRate = 1.0;
+		mState.mAnchorTime = 0;
+		mState.mAnchorClock = Clock::now();
+		mState.mSeekDirection = 1;
+	}
+
+	double PlaybackClock::getTime( const State &state, Clock::time_point now )
+	{
+		// Held until a pending start
+		if( ! state.mPlaying || now <= state.mAnchorClock )
+			return state.mAnchorTime;
+		return state.mAnchorTime + std::chrono::duration<double>( now - state.mAnchorClock ).count() * state.mRate;
+	}
+
+	void PlaybackClock::rebaseLocked( Clock::time_point now )
+	{
+		mState.mAnchorTime = getTimeLocked( now );
+		mState.mAnchorClock = std::max( mState.mAnchorClock, now );
+	}
+
+	void PlaybackClock::play()
+	{
+		playIn( 0 );
+	}
+
+	void PlaybackClock::playIn( double secondsFromNow )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( mState.mPlaying )
+			return;
+		mState.mAnchorClock = Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( std::max( secondsFromNow, 0.0 ) ) );
+		mState.mPlaying = true;
+		++mGeneration;
+	}
+
+	void PlaybackClock::stop()
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		const Clock::time_point now = Clock::now();
+		mState.mAnchorTime = getTimeLocked( now );
+		mState.mAnchorClock = now;
+		mState.mPlaying = false;
+		++mGeneration;
+	}
+
+	bool PlaybackClock::isPlaying() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mState.mPlaying;
+	}
+
+	void PlaybackClock::setRate( double rate )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		rebaseLocked( Clock::now() );
+		mState.mRate = rate;
+		++mGeneration;
+	}
+
+	double PlaybackClock::getRate() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mState.mRate;
+	}
+
+	void PlaybackClock::seek( double seconds )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		const Clock::time_point now = Clock::now();
+		const double current = getTimeLocked( now );
+		if( seconds != current )
+			mState.mSeekDirection = seconds < current ? -1 : 1;
+		rebaseLocked( now );
+		mState.mAnchorTime = seconds;
+		++mGeneration;
+	}
+
+	double PlaybackClock::getTime() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return getTimeLocked( Clock::now() );
+	}
+
+	double PlaybackClock::getTimeIn( double secondsFromNow ) const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return getTimeLocked( Clock::now() + std::chrono::duration_cast<Clock::duration>( std::chrono::duration<double>( secondsFromNow ) ) );
+	}
+
+	int PlaybackClock::getSeekDirection() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mState.mSeekDirection;
+	}
+
+	PlaybackClock::State PlaybackClock::getState() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mState;
+	}
+
+	void PlaybackClock::setState( const State &state )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mState = state;
+		++mGeneration;
+	}
+
+	uint64_t PlaybackClock::getGeneration() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mGeneration;
+	}
+
+	void PlaybackClock::recordDrift( double seconds )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		++mNumFrames;
+		if( seconds != 0 )
+			++mNumDriftedFrames;
+		mMaxDrift = std::max( mMaxDrift, std::abs( seconds ) );
+	}
+
+	double PlaybackClock::getMaxDrift() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mMaxDrift;
+	}
+
+	uint64_t PlaybackClock::getNumFrames() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mNumFrames;
+	}
+
+	uint64_t PlaybackClock::getNumDriftedFrames() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		return mNumDriftedFrames;
+	}
+
+	void PlaybackClock::resetDrift()
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mMaxDrift = 0;
+		mNumFrames = mNumDriftedFrames = 0;
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,89 @@
+/*
+ *  HapPlaybackClock.h
+ *
+ *  Master time base shared by movies that must stay locked together, ie. the layers of one composition.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace cinder { namespace hap {
+
+	typedef std::shared_ptr<class PlaybackClock> PlaybackClockRef;
+
+	//! Time any number of movies follow, see MovieGlHap::setPlaybackClock(). Each derives its position from this one clock,
+	//! folding it into its own loop, so they start, pause and seek on the very same frame and can't drift apart however
+	//! long they run. Followers report how far the frames they showed were from the clock, see getMaxDrift(). Thread-safe.
+	class PlaybackClock {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static PlaybackClockRef create() { return PlaybackClockRef( new PlaybackClock() ); }
+
+		void		play();
+		//! Starts playing \a secondsFromNow seconds from now, holding the current time until then. Leaves followers on other
+		//! machines the time to receive the start, see ClockSync::getStartDelay().
+		void		playIn( double secondsFromNow );
+		void		stop();
+		bool		isPlaying() const;
+		//! Sets the speed relative to real time, negative values running backwards. Defaults to 1.
+		void		setRate( double rate );
+		double		getRate() const;
+
+		//! Moves to \a seconds, exactly.
+		void		seek( double seconds );
+		//! Returns the current time in seconds. Not bounded, each follower folds it into its own duration or loop.
+		double		getTime() const;
+		//! Returns the time \a secondsFromNow seconds from now, if nothing changes meanwhile.
+		double		getTimeIn( double secondsFromNow ) const;
+		//! Returns the direction of the last seek, 1 or -1.
+		int			getSeekDirection() const;
+
+		//! Everything the time derives from, so another clock can be made to run exactly the same, ie. on another machine.
+		struct State {
+			bool				mPlaying;
+			double				mRate;
+			//! Time at mAnchorClock, which is in the future while a start is pending.
+			double				mAnchorTime;
+			Clock::time_point	mAnchorClock;
+			int					mSeekDirection;
+		};
+		State		getState() const;
+		//! Takes over \a state at once, followers never see part of it.
+		void		setState( const State &state );
+		//! Returns the time \a state reads at \a now.
+		static double	getTime( const State &state, Clock::time_point now );
+		//! Returns a counter bumped by every change to the state, to tell when it needs to be passed on.
+		uint64_t	getGeneration() const;
+
+		//! Records that a follower showed a frame \a seconds away from the clock's time, 0 when it was the right one.
+		void		recordDrift( double seconds );
+		//! Returns the largest drift recorded since resetDrift(), in seconds.
+		double		getMaxDrift() const;
+		//! Returns the number of frames shown, and how many of those weren't the one due, since resetDrift().
+		uint64_t	getNumFrames() const;
+		uint64_t	getNumDriftedFrames() const;
+		void		resetDrift();
+
+	protected:
+		PlaybackClock();
+
+		//! Returns the time at \a now, with mMutex locked.
+		double		getTimeLocked( Clock::time_point now ) const { return getTime( mState, now ); }
+		//! Moves the anchor to \a now, with mMutex locked. A pending start stays pending.
+		void		rebaseLocked( Clock::time_point now );
+
+		mutable std::mutex	mMutex;
+		State				mState;
+		uint64_t			mGeneration;
+
+		double				mMaxDrift;
+		uint64_t			mNumFrames, mNumDriftedFrames;
+	};
+
+} } // namespace cinder::hap
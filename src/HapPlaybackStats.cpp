@@ -0,0 +1,84 @@
+/*
+ *  HapPlaybackStats.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapPlaybackStats.h"
+
+namespace cinder { namespace hap {
+
+	LatencyHistogram::LatencyHistogram()
+	: mCount( 0 ), mTotalMicros( 0 ), mMaxMicros( 0 )
+	{
+		for( auto &bucket : mBuckets )
+			bucket = 0;
+	}
+
+	void LatencyHistogram::record( double seconds )
+	{
+		const uint64_t micros = seconds > 0 ? uint64_t( seconds * 1e6 ) : 0;
+
+		size_t bucket = 0;
+		while( bucket < kNumBuckets - 1 && ( micros >> bucket ) != 0 )
+			++bucket;
+		mBuckets[bucket].fetch_add( 1, std::memory_order_relaxed );
+
+		mCount.fetch_add( 1, std::memory_order_relaxed );
+		mTotalMicros.fetch_add( micros, std::memory_order_relaxed );
+		uint64_t max = mMaxMicros.load( std::memory_order_relaxed );
+		while( micros > max && ! mMaxMicros.compare_exchange_weak( max, micros, std::memory_order_relaxed ) )
+			;
+	}
+
+	double LatencyHistogram::getMeanSeconds() const
+	{
+		const uint64_t count = getCount();
+		return count ? mTotalMicros.load( std::memory_order_relaxed ) * 1e-6 / count : 0;
+	}
+
+	double LatencyHistogram::getBucketUpperSeconds( size_t bucket )
+	{
+		return double( uint64_t( 1 ) << bucket ) * 1e-6;
+	}
+
+	double LatencyHistogram::getPercentileSeconds( double percentile ) const
+	{
+		// Buckets are read one by one while other threads may record, so sum them rather than trusting mCount
+		uint64_t counts[kNumBuckets], total = 0;
+		for( size_t i = 0; i < kNumBuckets; ++i ) {
+			counts[i] = getBucketCount( i );
+			total += counts[i];
+		}
+		if( total == 0 )
+			return 0;
+
+		const uint64_t rank = uint64_t( percentile * ( total - 1 ) );
+		uint64_t seen = 0;
+		for( size_t i = 0; i < kNumBuckets; ++i ) {
+			seen += counts[i];
+			if( seen > rank )
+				return getBucketUpperSeconds( i );
+		}
+		return getBucketUpperSeconds( kNumBuckets - 1 );
+	}
+
+	PlaybackStats::PlaybackStats()
+	: mNumDecoded( 0 ), mNumUploaded( 0 ), mNumPresented( 0 ), mNumDropped( 0 ), mFramerate( 0 ),
+	  mFpsLastSampleFrame( 0 ), mFpsLastSampleTime( 0 )
+	{
+	}
+
+	void PlaybackStats::framePresented( double time, double sampleInterval )
+	{
+		const uint64_t presented = mNumPresented.fetch_add( 1, std::memory_order_relaxed );
+		if( time > mFpsLastSampleTime + sampleInterval ) {
+			// Average over the sample interval
+			mFramerate.store( float( ( presented - mFpsLastSampleFrame ) / ( time - mFpsLastSampleTime ) ), std::memory_order_relaxed );
+			mFpsLastSampleTime = time;
+			mFpsLastSampleFrame = presented;
+		}
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,82 @@
+/*
+ *  HapPlaybackStats.h
+ *
+ *  Per-movie frame counters, per-stage latency histograms and rolling framerate, updated without locks.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder { namespace hap {
+
+	//! Histogram of durations in power-of-two microsecond buckets. record() and the getters may run concurrently on any threads.
+	class LatencyHistogram {
+	public:
+		//! Bucket 0 holds durations under 1us, bucket i holds [2^(i-1), 2^i) us, the last one everything above.
+		static const size_t kNumBuckets = 24;
+
+		LatencyHistogram();
+
+		void		record( double seconds );
+
+		uint64_t	getCount() const { return mCount.load( std::memory_order_relaxed ); }
+		double		getMeanSeconds() const;
+		double		getMaxSeconds() const { return mMaxMicros.load( std::memory_order_relaxed ) * 1e-6; }
+		uint64_t	getBucketCount( size_t bucket ) const { return mBuckets[bucket].load( std::memory_order_relaxed ); }
+		//! Returns the exclusive upper bound of \a bucket, in seconds.
+		static double	getBucketUpperSeconds( size_t bucket );
+		//! Returns the upper bound of the bucket holding the \a percentile (in [0, 1]) sample, in seconds.
+		double		getPercentileSeconds( double percentile ) const;
+
+	private:
+		std::atomic<uint64_t>	mBuckets[kNumBuckets];
+		std::atomic<uint64_t>	mCount, mTotalMicros, mMaxMicros;
+	};
+
+	class PlaybackStats {
+	public:
+		enum Stage {
+			//! Reading the compressed sample from the movie source.
+			STAGE_READ,
+			//! Second-stage (Snappy) decompression of the sample.
+			STAGE_DECOMPRESS,
+			//! Submitting the DXT data to the texture.
+			STAGE_UPLOAD,
+			NUM_STAGES
+		};
+
+		PlaybackStats();
+
+		void		frameDecoded() { mNumDecoded.fetch_add( 1, std::memory_order_relaxed ); }
+		void		frameUploaded() { mNumUploaded.fetch_add( 1, std::memory_order_relaxed ); }
+		void		framesDropped( uint64_t count ) { mNumDropped.fetch_add( count, std::memory_order_relaxed ); }
+		//! Counts a new frame reaching the render thread at \a time seconds, and updates the framerate every \a sampleInterval seconds.
+		//! Must only be called from one thread.
+		void		framePresented( double time, double sampleInterval );
+		void		recordLatency( Stage stage, double seconds ) { mLatencies[stage].record( seconds ); }
+
+		uint64_t	getNumDecoded() const { return mNumDecoded.load( std::memory_order_relaxed ); }
+		uint64_t	getNumUploaded() const { return mNumUploaded.load( std::memory_order_relaxed ); }
+		uint64_t	getNumPresented() const { return mNumPresented.load( std::memory_order_relaxed ); }
+		//! Frames skipped because playback outran decoding, or replaced before the render thread picked them up.
+		uint64_t	getNumDropped() const { return mNumDropped.load( std::memory_order_relaxed ); }
+		//! Presented frames per second over the last sample interval.
+		float		getFramerate() const { return mFramerate.load( std::memory_order_relaxed ); }
+
+		const LatencyHistogram&	getLatency( Stage stage ) const { return mLatencies[stage]; }
+
+	private:
+		std::atomic<uint64_t>	mNumDecoded, mNumUploaded, mNumPresented, mNumDropped;
+		std::atomic<float>		mFramerate;
+		LatencyHistogram		mLatencies[NUM_STAGES];
+
+		// Owned by the thread calling framePresented()
+		uint64_t				mFpsLastSampleFrame;
+		double					mFpsLastSampleTime;
+	};
+
+} } // namespace cinder::hap
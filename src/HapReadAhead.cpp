@@ -0,0 +1,395 @@
+/*
+ *  HapReadAhead.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapReadAhead.h"
+
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined( HAP_USE_IO_URING )
+	#include <liburing.h>
+#endif
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		typedef std::chrono::steady_clock Clock;
+
+		double secondsSince( Clock::time_point start )
+		{
+			return std::chrono::duration<double>( Clock::now() - start ).count();
+		}
+
+		// Reads submitted to io_uring at once
+		const size_t kIoUringDepth = 8;
+
+		// States of ReadAhead::mQueued entries, 0 meaning neither
+		const uint8_t kInFlight = 1;
+		const uint8_t kFailed = 2;
+
+	} // anonymous namespace
+
+	ReadAhead::ReadAhead( const SampleTableRef &sampleTable, double windowSeconds )
+	: mSampleTable( sampleTable ), mSource( sampleTable->getSource() ), mWindowSeconds( windowSeconds ), mMaxReadSize( 4 * 1024 * 1024 ),
+	  mUseIoUring( false ), mResident( sampleTable->getNumSamples() ), mQueued( sampleTable->getNumSamples(), 0 ), mPlayhead( 0 ), mRate( 1.0 ),
+	  mResidentBegin( 0 ), mResidentEnd( 0 ), mQuit( false ), mRing( nullptr ), mFd( -1 )
+	{
+#if defined( HAP_USE_IO_URING )
+		// Mapped sources are paged in by touching them, only plain files go through the ring
+		if( auto file = std::dynamic_pointer_cast<MovieSourceFile>( mSource ) ) {
+			mRing = new io_uring;
+			if( ::io_uring_queue_init( kIoUringDepth, mRing, 0 ) == 0 ) {
+				mFd = file->getFileDescriptor();
+				mUseIoUring = true;
+			}
+			else {
+				CI_LOG_W( "HAP WARNING :: io_uring unavailable, reading ahead one sample run at a time." );
+				delete mRing;
+				mRing = nullptr;
+			}
+		}
+#endif
+		// Unbuffered reads land in aligned buffers recycled from a pool holding a full window, each large enough for the
+		// biggest sample or the biggest coalesced read
+		const size_t alignment = mSource->getReadAlignment();
+		if( alignment > 1 ) {
+			const size_t bufferSize = std::max<size_t>( mSampleTable->getMaxSampleSize(), mMaxReadSize ) + 2 * alignment;
+			const size_t numBuffers = (size_t)std::ceil( mWindowSeconds * mSampleTable->getFramerate() ) + kIoUringDepth + 2;
+			mBufferPool = BufferPool::create( bufferSize, numBuffers, alignment );
+		}
+
+		mThread = std::thread( &ReadAhead::threadLoop, this );
+	}
+
+	ReadAhead::~ReadAhead()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mQuit = true;
+		}
+		mWake.notify_all();
+		mThread.join();
+
+#if defined( HAP_USE_IO_URING )
+		if( mRing ) {
+			::io_uring_queue_exit( mRing );
+			delete mRing;
+		}
+#endif
+	}
+
+	void ReadAhead::setWindowSeconds( double seconds )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			mWindowSeconds = seconds;
+		}
+		mWake.notify_all();
+	}
+
+	void ReadAhead::setMaxReadSize( size_t size )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		mMaxReadSize = std::max<size_t>( size, 1 );
+	}
+
+	void ReadAhead::getWindow( size_t *begin, size_t *end ) const
+	{
+		// Faster playback goes through more samples in the same time
+		const double seconds = mWindowSeconds * std::max( std::abs( mRate ), 1.0 );
+		const size_t numFrames = std::max<size_t>( (size_t)std::ceil( seconds * mSampleTable->getFramerate() ), 1 );
+		if( mRate < 0 ) {
+			*begin = mPlayhead > numFrames ? mPlayhead - numFrames : 0;
+			*end = std::min( mPlayhead + 1, mResident.size() );
+		}
+		else {
+			*begin = mPlayhead;
+			*end = std::min( mPlayhead + numFrames + 1, mResident.size() );
+		}
+	}
+
+	void ReadAhead::setPlayhead( size_t index, double rate )
+	{
+		{
+			std::lock_guard<std::mutex> lock( mMutex );
+			if( ( index == mPlayhead && rate == mRate ) || index >= mResident.size() )
+				return;
+
+			size_t oldBegin, oldEnd, windowBegin, windowEnd;
+			getWindow( &oldBegin, &oldEnd );
+			mPlayhead = index;
+			mRate = rate;
+			getWindow( &windowBegin, &windowEnd );
+
+			// Samples that failed to read are retried once they leave the window and come back into it, not on every move
+			for( size_t i = windowBegin; i < windowEnd; ++i ) {
+				if( ( i < oldBegin || i >= oldEnd ) && mQueued[i] == kFailed )
+					mQueued[i] = 0;
+			}
+
+			// Release whatever fell out of the window, blocks go once none of their samples is resident or held
+			for( size_t i = mResidentBegin; i < mResidentEnd; ++i ) {
+				if( i < windowBegin || i >= windowEnd )
+					mResident[i].reset();
+			}
+			mResidentBegin = std::max( mResidentBegin, windowBegin );
+			mResidentEnd = std::min( mResidentEnd, windowEnd );
+			if( mResidentBegin >= mResidentEnd )
+				mResidentBegin = mResidentEnd = mPlayhead;
+		}
+		mWake.notify_all();
+	}
+
+	std::shared_ptr<const uint8_t> ReadAhead::getSample( size_t index )
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		if( index >= mResident.size() || ! mResident[index] ) {
+			++mStats.mNumMisses;
+			return nullptr;
+		}
+
+		++mStats.mNumHits;
+		const BlockRef &block = mResident[index];
+		return std::shared_ptr<const uint8_t>( block, block->mData + ( mSampleTable->getSample( index ).mOffset - block->mOffset ) );
+	}
+
+	ReadAheadStats ReadAhead::getStats() const
+	{
+		std::lock_guard<std::mutex> lock( mMutex );
+		ReadAheadStats stats = mStats;
+		size_t windowBegin, windowEnd;
+		getWindow( &windowBegin, &windowEnd );
+		for( size_t i = windowBegin; i < windowEnd; ++i ) {
+			if( ! mResident[i] )
+				++stats.mQueueDepth;
+		}
+		return stats;
+	}
+
+	void ReadAhead::collectRequests( size_t maxRequests, std::vector<Request> *requests )
+	{
+		const SampleTable::Sample *samples = mSampleTable->getSamples();
+		size_t windowBegin, windowEnd;
+		getWindow( &windowBegin, &windowEnd );
+		auto isMissing = [&]( size_t i ) { return ! mResident[i] && ! mQueued[i]; };
+
+		// Samples are requested in the order they will play, nearest the playhead first
+		const bool reverse = mRate < 0;
+		for( size_t n = 0; n < windowEnd - windowBegin && requests->size() < maxRequests; ++n ) {
+			const size_t i = reverse ? windowEnd - 1 - n : windowBegin + n;
+			if( ! isMissing( i ) )
+				continue;
+
+			// Extend the read over the samples that play next as long as they sit right next to each other in the file
+			Request request;
+			request.mFirst = request.mLast = i;
+			request.mOffset = samples[i].mOffset;
+			request.mSize = samples[i].mSize;
+			if( reverse ) {
+				while( request.mFirst > windowBegin ) {
+					const SampleTable::Sample &previous = samples[request.mFirst - 1];
+					if( ! isMissing( request.mFirst - 1 ) || previous.mOffset + previous.mSize != request.mOffset || request.mSize + previous.mSize > mMaxReadSize )
+						break;
+					request.mOffset = previous.mOffset;
+					request.mSize += previous.mSize;
+					--request.mFirst;
+				}
+			}
+			else {
+				while( request.mLast + 1 < windowEnd ) {
+					const SampleTable::Sample &next = samples[request.mLast + 1];
+					if( ! isMissing( request.mLast + 1 ) || next.mOffset != request.mOffset + request.mSize || request.mSize + next.mSize > mMaxReadSize )
+						break;
+					request.mSize += next.mSize;
+					++request.mLast;
+				}
+			}
+
+			for( size_t j = request.mFirst; j <= request.mLast; ++j )
+				mQueued[j] = kInFlight;
+			requests->push_back( request );
+			n += request.mLast - request.mFirst;
+		}
+	}
+
+	void ReadAhead::performRead( Request *request )
+	{
+		const Clock::time_point start = Clock::now();
+
+		const uint8_t *mapped = mSource->getPointer( request->mOffset, request->mSize );
+		if( mapped && request->mSize > 0 ) {
+			// Touch every page so the playback path never faults on storage
+			volatile uint8_t sum = 0;
+			for( size_t i = 0; i < request->mSize; i += 4096 )
+				sum += mapped[i];
+			sum += mapped[request->mSize - 1];
+			request->mBlock = std::make_shared<Block>();
+			request->mBlock->mOffset = request->mOffset;
+			request->mBlock->mData = mapped;
+			request->mSucceeded = true;
+		}
+		else {
+			uint8_t *target = allocateBlock( request );
+			request->mSucceeded = isComplete( *request, mSource->read( request->mReadOffset, target, request->mReadSize ) );
+		}
+
+		mReadLatency.record( secondsSince( start ) );
+	}
+
+	uint8_t* ReadAhead::allocateBlock( Request *request )
+	{
+		// Unbuffered sources need whole aligned blocks, the samples then start somewhere inside the first one
+		const uint64_t mask = mSource->getReadAlignment() - 1;
+		request->mReadOffset = request->mOffset & ~mask;
+		request->mReadSize = (size_t)( ( ( request->mOffset + request->mSize + mask ) & ~mask ) - request->mReadOffset );
+
+		BlockRef block = std::make_shared<Block>();
+		block->mOffset = request->mOffset;
+		uint8_t *target;
+		if( mBufferPool ) {
+			block->mAligned = mBufferPool->acquire( request->mReadSize );
+			target = block->mAligned.get();
+		}
+		else {
+			block->mBuffer.resize( request->mReadSize );
+			target = block->mBuffer.data();
+		}
+		block->mData = target + ( request->mOffset - request->mReadOffset );
+		request->mBlock = block;
+		return target;
+	}
+
+	bool ReadAhead::isComplete( const Request &request, size_t bytesRead ) const
+	{
+		// Aligned reads at the end of the file come back short of mReadSize but may still cover every sample
+		return bytesRead >= request.mOffset - request.mReadOffset + request.mSize;
+	}
+
+	void ReadAhead::performReadsIoUring( std::vector<Request> *requests )
+	{
+#if defined( HAP_USE_IO_URING )
+		// The whole batch is in flight at once, so the device sees a queue instead of one read at a time
+		const Clock::time_point start = Clock::now();
+		size_t numSubmitted = 0;
+		for( auto &request : *requests ) {
+			io_uring_sqe *sqe = ::io_uring_get_sqe( mRing );
+			if( ! sqe )
+				break;
+			uint8_t *target = allocateBlock( &request );
+			::io_uring_prep_read( sqe, mFd, target, (unsigned)request.mReadSize, request.mReadOffset );
+			::io_uring_sqe_set_data( sqe, &request );
+			++numSubmitted;
+		}
+		::io_uring_submit( mRing );
+
+		// Every submitted read must complete or be cancelled before its block or request may go, the kernel writes into both
+		std::vector<bool> pending( numSubmitted, true );
+		size_t numPending = numSubmitted;
+		bool cancelled = false;
+		while( numPending > 0 ) {
+			io_uring_cqe *cqe;
+			const int result = ::io_uring_wait_cqe( mRing, &cqe );
+			if( result == -EINTR )
+				continue;
+			if( result < 0 && ! cancelled ) {
+				for( size_t i = 0; i < numSubmitted; ++i ) {
+					io_uring_sqe *sqe = pending[i] ? ::io_uring_get_sqe( mRing ) : nullptr;
+					if( sqe ) {
+						::io_uring_prep_cancel( sqe, &(*requests)[i], 0 );
+						::io_uring_sqe_set_data( sqe, nullptr );
+					}
+				}
+				::io_uring_submit( mRing );
+				cancelled = true;
+				continue;
+			}
+			if( result < 0 ) {
+				// Reads may still land in their blocks, which stay alive with the ring while reads go the plain way from now on
+				CI_LOG_E( "HAP ERROR :: io_uring failed with reads in flight, falling back to plain reads: " << std::strerror( -result ) );
+				for( size_t i = 0; i < numSubmitted; ++i ) {
+					if( pending[i] ) {
+						mAbandonedBlocks.push_back( (*requests)[i].mBlock );
+						(*requests)[i].mBlock.reset();
+					}
+				}
+				mUseIoUring = false;
+				break;
+			}
+
+			// Cancellations complete too, without a request
+			Request *request = (Request*)::io_uring_cqe_get_data( cqe );
+			if( request ) {
+				request->mSucceeded = cqe->res >= 0 && isComplete( *request, (size_t)cqe->res );
+				pending[request - requests->data()] = false;
+				--numPending;
+				mReadLatency.record( secondsSince( start ) );
+			}
+			::io_uring_cqe_seen( mRing, cqe );
+		}
+
+		// Short or failed reads, and whatever didn't fit in the ring, are retried the plain way
+		for( auto &request : *requests ) {
+			if( ! request.mSucceeded )
+				performRead( &request );
+		}
+#else
+		for( auto &request : *requests )
+			performRead( &request );
+#endif
+	}
+
+	void ReadAhead::threadLoop()
+	{
+		std::vector<Request> requests;
+		while( true ) {
+			{
+				std::unique_lock<std::mutex> lock( mMutex );
+				mWake.wait( lock, [&] {
+					if( mQuit )
+						return true;
+					requests.clear();
+					collectRequests( mUseIoUring ? kIoUringDepth : 1, &requests );
+					return ! requests.empty();
+				} );
+				if( mQuit )
+					return;
+			}
+
+			if( mUseIoUring )
+				performReadsIoUring( &requests );
+			else
+				performRead( &requests.front() );
+
+			std::lock_guard<std::mutex> lock( mMutex );
+			// The playhead may have moved meanwhile, only keep what is still inside the window
+			size_t windowBegin, windowEnd;
+			getWindow( &windowBegin, &windowEnd );
+			for( auto &request : requests ) {
+				++mStats.mNumReads;
+				for( size_t i = request.mFirst; i <= request.mLast; ++i ) {
+					mQueued[i] = request.mSucceeded ? 0 : kFailed;
+					if( request.mSucceeded && i >= windowBegin && i < windowEnd ) {
+						mResident[i] = request.mBlock;
+						if( mResidentBegin == mResidentEnd )
+							mResidentBegin = mResidentEnd = i;
+						mResidentBegin = std::min( mResidentBegin, i );
+						mResidentEnd = std::max( mResidentEnd, i + 1 );
+					}
+				}
+				if( request.mSucceeded )
+					mStats.mBytesRead += request.mSize;
+			}
+		}
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,135 @@
+/*
+ *  HapReadAhead.h
+ *
+ *  Background reader keeping the compressed samples of the next few hundred milliseconds resident,
+ *  so slow storage doesn't stall the playback path.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapBufferPool.h"
+#include "HapPlaybackStats.h"
+#include "HapSampleTable.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct io_uring;
+
+namespace cinder { namespace hap {
+
+	struct ReadAheadStats {
+		ReadAheadStats() : mQueueDepth( 0 ), mNumHits( 0 ), mNumMisses( 0 ), mNumReads( 0 ), mBytesRead( 0 ) {}
+
+		//! Samples inside the window that aren't resident yet.
+		size_t		mQueueDepth;
+		//! Calls to getSample() that found the sample resident, and those that didn't.
+		uint64_t	mNumHits, mNumMisses;
+		//! Reads issued, each covering one or more adjacent samples.
+		uint64_t	mNumReads;
+		uint64_t	mBytesRead;
+	};
+
+	typedef std::shared_ptr<class ReadAhead> ReadAheadRef;
+
+	class ReadAhead {
+	public:
+		//! Starts reading the samples of \a sampleTable that play within \a windowSeconds after the playhead, in the direction of play.
+		static ReadAheadRef create( const SampleTableRef &sampleTable, double windowSeconds = 0.5 ) { return ReadAheadRef( new ReadAhead( sampleTable, windowSeconds ) ); }
+		~ReadAhead();
+
+		void		setWindowSeconds( double seconds );
+		double		getWindowSeconds() const { return mWindowSeconds; }
+		//! Caps how many bytes of adjacent samples are merged into one read. Defaults to 4 MiB.
+		void		setMaxReadSize( size_t size );
+
+		//! Moves the window to start at sample \a index, releasing the samples that fell out of it. The window extends behind
+		//! \a index for a negative \a rate, and covers |\a rate| times more samples above normal speed.
+		void		setPlayhead( size_t index, double rate = 1.0 );
+		//! Returns sample \a index if it is resident, otherwise null and the caller reads it itself.
+		//! The data stays valid for as long as the returned pointer is held.
+		std::shared_ptr<const uint8_t>	getSample( size_t index );
+
+		ReadAheadStats			getStats() const;
+		//! Latency of each read issued, whatever the number of samples it covered.
+		const LatencyHistogram&	getReadLatency() const { return mReadLatency; }
+		//! Returns true if reads are issued through io_uring rather than one at a time.
+		bool					isUsingIoUring() const { return mUseIoUring; }
+
+	protected:
+		ReadAhead( const SampleTableRef &sampleTable, double windowSeconds );
+
+		//! Bytes of one or more adjacent samples, read at once.
+		struct Block {
+			Block() : mOffset( 0 ), mData( nullptr ) {}
+
+			//! Position of the first byte in the source.
+			uint64_t				mOffset;
+			std::vector<uint8_t>	mBuffer;
+			//! Pooled instead of mBuffer for unbuffered sources.
+			std::shared_ptr<uint8_t>	mAligned;
+			//! Points into mBuffer or mAligned, or into the source itself when it is mapped.
+			const uint8_t			*mData;
+		};
+		typedef std::shared_ptr<Block> BlockRef;
+
+		//! One pending read of samples [mFirst, mLast].
+		struct Request {
+			Request() : mFirst( 0 ), mLast( 0 ), mOffset( 0 ), mSize( 0 ), mReadOffset( 0 ), mReadSize( 0 ), mSucceeded( false ) {}
+
+			size_t		mFirst, mLast;
+			uint64_t	mOffset;
+			size_t		mSize;
+			//! The range actually read, widened to the source's alignment.
+			uint64_t	mReadOffset;
+			size_t		mReadSize;
+			BlockRef	mBlock;
+			bool		mSucceeded;
+		};
+
+		void		threadLoop();
+		//! Collects up to \a maxRequests coalesced reads of missing samples inside the window. Called with mMutex locked.
+		void		collectRequests( size_t maxRequests, std::vector<Request> *requests );
+		void		performRead( Request *request );
+		//! Creates the block of \a request and returns where its read must land.
+		uint8_t*	allocateBlock( Request *request );
+		bool		isComplete( const Request &request, size_t bytesRead ) const;
+		void		performReadsIoUring( std::vector<Request> *requests );
+		//! Returns the samples [begin, end) inside the window. Called with mMutex locked.
+		void		getWindow( size_t *begin, size_t *end ) const;
+
+		SampleTableRef			mSampleTable;
+		MovieSourceRef			mSource;
+		double					mWindowSeconds;
+		size_t					mMaxReadSize;
+		std::atomic<bool>		mUseIoUring;
+		BufferPoolRef			mBufferPool;
+
+		std::vector<BlockRef>	mResident;
+		//! Samples being read, or whose read failed
+		std::vector<uint8_t>	mQueued;
+		size_t					mPlayhead;
+		double					mRate;
+		//! Resident samples all lie in [mResidentBegin, mResidentEnd)
+		size_t					mResidentBegin, mResidentEnd;
+
+		mutable std::mutex		mMutex;
+		std::condition_variable	mWake;
+		std::thread				mThread;
+		bool					mQuit;
+
+		ReadAheadStats			mStats;
+		LatencyHistogram		mReadLatency;
+
+		// Only used with HAP_USE_IO_URING
+		::io_uring				*mRing;
+		int						mFd;
+		//! Blocks of reads io_uring never reported back, kept until the ring is torn down.
+		std::vector<BlockRef>	mAbandonedBlocks;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,690 @@
+/*
+ *  HapSampleTable.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapSampleTable.h"
+#include "HapThreadPool.h"
+
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		inline uint16_t readU16( const uint8_t *p ) { return uint16_t( ( p[0] << 8 ) | p[1] ); }
+		inline uint32_t readU32( const uint8_t *p ) { return ( uint32_t( p[0] ) << 24 ) | ( uint32_t( p[1] ) << 16 ) | ( uint32_t( p[2] ) << 8 ) | uint32_t( p[3] ); }
+		inline uint64_t readU64( const uint8_t *p ) { return ( uint64_t( readU32( p ) ) << 32 ) | readU32( p + 4 ); }
+
+		//! Iterates the child atoms of an in-memory container atom.
+		class AtomIterator {
+		public:
+			AtomIterator( const uint8_t *data, size_t size )
+			: mData( data ), mEnd( data + size ), mType( 0 ), mBody( nullptr ), mBodySize( 0 )
+			{}
+
+			bool next()
+			{
+				if( mEnd - mData < 8 )
+					return false;
+				uint64_t size = readU32( mData );
+				mType = readU32( mData + 4 );
+				size_t headerSize = 8;
+				if( size == 1 ) {
+					if( mEnd - mData < 16 )
+						throw SampleTableExc( "Truncated 64-bit atom header" );
+					size = readU64( mData + 8 );
+					headerSize = 16;
+				}
+				else if( size == 0 ) {
+					size = mEnd - mData;
+				}
+				if( size < headerSize || size > (uint64_t)( mEnd - mData ) )
+					throw SampleTableExc( "Atom size out of bounds" );
+
+				mBody = mData + headerSize;
+				mBodySize = (size_t)size - headerSize;
+				mData += size;
+				return true;
+			}
+
+			uint32_t		getType() const { return mType; }
+			const uint8_t*	getBody() const { return mBody; }
+			size_t			getBodySize() const { return mBodySize; }
+
+		private:
+			const uint8_t	*mData, *mEnd;
+			uint32_t		mType;
+			const uint8_t	*mBody;
+			size_t			mBodySize;
+		};
+
+		//! Validates that a full-atom table with \a count entries of \a entrySize bytes fits after a \a headerSize byte header.
+		void checkTable( size_t bodySize, size_t headerSize, uint64_t count, size_t entrySize, const char *name )
+		{
+			if( bodySize < headerSize || count > ( bodySize - headerSize ) / entrySize )
+				throw SampleTableExc( std::string( "Truncated " ) + name + " atom" );
+		}
+
+		const uint32_t kAtomMoov = makeFourCC( "moov" );
+		const uint32_t kAtomTrak = makeFourCC( "trak" );
+		const uint32_t kAtomMdia = makeFourCC( "mdia" );
+		const uint32_t kAtomMdhd = makeFourCC( "mdhd" );
+		const uint32_t kAtomHdlr = makeFourCC( "hdlr" );
+		const uint32_t kAtomMinf = makeFourCC( "minf" );
+		const uint32_t kAtomStbl = makeFourCC( "stbl" );
+		const uint32_t kAtomStsd = makeFourCC( "stsd" );
+		const uint32_t kAtomStts = makeFourCC( "stts" );
+		const uint32_t kAtomStsc = makeFourCC( "stsc" );
+		const uint32_t kAtomStsz = makeFourCC( "stsz" );
+		const uint32_t kAtomStco = makeFourCC( "stco" );
+		const uint32_t kAtomCo64 = makeFourCC( "co64" );
+		const uint32_t kAtomCmov = makeFourCC( "cmov" );
+		const uint32_t kHandlerVideo = makeFourCC( "vide" );
+
+		// Sidecar index layout, in native byte order: an IndexHeader, the samples, then the time buckets
+		const char		kIndexMagic[8] = { 'H', 'A', 'P', 'I', 'N', 'D', 'E', 'X' };
+		const uint32_t	kIndexVersion = 2;
+		const uint32_t	kIndexByteOrder = 0x01020304;
+		// Bytes hashed at each end of the movie atom, so validating an index costs the same for any movie length
+		const size_t	kMoovHashSpan = 64 * 1024;
+
+		struct IndexHeader {
+			char		mMagic[8];
+			uint32_t	mVersion, mByteOrder;
+			uint64_t	mFileSize;
+			int64_t		mModified;
+			uint64_t	mMoovOffset, mMoovSize, mMoovHash;
+			uint32_t	mCodecType;
+			int32_t		mWidth, mHeight;
+			uint32_t	mTimeScale;
+			int64_t		mDuration;
+			uint32_t	mMaxSampleSize, mSampleDuration;
+			int64_t		mBucketDuration;
+			uint64_t	mNumSamples, mNumBuckets;
+		};
+		static_assert( sizeof( IndexHeader ) % 8 == 0, "Samples following the index header must stay 8-byte aligned" );
+
+		std::mutex		sIndexWriterMutex;
+		ThreadPoolRef	sIndexWriterPool;
+
+		//! Returns the single background thread sidecar indexes are written on, created on first use.
+		ThreadPoolRef getIndexWriterPool()
+		{
+			std::lock_guard<std::mutex> lock( sIndexWriterMutex );
+			if( ! sIndexWriterPool )
+				sIndexWriterPool = ThreadPool::create( ThreadPool::Options().numThreads( 1 ).background() );
+			return sIndexWriterPool;
+		}
+
+		//! 64-bit FNV-1a.
+		uint64_t hashBytes( const uint8_t *data, size_t size, uint64_t hash )
+		{
+			for( size_t i = 0; i < size; ++i )
+				hash = ( hash ^ data[i] ) * 0x100000001b3ULL;
+			return hash;
+		}
+
+		//! Hashes the size of the movie atom body at \a offset and up to kMoovHashSpan bytes at each of its ends.
+		uint64_t hashMovieAtom( const MovieSourceRef &source, uint64_t offset, uint64_t size )
+		{
+			uint8_t sizeBytes[8];
+			std::memcpy( sizeBytes, &size, 8 );
+			uint64_t hash = hashBytes( sizeBytes, 8, 0xcbf29ce484222325ULL );
+
+			std::vector<uint8_t> span( (size_t)std::min<uint64_t>( size, kMoovHashSpan ) );
+			hash = hashBytes( span.data(), source->read( offset, span.data(), span.size() ), hash );
+			if( size > kMoovHashSpan ) {
+				span.resize( (size_t)std::min<uint64_t>( size - kMoovHashSpan, kMoovHashSpan ) );
+				hash = hashBytes( span.data(), source->read( offset + size - span.size(), span.data(), span.size() ), hash );
+			}
+			return hash;
+		}
+
+		bool getFileStatus( const fs::path &path, uint64_t *size, int64_t *modified )
+		{
+#if defined( CINDER_MSW )
+			struct _stat64 status;
+			if( ::_wstat64( path.wstring().c_str(), &status ) != 0 )
+				return false;
+			*modified = (int64_t)status.st_mtime * 1000000000;
+#else
+			struct stat status;
+			if( ::stat( path.string().c_str(), &status ) != 0 )
+				return false;
+	#if defined( CINDER_MAC )
+			*modified = (int64_t)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+	#else
+			*modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+	#endif
+#endif
+			*size = (uint64_t)status.st_size;
+			return true;
+		}
+
+	} // anonymous namespace
+
+	// Samples are stored in sidecar indices as laid out in memory
+	static_assert( sizeof( SampleTable::Sample ) == 24, "SampleTable::Sample must not have padding" );
+
+	struct SampleTable::Track {
+		Track() : mIsVideo( false ), mCodecType( CODEC_UNKNOWN ), mWidth( 0 ), mHeight( 0 ), mTimeScale( 0 ), mDuration( 0 ),
+			mStts( nullptr ), mSttsSize( 0 ), mStsc( nullptr ), mStscSize( 0 ), mStsz( nullptr ), mStszSize( 0 ),
+			mStco( nullptr ), mStcoSize( 0 ), mIs64BitOffsets( false ) {}
+
+		bool			mIsVideo;
+		uint32_t		mCodecType;
+		int32_t			mWidth, mHeight;
+		uint32_t		mTimeScale;
+		int64_t			mDuration;
+
+		// Raw table atoms, pointing into the moov buffer which outlives the Track
+		const uint8_t	*mStts;	size_t mSttsSize;
+		const uint8_t	*mStsc;	size_t mStscSize;
+		const uint8_t	*mStsz;	size_t mStszSize;
+		const uint8_t	*mStco;	size_t mStcoSize;
+		bool			mIs64BitOffsets;
+	};
+
+	SampleTable::SampleTable( const MovieSourceRef &source )
+	: mSource( source ), mCodecType( CODEC_UNKNOWN ), mWidth( 0 ), mHeight( 0 ), mTimeScale( 0 ), mDuration( 0 ),
+	  mMaxSampleSize( 0 ), mMoovOffset( 0 ), mMoovSize( 0 ), mSampleData( nullptr ), mNumSamples( 0 ), mBucketData( nullptr ),
+	  mNumBuckets( 0 ), mSampleDuration( 0 ), mBucketDuration( 0 )
+	{
+	}
+
+	SampleTableRef SampleTable::create( const MovieSourceRef &source )
+	{
+		SampleTableRef table( new SampleTable( source ) );
+		table->parse();
+		return table;
+	}
+
+	bool SampleTable::findMovieAtom()
+	{
+		// Walk the top-level atoms, only reading headers, until we find the movie atom. mdat is never touched.
+		const uint64_t fileSize = mSource->getSize();
+		uint64_t offset = 0;
+		while( offset + 8 <= fileSize ) {
+			uint8_t header[16];
+			size_t headerRead = mSource->read( offset, header, (size_t)std::min<uint64_t>( 16, fileSize - offset ) );
+			if( headerRead < 8 )
+				break;
+
+			uint64_t size = readU32( header );
+			uint32_t type = readU32( header + 4 );
+			uint64_t headerSize = 8;
+			if( size == 1 ) {
+				if( headerRead < 16 )
+					break;
+				size = readU64( header + 8 );
+				headerSize = 16;
+			}
+			else if( size == 0 ) {
+				size = fileSize - offset;
+			}
+			if( size < headerSize || size > fileSize - offset )
+				throw SampleTableExc( "Top-level atom size out of bounds" );
+
+			if( type == kAtomMoov ) {
+				mMoovOffset = offset + headerSize;
+				mMoovSize = size - headerSize;
+				return true;
+			}
+			offset += size;
+		}
+		return false;
+	}
+
+	void SampleTable::parse()
+	{
+		if( ! findMovieAtom() )
+			throw SampleTableExc( "No movie atom found" );
+
+		std::vector<uint8_t> moov( (size_t)mMoovSize );
+		if( mSource->read( mMoovOffset, moov.data(), moov.size() ) != moov.size() )
+			throw SampleTableExc( "Unable to read movie atom" );
+		parseMovie( moov.data(), moov.size() );
+	}
+
+	void SampleTable::parseMovie( const uint8_t *data, size_t size )
+	{
+		Track selected;
+		AtomIterator it( data, size );
+		while( it.next() ) {
+			if( it.getType() == kAtomCmov )
+				throw SampleTableExc( "Compressed movie atoms are not supported" );
+			if( it.getType() != kAtomTrak )
+				continue;
+
+			Track track;
+			if( ! parseTrack( it.getBody(), it.getBodySize(), &track ) )
+				continue;
+			// Prefer the first Hap track, otherwise keep the first video track
+			if( ! selected.mIsVideo || ( isHapCodec( track.mCodecType ) && ! isHapCodec( selected.mCodecType ) ) )
+				selected = track;
+		}
+
+		if( ! selected.mIsVideo )
+			throw SampleTableExc( "No video track found" );
+
+		mCodecType = selected.mCodecType;
+		mWidth = selected.mWidth;
+		mHeight = selected.mHeight;
+		mTimeScale = selected.mTimeScale;
+		buildSamples( selected );
+		mDuration = std::max<int64_t>( selected.mDuration, mSamples.empty() ? 0 : mSamples.back().mTime + mSamples.back().mDuration );
+		buildTimeLookup();
+
+		mSampleData = mSamples.data();
+		mNumSamples = mSamples.size();
+		mBucketData = mTimeBuckets.data();
+		mNumBuckets = mTimeBuckets.size();
+	}
+
+	bool SampleTable::parseTrack( const uint8_t *data, size_t size, Track *track )
+	{
+		const uint8_t *mdia = nullptr;
+		size_t mdiaSize = 0;
+		AtomIterator trak( data, size );
+		while( trak.next() ) {
+			if( trak.getType() == kAtomMdia ) {
+				mdia = trak.getBody();
+				mdiaSize = trak.getBodySize();
+			}
+		}
+		if( ! mdia )
+			return false;
+
+		const uint8_t *stbl = nullptr;
+		size_t stblSize = 0;
+		AtomIterator media( mdia, mdiaSize );
+		while( media.next() ) {
+			const uint8_t *body = media.getBody();
+			size_t bodySize = media.getBodySize();
+			if( media.getType() == kAtomMdhd ) {
+				if( bodySize >= 4 && body[0] == 1 ) {
+					checkTable( bodySize, 32, 0, 1, "mdhd" );
+					track->mTimeScale = readU32( body + 20 );
+					track->mDuration = (int64_t)readU64( body + 24 );
+				}
+				else {
+					checkTable( bodySize, 20, 0, 1, "mdhd" );
+					track->mTimeScale = readU32( body + 12 );
+					track->mDuration = readU32( body + 16 );
+				}
+			}
+			else if( media.getType() == kAtomHdlr ) {
+				// QuickTime stores 'mhlr' in the component type and MP4 a zero, the subtype is at the same place in both
+				checkTable( bodySize, 12, 0, 1, "hdlr" );
+				track->mIsVideo = readU32( body + 8 ) == kHandlerVideo;
+			}
+			else if( media.getType() == kAtomMinf ) {
+				AtomIterator minf( body, bodySize );
+				while( minf.next() ) {
+					if( minf.getType() == kAtomStbl ) {
+						stbl = minf.getBody();
+						stblSize = minf.getBodySize();
+					}
+				}
+			}
+		}
+		if( ! track->mIsVideo || ! stbl )
+			return false;
+		if( track->mTimeScale == 0 )
+			throw SampleTableExc( "Video track has no time scale" );
+
+		AtomIterator tables( stbl, stblSize );
+		while( tables.next() ) {
+			const uint8_t *body = tables.getBody();
+			size_t bodySize = tables.getBodySize();
+			uint32_t type = tables.getType();
+			if( type == kAtomStsd ) {
+				// Only the first sample description is used; its visual sample entry carries the codec and dimensions
+				checkTable( bodySize, 8, 0, 1, "stsd" );
+				if( readU32( body + 4 ) > 0 ) {
+					checkTable( bodySize, 8 + 36, 0, 1, "stsd" );
+					track->mCodecType = readU32( body + 12 );
+					track->mWidth = readU16( body + 8 + 32 );
+					track->mHeight = readU16( body + 8 + 34 );
+				}
+			}
+			else if( type == kAtomStts ) {
+				track->mStts = body;
+				track->mSttsSize = bodySize;
+			}
+			else if( type == kAtomStsc ) {
+				track->mStsc = body;
+				track->mStscSize = bodySize;
+			}
+			else if( type == kAtomStsz ) {
+				track->mStsz = body;
+				track->mStszSize = bodySize;
+			}
+			else if( type == kAtomStco || type == kAtomCo64 ) {
+				track->mStco = body;
+				track->mStcoSize = bodySize;
+				track->mIs64BitOffsets = type == kAtomCo64;
+			}
+		}
+
+		if( ! track->mStts || ! track->mStsc || ! track->mStsz || ! track->mStco )
+			throw SampleTableExc( "Video track is missing a sample table atom" );
+		return true;
+	}
+
+	void SampleTable::buildSamples( const Track &track )
+	{
+		// stsz: sizes
+		checkTable( track.mStszSize, 12, 0, 1, "stsz" );
+		const uint32_t constantSize = readU32( track.mStsz + 4 );
+		const uint32_t numSamples = readU32( track.mStsz + 8 );
+		if( constantSize == 0 )
+			checkTable( track.mStszSize, 12, numSamples, 4, "stsz" );
+
+		mSamples.resize( numSamples );
+		for( uint32_t i = 0; i < numSamples; ++i ) {
+			mSamples[i].mSize = constantSize ? constantSize : readU32( track.mStsz + 12 + i * 4 );
+			mMaxSampleSize = std::max( mMaxSampleSize, mSamples[i].mSize );
+		}
+
+		// stts: durations and presentation times
+		checkTable( track.mSttsSize, 8, 0, 1, "stts" );
+		const uint32_t numTimeEntries = readU32( track.mStts + 4 );
+		checkTable( track.mSttsSize, 8, numTimeEntries, 8, "stts" );
+		{
+			uint32_t sample = 0;
+			int64_t time = 0;
+			uint32_t delta = 0;
+			for( uint32_t e = 0; e < numTimeEntries && sample < numSamples; ++e ) {
+				uint32_t count = readU32( track.mStts + 8 + e * 8 );
+				delta = readU32( track.mStts + 8 + e * 8 + 4 );
+				for( uint32_t c = 0; c < count && sample < numSamples; ++c, ++sample ) {
+					mSamples[sample].mTime = time;
+					mSamples[sample].mDuration = delta;
+					time += delta;
+				}
+			}
+			// Some writers omit the last entry, repeat the final duration
+			for( ; sample < numSamples; ++sample ) {
+				mSamples[sample].mTime = time;
+				mSamples[sample].mDuration = delta;
+				time += delta;
+			}
+		}
+
+		// stco / co64: chunk offsets
+		checkTable( track.mStcoSize, 8, 0, 1, "stco" );
+		const uint32_t numChunks = readU32( track.mStco + 4 );
+		const size_t offsetSize = track.mIs64BitOffsets ? 8 : 4;
+		checkTable( track.mStcoSize, 8, numChunks, offsetSize, "stco" );
+
+		// stsc: runs of chunks sharing a samples-per-chunk count
+		checkTable( track.mStscSize, 8, 0, 1, "stsc" );
+		const uint32_t numChunkRuns = readU32( track.mStsc + 4 );
+		checkTable( track.mStscSize, 8, numChunkRuns, 12, "stsc" );
+
+		uint32_t sample = 0;
+		for( uint32_t r = 0; r < numChunkRuns && sample < numSamples; ++r ) {
+			const uint8_t *run = track.mStsc + 8 + r * 12;
+			uint32_t firstChunk = readU32( run );
+			uint32_t samplesPerChunk = readU32( run + 4 );
+			uint32_t lastChunk = ( r + 1 < numChunkRuns ) ? readU32( run + 12 ) - 1 : numChunks;
+			if( firstChunk == 0 || lastChunk > numChunks )
+				throw SampleTableExc( "Invalid sample-to-chunk table" );
+
+			for( uint32_t chunk = firstChunk; chunk <= lastChunk && sample < numSamples; ++chunk ) {
+				const uint8_t *entry = track.mStco + 8 + ( chunk - 1 ) * offsetSize;
+				uint64_t offset = track.mIs64BitOffsets ? readU64( entry ) : readU32( entry );
+				for( uint32_t s = 0; s < samplesPerChunk && sample < numSamples; ++s, ++sample ) {
+					mSamples[sample].mOffset = offset;
+					offset += mSamples[sample].mSize;
+				}
+			}
+		}
+		if( sample != numSamples )
+			throw SampleTableExc( "Sample-to-chunk table does not cover every sample" );
+
+		// Keep what is playable from truncated files, ie. interrupted recordings
+		const uint64_t fileSize = mSource->getSize();
+		for( size_t i = 0; i < mSamples.size(); ++i ) {
+			if( mSamples[i].mOffset + mSamples[i].mSize > fileSize ) {
+				CI_LOG_W( "Sample " << i << " of " << mSamples.size() << " lies beyond the end of the file, truncating." );
+				mSamples.resize( i );
+				break;
+			}
+		}
+	}
+
+	void SampleTable::buildTimeLookup()
+	{
+		if( mSamples.empty() )
+			return;
+
+		bool isConstant = true;
+		uint32_t minDuration = 0;
+		for( const auto &sample : mSamples ) {
+			isConstant = isConstant && sample.mDuration == mSamples.front().mDuration;
+			if( sample.mDuration > 0 && ( minDuration == 0 || sample.mDuration < minDuration ) )
+				minDuration = sample.mDuration;
+		}
+		if( isConstant && minDuration > 0 ) {
+			mSampleDuration = minDuration;
+			return;
+		}
+
+		// A bucket is never longer than the shortest sample, so at most one sample boundary (plus any
+		// zero-length samples) falls inside it. Bail out to a binary search for pathological tables.
+		if( minDuration == 0 )
+			return;
+		const int64_t total = mSamples.back().mTime + mSamples.back().mDuration;
+		const int64_t numBuckets = ( total + minDuration - 1 ) / minDuration;
+		if( numBuckets > (int64_t)mSamples.size() * 4 + 16 )
+			return;
+
+		mBucketDuration = minDuration;
+		mTimeBuckets.resize( (size_t)numBuckets );
+		uint32_t sample = 0;
+		for( int64_t b = 0; b < numBuckets; ++b ) {
+			const int64_t time = b * mBucketDuration;
+			while( sample + 1 < mSamples.size() && mSamples[sample + 1].mTime <= time )
+				++sample;
+			mTimeBuckets[(size_t)b] = sample;
+		}
+	}
+
+	SampleTableRef SampleTable::createIndexed( const MovieSourceRef &source, const fs::path &moviePath, const fs::path &indexPath )
+	{
+		SampleTableRef table( new SampleTable( source ) );
+		try {
+			if( table->loadIndex( moviePath, indexPath ) )
+				return table;
+		}
+		catch( const std::exception &exc ) {
+			CI_LOG_W( "HAP WARNING :: ignoring sidecar index " << indexPath << ": " << exc.what() );
+		}
+
+		// Stale or missing, parse the container and leave the rewrite to the background, away from the decode workers
+		table = create( source );
+		std::weak_ptr<const SampleTable> weakTable = table;
+		getIndexWriterPool()->submit( [weakTable, source, moviePath, indexPath] {
+			writeIndex( weakTable, source, moviePath, indexPath );
+		} );
+		return table;
+	}
+
+	fs::path SampleTable::getIndexPath( const fs::path &moviePath, const fs::path &directory )
+	{
+		return ( directory.empty() ? moviePath.parent_path() : directory ) / ( moviePath.filename().string() + ".hapidx" );
+	}
+
+	bool SampleTable::loadIndex( const fs::path &moviePath, const fs::path &indexPath )
+	{
+		uint64_t fileSize;
+		int64_t modified;
+		if( ! fs::exists( indexPath ) || ! getFileStatus( moviePath, &fileSize, &modified ) || fileSize != mSource->getSize() )
+			return false;
+
+		MovieSourceRef index = MovieSource::create( indexPath );
+		const uint64_t indexSize = index->getSize();
+		if( indexSize < sizeof( IndexHeader ) )
+			return false;
+		const uint8_t *data = index->getPointer( 0, (size_t)indexSize );
+		if( ! data ) {
+			mIndexBuffer.resize( (size_t)indexSize );
+			if( index->read( 0, mIndexBuffer.data(), mIndexBuffer.size() ) != mIndexBuffer.size() )
+				return false;
+			data = mIndexBuffer.data();
+		}
+
+		IndexHeader header;
+		std::memcpy( &header, data, sizeof( header ) );
+		if( std::memcmp( header.mMagic, kIndexMagic, sizeof( kIndexMagic ) ) != 0 || header.mVersion != kIndexVersion || header.mByteOrder != kIndexByteOrder )
+			return false;
+		if( header.mFileSize != fileSize || header.mModified != modified )
+			return false;
+		if( header.mNumSamples > indexSize || header.mNumBuckets > indexSize )
+			return false;
+		if( sizeof( IndexHeader ) + header.mNumSamples * sizeof( Sample ) + header.mNumBuckets * sizeof( uint32_t ) != indexSize )
+			return false;
+		if( header.mNumBuckets && header.mBucketDuration <= 0 )
+			return false;
+
+		// Checked last, the movie atom is all that gets read from the movie itself
+		if( header.mMoovOffset + header.mMoovSize > fileSize || hashMovieAtom( mSource, header.mMoovOffset, header.mMoovSize ) != header.mMoovHash )
+			return false;
+
+		// The body must agree with the header too, a corrupted entry would send reads and lookups out of range
+		const Sample *samples = (const Sample*)( data + sizeof( IndexHeader ) );
+		const uint32_t *buckets = (const uint32_t*)( samples + header.mNumSamples );
+		for( uint64_t i = 0; i < header.mNumSamples; ++i ) {
+			if( samples[i].mSize > header.mMaxSampleSize || samples[i].mOffset > fileSize || samples[i].mSize > fileSize - samples[i].mOffset )
+				return false;
+		}
+		for( uint64_t i = 0; i < header.mNumBuckets; ++i ) {
+			if( buckets[i] >= header.mNumSamples )
+				return false;
+		}
+
+		mCodecType = header.mCodecType;
+		mWidth = header.mWidth;
+		mHeight = header.mHeight;
+		mTimeScale = header.mTimeScale;
+		mDuration = header.mDuration;
+		mMaxSampleSize = header.mMaxSampleSize;
+		mMoovOffset = header.mMoovOffset;
+		mMoovSize = header.mMoovSize;
+		mSampleDuration = header.mSampleDuration;
+		mBucketDuration = header.mBucketDuration;
+
+		mSampleData = samples;
+		mNumSamples = (size_t)header.mNumSamples;
+		mBucketData = buckets;
+		mNumBuckets = (size_t)header.mNumBuckets;
+		mIndexSource = index;
+		return true;
+	}
+
+	bool SampleTable::writeIndex( const fs::path &moviePath, const fs::path &indexPath ) const
+	{
+		return writeIndex( shared_from_this(), mSource, moviePath, indexPath );
+	}
+
+	bool SampleTable::writeIndex( const std::weak_ptr<const SampleTable> &weakTable, const MovieSourceRef &source, const fs::path &moviePath, const fs::path &indexPath )
+	{
+		IndexHeader header;
+		std::memset( &header, 0, sizeof( header ) );
+		std::vector<Sample> samples;
+		std::vector<uint32_t> buckets;
+		{
+			SampleTableRef table = std::const_pointer_cast<SampleTable>( weakTable.lock() );
+			if( ! table )
+				return false;
+			if( ! getFileStatus( moviePath, &header.mFileSize, &header.mModified ) || header.mFileSize != source->getSize() ) {
+				CI_LOG_W( "HAP WARNING :: not writing sidecar index, " << moviePath << " changed since it was opened." );
+				return false;
+			}
+			std::memcpy( header.mMagic, kIndexMagic, sizeof( kIndexMagic ) );
+			header.mVersion = kIndexVersion;
+			header.mByteOrder = kIndexByteOrder;
+			header.mMoovOffset = table->mMoovOffset;
+			header.mMoovSize = table->mMoovSize;
+			header.mCodecType = table->mCodecType;
+			header.mWidth = table->mWidth;
+			header.mHeight = table->mHeight;
+			header.mTimeScale = table->mTimeScale;
+			header.mDuration = table->mDuration;
+			header.mMaxSampleSize = table->mMaxSampleSize;
+			header.mSampleDuration = table->mSampleDuration;
+			header.mBucketDuration = table->mBucketDuration;
+			samples.assign( table->mSampleData, table->mSampleData + table->mNumSamples );
+			buckets.assign( table->mBucketData, table->mBucketData + table->mNumBuckets );
+		}
+		header.mMoovHash = hashMovieAtom( source, header.mMoovOffset, header.mMoovSize );
+		header.mNumSamples = samples.size();
+		header.mNumBuckets = buckets.size();
+
+		// Written aside and renamed over, so a concurrent open never maps a partial index
+		const fs::path tempPath = indexPath.string() + ".tmp";
+		{
+			std::ofstream out( tempPath.string().c_str(), std::ios::binary | std::ios::trunc );
+			out.write( (const char*)&header, sizeof( header ) );
+			out.write( (const char*)samples.data(), samples.size() * sizeof( Sample ) );
+			out.write( (const char*)buckets.data(), buckets.size() * sizeof( uint32_t ) );
+			out.close();
+			if( ! out ) {
+				CI_LOG_W( "HAP WARNING :: couldn't write sidecar index " << indexPath );
+				std::remove( tempPath.string().c_str() );
+				return false;
+			}
+		}
+		try {
+			fs::rename( tempPath, indexPath );
+		}
+		catch( const std::exception &exc ) {
+			CI_LOG_W( "HAP WARNING :: couldn't write sidecar index " << indexPath << ": " << exc.what() );
+			std::remove( tempPath.string().c_str() );
+			return false;
+		}
+		return true;
+	}
+
+	size_t SampleTable::getSampleIndexForTime( int64_t time ) const
+	{
+		if( mNumSamples == 0 || time <= 0 )
+			return 0;
+
+		const size_t last = mNumSamples - 1;
+		if( mSampleDuration )
+			return std::min<size_t>( (size_t)( time / mSampleDuration ), last );
+
+		if( mNumBuckets ) {
+			size_t bucket = std::min<size_t>( (size_t)( time / mBucketDuration ), mNumBuckets - 1 );
+			size_t index = mBucketData[bucket];
+			while( index < last && mSampleData[index + 1].mTime <= time )
+				++index;
+			return index;
+		}
+
+		const Sample *end = mSampleData + mNumSamples;
+		const Sample *it = std::upper_bound( mSampleData, end, time, []( int64_t t, const Sample &s ) { return t < s.mTime; } );
+		return it == mSampleData ? 0 : (size_t)( it - mSampleData ) - 1;
+	}
+
+	float SampleTable::getFramerate() const
+	{
+		if( mDuration <= 0 )
+			return 0;
+		return (float)( mNumSamples * (double)mTimeScale / mDuration );
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,121 @@
+/*
+ *  HapSampleTable.h
+ *
+ *  Portable QuickTime/MP4 container parser. Walks moov/trak/stbl without the QuickTime API
+ *  and flattens the video track's sample tables into one array indexed by frame, which can be
+ *  persisted to a sidecar file and mapped back on the next open.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapDecoder.h"
+#include "HapMovieSource.h"
+#include "HapTypes.h"
+
+#include <cmath>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	typedef std::shared_ptr<class SampleTable> SampleTableRef;
+
+	class SampleTable : public std::enable_shared_from_this<SampleTable> {
+	public:
+		//! One video sample (a compressed Hap frame). Times are expressed in the media's time scale.
+		struct Sample {
+			uint64_t	mOffset;
+			uint32_t	mSize;
+			uint32_t	mDuration;
+			int64_t		mTime;
+		};
+
+		//! Parses the container behind \a source. Throws SampleTableExc if no usable video track is found.
+		static SampleTableRef create( const MovieSourceRef &source );
+		//! Maps the index from the sidecar file at \a indexPath when it was written for this very movie, so even multi-hour movies
+		//! open in constant time. Otherwise parses the container like create() and rewrites the sidecar on a low-priority thread
+		//! of its own, so decode workers never wait on it. \a moviePath is the file behind \a source.
+		static SampleTableRef createIndexed( const MovieSourceRef &source, const fs::path &moviePath, const fs::path &indexPath );
+		//! Returns the default sidecar path of \a moviePath, its file name with ".hapidx" appended, next to it or in \a directory.
+		static fs::path	getIndexPath( const fs::path &moviePath, const fs::path &directory = fs::path() );
+
+		//! Writes the sidecar index of \a moviePath to \a indexPath. Returns false on failure.
+		bool			writeIndex( const fs::path &moviePath, const fs::path &indexPath ) const;
+		//! Returns true if the table was mapped from a sidecar index rather than parsed from the container.
+		bool			isLoadedFromIndex() const { return (bool)mIndexSource; }
+
+		const MovieSourceRef&	getSource() const { return mSource; }
+		//! Replaces the source samples are read from with another one over the same bytes, ie. the same file opened unbuffered.
+		void					setSource( const MovieSourceRef &source ) { mSource = source; }
+
+		uint32_t		getCodecType() const { return mCodecType; }
+		bool			isHap() const { return isHapCodec( mCodecType ); }
+		int32_t			getWidth() const { return mWidth; }
+		int32_t			getHeight() const { return mHeight; }
+
+		uint32_t		getTimeScale() const { return mTimeScale; }
+		int64_t			getDuration() const { return mDuration; }
+		double			getDurationSeconds() const { return mDuration / (double)mTimeScale; }
+		float			getFramerate() const;
+
+		size_t			getNumSamples() const { return mNumSamples; }
+		const Sample&	getSample( size_t index ) const { return mSampleData[index]; }
+		//! Returns all getNumSamples() samples, in decode order.
+		const Sample*	getSamples() const { return mSampleData; }
+		//! Returns the size of the largest sample, useful to size read buffers once.
+		uint32_t		getMaxSampleSize() const { return mMaxSampleSize; }
+
+		//! Returns the index of the sample displayed at \a time (in media time scale units), clamped to the track. O(1).
+		size_t			getSampleIndexForTime( int64_t time ) const;
+		//! Returns the index of the sample displayed at \a seconds, clamped to the track. O(1). Rounds to the nearest time scale
+		//! unit, so getSampleSeconds() maps back to its own sample.
+		size_t			getSampleIndexForSeconds( double seconds ) const { return getSampleIndexForTime( std::llround( seconds * mTimeScale ) ); }
+		//! Returns the time sample \a index is first displayed at, in seconds.
+		double			getSampleSeconds( size_t index ) const { return mSampleData[index].mTime / (double)mTimeScale; }
+
+	protected:
+		SampleTable( const MovieSourceRef &source );
+
+		struct Track;
+		void			parse();
+		void			parseMovie( const uint8_t *data, size_t size );
+		bool			parseTrack( const uint8_t *data, size_t size, Track *track );
+		void			buildSamples( const Track &track );
+		void			buildTimeLookup();
+		//! Finds the movie atom, setting mMoovOffset and mMoovSize to its body. Returns false if there is none.
+		bool			findMovieAtom();
+		//! Maps the sidecar at \a indexPath if it matches \a moviePath. Returns false if it is missing, stale or corrupt.
+		bool			loadIndex( const fs::path &moviePath, const fs::path &indexPath );
+		//! Writes the index of \a table, unless it expired before the writer got to it.
+		static bool		writeIndex( const std::weak_ptr<const SampleTable> &table, const MovieSourceRef &source, const fs::path &moviePath, const fs::path &indexPath );
+
+		MovieSourceRef			mSource;
+		uint32_t				mCodecType;
+		int32_t					mWidth, mHeight;
+		uint32_t				mTimeScale;
+		int64_t					mDuration;
+		uint32_t				mMaxSampleSize;
+		uint64_t				mMoovOffset, mMoovSize;
+
+		// Samples and time buckets live in the vectors when parsed, in the mapped sidecar when loaded from an index
+		const Sample			*mSampleData;
+		size_t					mNumSamples;
+		const uint32_t			*mBucketData;
+		size_t					mNumBuckets;
+		std::vector<Sample>		mSamples;
+		MovieSourceRef			mIndexSource;
+		std::vector<uint8_t>	mIndexBuffer;
+
+		// Every sample lasts mSampleDuration when it is non-zero, so lookup is a division.
+		// Otherwise mTimeBuckets maps each mBucketDuration-long slice of the track to its first sample.
+		uint32_t				mSampleDuration;
+		int64_t					mBucketDuration;
+		std::vector<uint32_t>	mTimeBuckets;
+	};
+
+	class SampleTableExc : public Exception {
+	public:
+		SampleTableExc( const std::string &description ) : Exception( description ) {}
+	};
+
+} } // namespace cinder::hap
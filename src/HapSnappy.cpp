@@ -0,0 +1,280 @@
+/*
+ *  HapSnappy.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapSnappy.h"
+
+#include <cstring>
+#include <vector>
+
+namespace cinder { namespace hap { namespace snappy {
+
+	namespace {
+
+		enum {
+			TAG_LITERAL	= 0,
+			TAG_COPY_1	= 1,
+			TAG_COPY_2	= 2,
+			TAG_COPY_4	= 3
+		};
+
+		inline uint32_t readLE( const uint8_t *p, int bytes )
+		{
+			uint32_t v = 0;
+			for( int i = 0; i < bytes; ++i )
+				v |= uint32_t( p[i] ) << ( 8 * i );
+			return v;
+		}
+
+		//! Reads the varint length header, returns the number of header bytes or 0 if it is malformed.
+		size_t readVarint( const uint8_t *in, size_t inSize, size_t *result )
+		{
+			uint64_t value = 0;
+			for( size_t i = 0; i < inSize && i < 5; ++i ) {
+				value |= uint64_t( in[i] & 0x7F ) << ( 7 * i );
+				if( ! ( in[i] & 0x80 ) ) {
+					if( value > 0xFFFFFFFF )
+						return 0;
+					*result = (size_t)value;
+					return i + 1;
+				}
+			}
+			return 0;
+		}
+
+		//! Matches are searched through a table of where each hash of 4 bytes was last seen.
+		const int		kHashBits = 14;
+		//! Copies with 2-byte offsets only, matches further back are passed over.
+		const size_t	kMaxOffset = 0xFFFF;
+
+		inline uint32_t load32( const uint8_t *p )
+		{
+			uint32_t v;
+			std::memcpy( &v, p, 4 );
+			return v;
+		}
+
+		inline uint32_t hash( uint32_t bytes ) { return ( bytes * 0x1E35A7BD ) >> ( 32 - kHashBits ); }
+
+		uint8_t* writeVarint( uint8_t *out, uint32_t value )
+		{
+			while( value >= 0x80 ) {
+				*out++ = uint8_t( value | 0x80 );
+				value >>= 7;
+			}
+			*out++ = uint8_t( value );
+			return out;
+		}
+
+		uint8_t* emitLiteral( uint8_t *op, const uint8_t *literal, size_t len )
+		{
+			const size_t n = len - 1;
+			if( n < 60 ) {
+				*op++ = uint8_t( n << 2 );
+			}
+			else {
+				int bytes = 1;
+				while( bytes < 4 && ( n >> ( 8 * bytes ) ) )
+					++bytes;
+				*op++ = uint8_t( ( 59 + bytes ) << 2 );
+				for( int i = 0; i < bytes; ++i )
+					*op++ = uint8_t( n >> ( 8 * i ) );
+			}
+			std::memcpy( op, literal, len );
+			return op + len;
+		}
+
+		uint8_t* emitCopy( uint8_t *op, size_t offset, size_t len )
+		{
+			// Copies hold at most 64 bytes, the split leaves at least 4 for the last one
+			while( len >= 68 ) {
+				*op++ = uint8_t( TAG_COPY_2 | ( 63 << 2 ) );
+				*op++ = uint8_t( offset );
+				*op++ = uint8_t( offset >> 8 );
+				len -= 64;
+			}
+			if( len > 64 ) {
+				*op++ = uint8_t( TAG_COPY_2 | ( 59 << 2 ) );
+				*op++ = uint8_t( offset );
+				*op++ = uint8_t( offset >> 8 );
+				len -= 60;
+			}
+			if( len < 12 && offset < 2048 ) {
+				*op++ = uint8_t( TAG_COPY_1 | ( ( len - 4 ) << 2 ) | ( ( offset >> 8 ) << 5 ) );
+				*op++ = uint8_t( offset );
+			}
+			else {
+				*op++ = uint8_t( TAG_COPY_2 | ( ( len - 1 ) << 2 ) );
+				*op++ = uint8_t( offset );
+				*op++ = uint8_t( offset >> 8 );
+			}
+			return op;
+		}
+
+	} // anonymous namespace
+
+	size_t getMaxCompressedLength( size_t inputSize )
+	{
+		// Same bound as the reference implementation
+		return 32 + inputSize + inputSize / 6;
+	}
+
+	bool compress( const void *input, size_t inputSize, void *output, size_t outputSize, size_t *compressedSize )
+	{
+		if( ( ! input && inputSize ) || ! output || ! compressedSize || inputSize > 0xFFFFFFFF || outputSize < getMaxCompressedLength( inputSize ) )
+			return false;
+
+		const uint8_t *const ipBegin = (const uint8_t*)input;
+		const uint8_t *const ipEnd = ipBegin + inputSize;
+		const uint8_t *ip = ipBegin;
+		const uint8_t *literal = ip;
+		uint8_t *op = writeVarint( (uint8_t*)output, uint32_t( inputSize ) );
+		std::vector<uint32_t> table( size_t( 1 ) << kHashBits, 0 );
+
+		while( ip + 4 <= ipEnd ) {
+			// Look for a match, stepping faster the longer none turns up, so incompressible data goes by quickly
+			const uint8_t *candidate;
+			uint32_t skip = 32;
+			for( ;; ) {
+				const uint32_t bytes = load32( ip );
+				uint32_t &entry = table[hash( bytes )];
+				candidate = ipBegin + entry;
+				entry = uint32_t( ip - ipBegin );
+				if( candidate < ip && size_t( ip - candidate ) <= kMaxOffset && load32( candidate ) == bytes )
+					break;
+				ip += skip++ >> 5;
+				if( ip + 4 > ipEnd )
+					goto remainder;
+			}
+
+			if( ip > literal )
+				op = emitLiteral( op, literal, ip - literal );
+			// Copies follow each other as long as the bytes right after one match again
+			for( ;; ) {
+				size_t len = 4;
+				while( ip + len < ipEnd && candidate[len] == ip[len] )
+					++len;
+				op = emitCopy( op, ip - candidate, len );
+				ip += len;
+				literal = ip;
+				if( ip + 4 > ipEnd )
+					goto remainder;
+
+				table[hash( load32( ip - 1 ) )] = uint32_t( ip - 1 - ipBegin );
+				const uint32_t bytes = load32( ip );
+				uint32_t &entry = table[hash( bytes )];
+				candidate = ipBegin + entry;
+				entry = uint32_t( ip - ipBegin );
+				if( ! ( candidate < ip && size_t( ip - candidate ) <= kMaxOffset && load32( candidate ) == bytes ) )
+					break;
+			}
+			++ip;
+		}
+
+	remainder:
+		if( ipEnd > literal )
+			op = emitLiteral( op, literal, ipEnd - literal );
+		*compressedSize = op - (uint8_t*)output;
+		return true;
+	}
+
+	bool getUncompressedLength( const void *input, size_t inputSize, size_t *result )
+	{
+		return readVarint( (const uint8_t*)input, inputSize, result ) != 0;
+	}
+
+	bool uncompress( const void *input, size_t inputSize, void *output, size_t outputSize )
+	{
+		const uint8_t *ip = (const uint8_t*)input;
+		const uint8_t *ipEnd = ip + inputSize;
+
+		size_t length;
+		size_t header = readVarint( ip, inputSize, &length );
+		if( ! header || length > outputSize )
+			return false;
+		ip += header;
+
+		uint8_t *op = (uint8_t*)output;
+		uint8_t *const opBegin = op;
+		uint8_t *const opEnd = op + length;
+
+		while( ip < ipEnd ) {
+			const uint8_t tag = *ip++;
+			switch( tag & 3 ) {
+				case TAG_LITERAL: {
+					size_t len = tag >> 2;
+					if( len >= 60 ) {
+						const int bytes = int( len ) - 59;
+						if( ipEnd - ip < bytes )
+							return false;
+						len = readLE( ip, bytes );
+						ip += bytes;
+					}
+					len += 1;
+					if( (size_t)( ipEnd - ip ) < len || (size_t)( opEnd - op ) < len )
+						return false;
+					// Short literals dominate, copy them with a single fixed-size move when there's slack on both sides
+					if( len <= 16 && ipEnd - ip >= 16 && opEnd - op >= 16 )
+						std::memcpy( op, ip, 16 );
+					else
+						std::memcpy( op, ip, len );
+					ip += len;
+					op += len;
+					continue;
+				}
+				case TAG_COPY_1: {
+					if( ip >= ipEnd )
+						return false;
+					const size_t len = 4 + ( ( tag >> 2 ) & 7 );
+					const size_t offset = ( size_t( tag >> 5 ) << 8 ) | *ip++;
+					if( offset == 0 || offset > (size_t)( op - opBegin ) || (size_t)( opEnd - op ) < len )
+						return false;
+					const uint8_t *src = op - offset;
+					if( offset >= 8 && opEnd - op >= 16 ) {
+						// Non-overlapping 8-byte steps, the copy is at most 11 bytes
+						std::memcpy( op, src, 8 );
+						std::memcpy( op + 8, src + 8, 8 );
+					}
+					else {
+						for( size_t i = 0; i < len; ++i )
+							op[i] = src[i];
+					}
+					op += len;
+					continue;
+				}
+				case TAG_COPY_2:
+				case TAG_COPY_4: {
+					const int bytes = ( tag & 3 ) == TAG_COPY_2 ? 2 : 4;
+					if( ipEnd - ip < bytes )
+						return false;
+					const size_t len = ( tag >> 2 ) + 1;
+					const size_t offset = readLE( ip, bytes );
+					ip += bytes;
+					if( offset == 0 || offset > (size_t)( op - opBegin ) || (size_t)( opEnd - op ) < len )
+						return false;
+					const uint8_t *src = op - offset;
+					if( offset >= 8 && (size_t)( opEnd - op ) >= len + 8 ) {
+						// Each 8-byte step only reads bytes already written, so overlap is harmless
+						for( size_t i = 0; i < len; i += 8 )
+							std::memcpy( op + i, src + i, 8 );
+					}
+					else if( offset >= len ) {
+						std::memcpy( op, src, len );
+					}
+					else {
+						for( size_t i = 0; i < len; ++i )
+							op[i] = src[i];
+					}
+					op += len;
+					continue;
+				}
+			}
+		}
+
+		return op == opEnd;
+	}
+
+} } } // namespace cinder::hap::snappy
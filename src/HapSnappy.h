@@ -0,0 +1,27 @@
+/*
+ *  HapSnappy.h
+ *
+ *  Minimal in-tree implementation of the Snappy raw format, used as Hap's second-stage compressor.
+ *  See https://github.com/google/snappy/blob/master/format_description.txt
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder { namespace hap { namespace snappy {
+
+	//! Reads the uncompressed length stored at the start of a Snappy stream. Returns false if the header is malformed.
+	bool	getUncompressedLength( const void *input, size_t inputSize, size_t *result );
+	//! Decompresses \a input into \a output, which must hold at least the uncompressed length. Returns false on corrupt input.
+	bool	uncompress( const void *input, size_t inputSize, void *output, size_t outputSize );
+
+	//! Returns the most bytes compress() can produce for \a inputSize bytes of input.
+	size_t	getMaxCompressedLength( size_t inputSize );
+	//! Compresses \a input into \a output, which must hold getMaxCompressedLength( inputSize ) bytes, and sets \a compressedSize.
+	//! Greedy hash-table matching like the reference compressor, fast rather than tight. Returns false on bad arguments.
+	bool	compress( const void *input, size_t inputSize, void *output, size_t outputSize, size_t *compressedSize );
+
+} } } // namespace cinder::hap::snappy
@@ -0,0 +1,208 @@
+/*
+ *  HapTextureUploader.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapTextureUploader.h"
+
+#include "cinder/gl/scoped.h"
+#include "cinder/Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		typedef std::chrono::steady_clock Clock;
+
+		double secondsSince( Clock::time_point start )
+		{
+			return std::chrono::duration<double>( Clock::now() - start ).count();
+		}
+
+		// Mapping an orphaned buffer never waits on the GPU unless the driver ran out of storage to rename,
+		// so anything slower than this is reported as a stall
+		const double kOrphanStallThreshold = 0.0005;
+
+	} // anonymous namespace
+
+	TextureUploader::TextureUploader( UploadMode mode, size_t ringDepth )
+	: mMode( mode ), mRequestedMode( mode ), mSlots( std::max<size_t>( ringDepth, 1 ) ), mNextSlot( 0 ),
+	  mPersistentBuffer( 0 ), mPersistentData( nullptr ), mPersistentSlotSize( 0 ), mAcquired( nullptr ), mAcquiredSlot( 0 )
+	{
+		if( mMode == UploadMode::PERSISTENT && ! gl::isExtensionAvailable( "GL_ARB_buffer_storage" ) ) {
+			CI_LOG_W( "HAP WARNING :: GL_ARB_buffer_storage unavailable, using fenced PBOs." );
+			mMode = UploadMode::PBO_FENCED;
+		}
+	}
+
+	TextureUploader::~TextureUploader()
+	{
+		releasePersistent();
+	}
+
+	void TextureUploader::upload( const gl::Texture2dRef &texture, GLsizei width, GLsizei height, const void *data, GLsizei dataSize )
+	{
+		++mStats.mNumUploads;
+
+		// Frames decoded straight into the mapped slot need no copy at all, others are copied in
+		if( mMode == UploadMode::PERSISTENT && data != mAcquired ) {
+			void *dst = acquireWritePointer( dataSize );
+			if( dst )
+				std::memcpy( dst, data, dataSize );
+		}
+
+		// acquireWritePointer() drops to PBO_FENCED if the persistent buffer can't be mapped
+		if( mMode == UploadMode::PERSISTENT ) {
+			Slot &slot = mSlots[mAcquiredSlot];
+			const size_t offset = mAcquiredSlot * mPersistentSlotSize;
+			mAcquired = nullptr;
+
+			// The mapping is coherent, so writes are visible to the GPU without an explicit flush
+			gl::ScopedBuffer scopedBuffer( GL_PIXEL_UNPACK_BUFFER, mPersistentBuffer );
+			gl::ScopedTextureBind bind( texture );
+			glCompressedTexSubImage2D( texture->getTarget(), 0, 0, 0, width, height, texture->getInternalFormat(), dataSize, (const GLvoid*)offset );
+			slot.mFence = gl::Sync::create();
+			return;
+		}
+		else if( mMode != UploadMode::CLIENT_MEMORY ) {
+			Slot &slot = mSlots[mNextSlot];
+			mNextSlot = ( mNextSlot + 1 ) % mSlots.size();
+
+			if( ! slot.mPbo || slot.mPbo->getSize() < (size_t)dataSize ) {
+				slot.mPbo = gl::Pbo::create( GL_PIXEL_UNPACK_BUFFER, dataSize, nullptr, GL_STREAM_DRAW );
+				slot.mFence.reset();
+			}
+
+			gl::ScopedBuffer scopedPbo( slot.mPbo );
+			void *dst = mapSlot( slot, dataSize );
+			if( dst ) {
+				std::memcpy( dst, data, dataSize );
+				slot.mPbo->unmap();
+
+				// With a pixel-unpack buffer bound the data pointer is an offset into it, the copy becomes a GPU-side transfer
+				gl::ScopedTextureBind bind( texture );
+				glCompressedTexSubImage2D( texture->getTarget(), 0, 0, 0, width, height, texture->getInternalFormat(), dataSize, nullptr );
+				if( mMode == UploadMode::PBO_FENCED )
+					slot.mFence = gl::Sync::create();
+				return;
+			}
+			CI_LOG_W( "HAP WARNING :: couldn't map pixel unpack buffer, uploading from client memory." );
+		}
+
+		gl::ScopedTextureBind bind( texture );
+		glCompressedTexSubImage2D( texture->getTarget(), 0, 0, 0, width, height, texture->getInternalFormat(), dataSize, data );
+	}
+
+	void* TextureUploader::mapSlot( Slot &slot, GLsizei dataSize )
+	{
+		const Clock::time_point start = Clock::now();
+
+		if( mMode == UploadMode::PBO_ORPHAN ) {
+			slot.mPbo->bufferData( slot.mPbo->getSize(), nullptr, GL_STREAM_DRAW );
+			void *ptr = slot.mPbo->mapBufferRange( 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+			const double elapsed = secondsSince( start );
+			if( elapsed > kOrphanStallThreshold )
+				recordStall( elapsed );
+			return ptr;
+		}
+
+		waitForFence( slot );
+		return slot.mPbo->mapBufferRange( 0, dataSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+	}
+
+	void TextureUploader::waitForFence( Slot &slot )
+	{
+		// The slot was last sourced ringDepth uploads ago; only wait if the GPU still hasn't consumed it
+		if( ! slot.mFence )
+			return;
+
+		const Clock::time_point start = Clock::now();
+		GLenum status = slot.mFence->clientWaitSync( GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+		if( status == GL_TIMEOUT_EXPIRED ) {
+			do {
+				status = slot.mFence->clientWaitSync( 0, 1000000 );
+			} while( status == GL_TIMEOUT_EXPIRED );
+			recordStall( secondsSince( start ) );
+		}
+		slot.mFence.reset();
+	}
+
+	void* TextureUploader::acquireWritePointer( size_t dataSize )
+	{
+		if( mMode != UploadMode::PERSISTENT )
+			return nullptr;
+		if( mAcquired )
+			return mAcquired;
+
+		if( dataSize > mPersistentSlotSize ) {
+			// Keep slots aligned so DMA engines read whole lines
+			if( ! allocatePersistent( ( dataSize + 255 ) & ~size_t( 255 ) ) )
+				return nullptr;
+		}
+
+		mAcquiredSlot = mNextSlot;
+		mNextSlot = ( mNextSlot + 1 ) % mSlots.size();
+		waitForFence( mSlots[mAcquiredSlot] );
+		mAcquired = mPersistentData + mAcquiredSlot * mPersistentSlotSize;
+		return mAcquired;
+	}
+
+	bool TextureUploader::allocatePersistent( size_t slotSize )
+	{
+		// Growing the buffer means none of the old slots may still be read by the GPU
+		for( auto &slot : mSlots )
+			waitForFence( slot );
+		releasePersistent();
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr totalSize = slotSize * mSlots.size();
+		glGenBuffers( 1, &mPersistentBuffer );
+		{
+			gl::ScopedBuffer scopedBuffer( GL_PIXEL_UNPACK_BUFFER, mPersistentBuffer );
+			glBufferStorage( GL_PIXEL_UNPACK_BUFFER, totalSize, nullptr, flags );
+			mPersistentData = (uint8_t*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, totalSize, flags );
+		}
+		mNextSlot = 0;
+
+		// Storage can run out or the driver may refuse the mapping; both leave mPersistentData null
+		if( ! mPersistentData ) {
+			CI_LOG_W( "HAP WARNING :: couldn't map a " << totalSize << " byte persistent pixel unpack buffer, using fenced PBOs." );
+			releasePersistent();
+			mMode = UploadMode::PBO_FENCED;
+			return false;
+		}
+
+		mPersistentSlotSize = slotSize;
+		return true;
+	}
+
+	void TextureUploader::releasePersistent()
+	{
+		if( ! mPersistentBuffer )
+			return;
+
+		if( mPersistentData ) {
+			gl::ScopedBuffer scopedBuffer( GL_PIXEL_UNPACK_BUFFER, mPersistentBuffer );
+			glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+		}
+		glDeleteBuffers( 1, &mPersistentBuffer );
+		mPersistentBuffer = 0;
+		mPersistentData = nullptr;
+		mPersistentSlotSize = 0;
+		mAcquired = nullptr;
+	}
+
+	void TextureUploader::recordStall( double seconds )
+	{
+		++mStats.mNumStalls;
+		mStats.mStallSeconds += seconds;
+		mStats.mLastStallSeconds = seconds;
+	}
+
+} } // namespace cinder::hap
@@ -0,0 +1,95 @@
+/*
+ *  HapTextureUploader.h
+ *
+ *  Streams compressed DXT frames into a texture through a ring of pixel-unpack buffers,
+ *  so glCompressedTexSubImage2D sources GPU memory instead of client memory. In PERSISTENT mode the
+ *  ring lives in one persistently mapped buffer that the decoder writes into directly.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Pbo.h"
+#include "cinder/gl/Sync.h"
+#include "cinder/gl/Texture.h"
+
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	enum class UploadMode {
+		//! glCompressedTexSubImage2D straight from client memory; the driver copies synchronously.
+		CLIENT_MEMORY,
+		//! Ring of PBOs re-specified (orphaned) before every write, letting the driver rename storage still in flight.
+		PBO_ORPHAN,
+		//! Ring of PBOs mapped unsynchronized, each guarded by a fence waited on before the slot is reused.
+		PBO_FENCED,
+		//! Ring of slots in one buffer persistently and coherently mapped (GL_ARB_buffer_storage), fenced per slot.
+		//! Frames decoded into acquireWritePointer() reach the GPU without any CPU copy. Falls back to PBO_FENCED if unsupported or unmappable.
+		PERSISTENT
+	};
+
+	struct UploadStats {
+		UploadStats() : mNumUploads( 0 ), mNumStalls( 0 ), mStallSeconds( 0 ), mLastStallSeconds( 0 ) {}
+
+		uint64_t	mNumUploads;
+		//! Uploads that had to wait for the GPU (a fence not yet signaled, or a slow buffer map).
+		uint64_t	mNumStalls;
+		double		mStallSeconds;
+		double		mLastStallSeconds;
+	};
+
+	typedef std::shared_ptr<class TextureUploader> TextureUploaderRef;
+
+	//! Must be created and used on the thread owning the GL context.
+	class TextureUploader {
+	public:
+		static TextureUploaderRef create( UploadMode mode, size_t ringDepth = 3 ) { return TextureUploaderRef( new TextureUploader( mode, ringDepth ) ); }
+		~TextureUploader();
+
+		//! Returns the mode in use, which differs from getRequestedMode() when PERSISTENT isn't supported by the context.
+		UploadMode		getMode() const { return mMode; }
+		UploadMode		getRequestedMode() const { return mRequestedMode; }
+		size_t			getRingDepth() const { return mSlots.size(); }
+
+		//! Uploads \a dataSize bytes of \a data into the \a width x \a height (multiples of 4) region of \a texture.
+		//! If \a data was returned by acquireWritePointer() it is used in place.
+		void			upload( const gl::Texture2dRef &texture, GLsizei width, GLsizei height, const void *data, GLsizei dataSize );
+
+		//! PERSISTENT mode: waits until the next slot is free and returns its mapped memory, large enough for \a dataSize bytes.
+		//! Any thread may write to it until it is passed to upload(). Returns null in the other modes.
+		void*			acquireWritePointer( size_t dataSize );
+
+		const UploadStats&	getStats() const { return mStats; }
+
+	protected:
+		TextureUploader( UploadMode mode, size_t ringDepth );
+
+		struct Slot {
+			gl::PboRef		mPbo;
+			gl::SyncRef		mFence;
+		};
+
+		//! Maps the next slot for writing \a dataSize bytes, waiting on its fence if needed.
+		void*			mapSlot( Slot &slot, GLsizei dataSize );
+		void			waitForFence( Slot &slot );
+		void			recordStall( double seconds );
+		//! Returns false and drops to PBO_FENCED if the buffer can't be created and mapped.
+		bool			allocatePersistent( size_t slotSize );
+		void			releasePersistent();
+
+		UploadMode			mMode, mRequestedMode;
+		std::vector<Slot>	mSlots;
+		size_t				mNextSlot;
+		UploadStats			mStats;
+
+		// PERSISTENT mode
+		GLuint				mPersistentBuffer;
+		uint8_t				*mPersistentData;
+		size_t				mPersistentSlotSize;
+		void				*mAcquired;
+		size_t				mAcquiredSlot;
+	};
+
+} } // namespace cinder::hap
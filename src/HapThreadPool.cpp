@@ -0,0 +1,235 @@
+/*
+ *  HapThreadPool.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapThreadPool.h"
+
+#include <algorithm>
+
+#if defined( CINDER_MSW )
+	#include <Windows.h>
+#elif defined( CINDER_MAC )
+	#include <mach/mach.h>
+	#include <mach/thread_policy.h>
+	#include <pthread.h>
+	#include <sys/resource.h>
+#else
+	#include <pthread.h>
+	#include <sched.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+// Neither VS2013 nor Apple's clang before Xcode 8 has thread_local, their own storage classes work for plain pointers and integers
+#if defined( _MSC_VER )
+	#define HAP_THREAD_LOCAL __declspec( thread )
+#else
+	#define HAP_THREAD_LOCAL __thread
+#endif
+
+namespace cinder { namespace hap {
+
+	namespace {
+
+		// Lets submit() recognize its own workers, so nested tasks stay on the submitting worker's queue
+		HAP_THREAD_LOCAL const ThreadPool	*sCurrentPool = nullptr;
+		HAP_THREAD_LOCAL size_t				sCurrentWorker = 0;
+
+		std::mutex		sSharedMutex;
+		ThreadPoolRef	sSharedPool;
+
+	} // anonymous namespace
+
+	ThreadPool::ThreadPool( const Options &options )
+	: mOptions( options ), mNextWorker( 0 ), mNumQueued( 0 ), mNumStolen( 0 ), mQuit( false )
+	{
+		size_t numThreads = options.mNumThreads;
+		if( numThreads == 0 )
+			numThreads = std::max<size_t>( std::thread::hardware_concurrency(), 2 ) - 1;
+
+		// All workers exist before any starts, since they steal from each other
+		for( size_t i = 0; i < numThreads; ++i )
+			mWorkers.emplace_back( new Worker );
+		for( size_t i = 0; i < numThreads; ++i )
+			mWorkers[i]->mThread = std::thread( &ThreadPool::workerLoop, this, i );
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mSleepMutex );
+			mQuit = true;
+		}
+		mWake.notify_all();
+		for( auto &worker : mWorkers )
+			worker->mThread.join();
+	}
+
+	ThreadPoolRef ThreadPool::getShared()
+	{
+		std::lock_guard<std::mutex> lock( sSharedMutex );
+		if( ! sSharedPool )
+			sSharedPool = create();
+		return sSharedPool;
+	}
+
+	void ThreadPool::setShared( const ThreadPoolRef &pool )
+	{
+		std::lock_guard<std::mutex> lock( sSharedMutex );
+		sSharedPool = pool;
+	}
+
+	void ThreadPool::submit( const std::function<void ()> &task, TaskPriority priority )
+	{
+		if( mWorkers.empty() ) {
+			task();
+			return;
+		}
+
+		const size_t index = ( sCurrentPool == this ) ? sCurrentWorker : mNextWorker.fetch_add( 1, std::memory_order_relaxed ) % mWorkers.size();
+		Worker &worker = *mWorkers[index];
+		{
+			std::lock_guard<std::mutex> lock( worker.mMutex );
+			worker.mQueues[(size_t)priority].push_back( task );
+		}
+		// Counted only once queued, so a worker seeing mNumQueued > 0 always finds something to pop
+		mNumQueued.fetch_add( 1 );
+		{
+			std::lock_guard<std::mutex> lock( mSleepMutex );
+		}
+		mWake.notify_one();
+	}
+
+	bool ThreadPool::popTask( size_t index, std::function<void ()> *task )
+	{
+		const size_t numWorkers = mWorkers.size();
+		for( size_t priority = 0; priority < (size_t)TaskPriority::NUM_PRIORITIES; ++priority ) {
+			// Oldest task of our own queue first, then the newest of each victim's, so owner and thieves work at opposite ends
+			for( size_t i = 0; i < numWorkers; ++i ) {
+				const size_t victim = ( index + i ) % numWorkers;
+				Worker &worker = *mWorkers[victim];
+				std::lock_guard<std::mutex> lock( worker.mMutex );
+				auto &queue = worker.mQueues[priority];
+				if( queue.empty() )
+					continue;
+				if( i == 0 ) {
+					*task = std::move( queue.front() );
+					queue.pop_front();
+				}
+				else {
+					*task = std::move( queue.back() );
+					queue.pop_back();
+					mNumStolen.fetch_add( 1, std::memory_order_relaxed );
+				}
+				mNumQueued.fetch_sub( 1 );
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::workerLoop( size_t index )
+	{
+		sCurrentPool = this;
+		sCurrentWorker = index;
+		if( mOptions.mPinThreads )
+			pinCurrentThread( ( mOptions.mFirstCpu + index ) % std::max<size_t>( std::thread::hardware_concurrency(), 1 ) );
+		if( mOptions.mBackground )
+			lowerCurrentThreadPriority();
+
+		while( true ) {
+			std::function<void ()> task;
+			if( popTask( index, &task ) ) {
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock( mSleepMutex );
+			mWake.wait( lock, [this] { return mQuit || mNumQueued.load() > 0; } );
+			if( mQuit && mNumQueued.load() == 0 )
+				return;
+		}
+	}
+
+	void ThreadPool::pinCurrentThread( size_t cpu )
+	{
+#if defined( CINDER_MSW )
+		::SetThreadAffinityMask( ::GetCurrentThread(), DWORD_PTR( 1 ) << ( cpu % ( sizeof( DWORD_PTR ) * 8 ) ) );
+#elif defined( CINDER_MAC )
+		// OS X has no hard affinity, threads sharing a tag are only kept on the same L2 when possible
+		thread_affinity_policy_data_t policy = { int( cpu + 1 ) };
+		::thread_policy_set( ::pthread_mach_thread_np( ::pthread_self() ), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT );
+#else
+		cpu_set_t set;
+		CPU_ZERO( &set );
+		CPU_SET( cpu, &set );
+		::pthread_setaffinity_np( ::pthread_self(), sizeof( set ), &set );
+#endif
+	}
+
+	void ThreadPool::lowerCurrentThreadPriority()
+	{
+#if defined( CINDER_MSW )
+		// Background mode lowers the thread's I/O and memory priority along with its CPU priority. Vista and later, the
+		// samples' _WIN32_WINNT hides its definition
+#if ! defined( THREAD_MODE_BACKGROUND_BEGIN )
+		const int THREAD_MODE_BACKGROUND_BEGIN = 0x00010000;
+#endif
+		if( ! ::SetThreadPriority( ::GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN ) )
+			::SetThreadPriority( ::GetCurrentThread(), THREAD_PRIORITY_LOWEST );
+#elif defined( CINDER_MAC )
+		sched_param param;
+		int policy;
+		if( ::pthread_getschedparam( ::pthread_self(), &policy, &param ) == 0 ) {
+			param.sched_priority = ::sched_get_priority_min( policy );
+			::pthread_setschedparam( ::pthread_self(), policy, &param );
+		}
+		::setiopolicy_np( IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE );
+#else
+		// Linux applies nice values to single threads
+		::setpriority( PRIO_PROCESS, (id_t)::syscall( SYS_gettid ), 19 );
+#endif
+	}
+
+	void ThreadPool::parallelFor( size_t count, const std::function<void ( size_t index, size_t thread )> &fn, TaskPriority priority )
+	{
+		if( count == 0 )
+			return;
+
+		// Workers and the caller pull indices from a shared counter, so uneven chunks balance themselves
+		struct State {
+			std::atomic<size_t>		mNext;
+			std::atomic<size_t>		mDone;
+			std::mutex				mMutex;
+			std::condition_variable	mFinished;
+		};
+		auto state = std::make_shared<State>();
+		state->mNext = 0;
+		state->mDone = 0;
+
+		auto run = [state, count, &fn]( size_t thread ) {
+			size_t index;
+			while( ( index = state->mNext.fetch_add( 1 ) ) < count ) {
+				fn( index, thread );
+				if( state->mDone.fetch_add( 1 ) + 1 == count ) {
+					std::lock_guard<std::mutex> lock( state->mMutex );
+					state->mFinished.notify_all();
+				}
+			}
+		};
+
+		const size_t numHelpers = std::min( count - 1, mWorkers.size() );
+		for( size_t i = 0; i < numHelpers; ++i )
+			submit( [run, i] { run( i + 1 ); }, priority );
+
+		run( 0 );
+
+		std::unique_lock<std::mutex> lock( state->mMutex );
+		state->mFinished.wait( lock, [&] { return state->mDone == count; } );
+	}
+
+} } // namespace cinder::hap
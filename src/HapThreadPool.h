@@ -0,0 +1,100 @@
+/*
+ *  HapThreadPool.h
+ *
+ *  Work-stealing pool of decode threads with task priorities. One shared pool serves every MovieGlHap by default,
+ *  so many concurrent movies don't oversubscribe the cores.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "cinder/Cinder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cinder { namespace hap {
+
+	//! Tasks of a higher priority always run before queued tasks of a lower one.
+	enum class TaskPriority {
+		//! Frames of a layer being displayed.
+		ON_SCREEN,
+		//! Frames decoded ahead of time, ie. before a clip starts or loops.
+		PREROLL,
+		//! Frames nobody waits on, ie. thumbnails and scrubbing previews.
+		THUMBNAIL,
+		NUM_PRIORITIES
+	};
+
+	typedef std::shared_ptr<class ThreadPool> ThreadPoolRef;
+
+	class ThreadPool {
+	public:
+		struct Options {
+			Options() : mNumThreads( 0 ), mPinThreads( false ), mFirstCpu( 0 ), mBackground( false ) {}
+
+			//! Number of workers. 0 uses one worker per hardware thread, minus the caller's.
+			Options&	numThreads( size_t numThreads ) { mNumThreads = numThreads; return *this; }
+			//! Asks the OS to keep worker i on logical CPU ( \a firstCpu + i ) modulo the CPU count. Only a hint on OS X.
+			Options&	pinThreads( bool pin = true, size_t firstCpu = 0 ) { mPinThreads = pin; mFirstCpu = firstCpu; return *this; }
+			//! Lowers the workers' CPU and disk priority below every other thread's, for housekeeping that must not slow playback.
+			Options&	background( bool background = true ) { mBackground = background; return *this; }
+
+			size_t		mNumThreads;
+			bool		mPinThreads;
+			size_t		mFirstCpu;
+			bool		mBackground;
+		};
+
+		//! Creates a pool with \a numThreads workers. 0 uses one worker per hardware thread, minus the caller's.
+		static ThreadPoolRef create( size_t numThreads = 0 ) { return create( Options().numThreads( numThreads ) ); }
+		static ThreadPoolRef create( const Options &options ) { return ThreadPoolRef( new ThreadPool( options ) ); }
+		~ThreadPool();
+
+		//! Returns the process-wide pool, created with default Options on first use.
+		static ThreadPoolRef	getShared();
+		//! Replaces the process-wide pool used by movies created from now on, ie. to change its worker count or pinning.
+		static void				setShared( const ThreadPoolRef &pool );
+
+		size_t	getNumThreads() const { return mWorkers.size(); }
+		//! Returns how many tasks ran on a worker other than the one they were queued on.
+		uint64_t	getNumStolen() const { return mNumStolen.load( std::memory_order_relaxed ); }
+
+		//! Queues \a task to run on a worker. Tasks submitted from a worker go to its own queue, others are spread across the workers.
+		void	submit( const std::function<void ()> &task, TaskPriority priority = TaskPriority::ON_SCREEN );
+		//! Runs \a fn( i ) for i in [0, count) across the workers and the calling thread, and returns once all calls completed.
+		//! \a fn also receives which participant runs it, in [0, getNumThreads()], 0 being the caller.
+		void	parallelFor( size_t count, const std::function<void ( size_t index, size_t thread )> &fn, TaskPriority priority = TaskPriority::ON_SCREEN );
+
+	protected:
+		ThreadPool( const Options &options );
+
+		struct Worker {
+			std::mutex							mMutex;
+			std::deque<std::function<void ()>>	mQueues[(size_t)TaskPriority::NUM_PRIORITIES];
+			std::thread							mThread;
+		};
+
+		void	workerLoop( size_t index );
+		//! Pops the highest priority task, from worker \a index's own queues first, then from the other workers'.
+		bool	popTask( size_t index, std::function<void ()> *task );
+		void	pinCurrentThread( size_t cpu );
+		void	lowerCurrentThreadPriority();
+
+		Options								mOptions;
+		std::vector<std::unique_ptr<Worker>>	mWorkers;
+		std::atomic<size_t>					mNextWorker;
+		std::atomic<size_t>					mNumQueued;
+		std::atomic<uint64_t>				mNumStolen;
+		std::mutex							mSleepMutex;
+		std::condition_variable				mWake;
+		bool								mQuit;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,208 @@
+/*
+ *  HapTransport.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "HapTransport.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cinder { namespace hap {
+
+	Transport::Transport()
+	: mDuration( 0 ), mIn( 0 ), mOut( -1 ), mLoopMode( LoopMode::NONE ), mPlaying( false ), mRate( 1.0 ), mAnchorTime( 0 ),
+	  mAnchorDirection( 1 ), mAnchorClock( Clock::now() ), mSeekDirection( 1 )
+	{
+	}
+
+	void Transport::setClock( const PlaybackClockRef &clock )
+	{
+		if( clock == mClock )
+			return;
+		if( mClock ) {
+			// Carry on alone from wherever the clock had got to
+			bool reflected;
+			mAnchorTime = getTime( 0, &reflected );
+			mAnchorDirection = reflected ? -1 : 1;
+			mAnchorClock = Clock::now();
+			mPlaying = mClock->isPlaying();
+			mRate = mClock->getRate();
+			mSeekDirection = mClock->getSeekDirection();
+		}
+		else {
+			mAnchorDirection = 1;
+		}
+		mClock = clock;
+	}
+
+	void Transport::setDuration( double seconds )
+	{
+		rebase();
+		mDuration = std::max( seconds, 0.0 );
+		mAnchorTime = std::min( std::max( mAnchorTime, mIn ), getSegmentOut() );
+	}
+
+	void Transport::setSegment( double inSeconds, double outSeconds )
+	{
+		rebase();
+		mIn = std::max( inSeconds, 0.0 );
+		mOut = std::max( outSeconds, mIn );
+		mAnchorTime = std::min( std::max( mAnchorTime, mIn ), getSegmentOut() );
+	}
+
+	void Transport::resetSegment()
+	{
+		rebase();
+		mIn = 0;
+		mOut = -1;
+		mAnchorTime = std::min( std::max( mAnchorTime, mIn ), getSegmentOut() );
+	}
+
+	void Transport::setLoopMode( LoopMode mode )
+	{
+		rebase();
+		mLoopMode = mode;
+	}
+
+	void Transport::play()
+	{
+		if( isDone() ) {
+			// Over from the start of the segment, its end for negative rates
+			const double time = getRate() < 0 ? getSegmentOut() : mIn;
+			if( mClock )
+				mClock->seek( time );
+			mAnchorTime = time;
+			mAnchorDirection = 1;
+		}
+		else {
+			rebase();
+		}
+		if( mClock ) {
+			mClock->play();
+			return;
+		}
+		mAnchorClock = Clock::now();
+		mPlaying = true;
+	}
+
+	void Transport::stop()
+	{
+		if( mClock ) {
+			mClock->stop();
+			return;
+		}
+		rebase();
+		mPlaying = false;
+	}
+
+	bool Transport::isDone() const
+	{
+		if( mLoopMode != LoopMode::NONE )
+			return false;
+		const double velocity = getRate() * mAnchorDirection;
+		const double time = getTime();
+		return velocity > 0 ? time >= getSegmentOut() : velocity < 0 ? time <= mIn : false;
+	}
+
+	void Transport::setRate( double rate )
+	{
+		if( mClock ) {
+			mClock->setRate( rate );
+			return;
+		}
+		rebase();
+		mRate = rate;
+	}
+
+	int Transport::getDirection() const
+	{
+		const double rate = getRate();
+		if( ! isPlaying() || rate == 0 )
+			return mClock ? mClock->getSeekDirection() : mSeekDirection;
+		bool reflected;
+		getTime( 0, &reflected );
+		return ( rate * mAnchorDirection < 0 ) != reflected ? -1 : 1;
+	}
+
+	void Transport::seek( double seconds )
+	{
+		const double time = std::min( std::max( seconds, mIn ), getSegmentOut() );
+		mAnchorDirection = 1;
+		if( mClock ) {
+			mClock->seek( time );
+			return;
+		}
+		const double current = getTime();
+		if( time != current )
+			mSeekDirection = time < current ? -1 : 1;
+		mAnchorTime = time;
+		mAnchorClock = Clock::now();
+	}
+
+	double Transport::getTime() const
+	{
+		bool reflected;
+		return getTime( 0, &reflected );
+	}
+
+	double Transport::getTimeIn( double secondsFromNow ) const
+	{
+		bool reflected;
+		return getTime( secondsFromNow, &reflected );
+	}
+
+	double Transport::getPosition( double secondsFromNow ) const
+	{
+		if( mClock )
+			return mClock->getTimeIn( secondsFromNow );
+		if( ! mPlaying )
+			return mAnchorTime;
+		const double elapsed = std::chrono::duration<double>( Clock::now() - mAnchorClock ).count() + secondsFromNow;
+		return mAnchorTime + elapsed * mRate * mAnchorDirection;
+	}
+
+	double Transport::getTime( double secondsFromNow, bool *reflected ) const
+	{
+		*reflected = false;
+		const double in = mIn, out = getSegmentOut();
+		const double position = getPosition( secondsFromNow );
+		const double length = out - in;
+		if( length <= 0 )
+			return in;
+
+		switch( mLoopMode ) {
+			case LoopMode::LOOP: {
+				const double offset = std::fmod( position - in, length );
+				return in + ( offset < 0 ? offset + length : offset );
+			}
+			case LoopMode::BOUNCE: {
+				// Every other length of the unbounded position is mirrored
+				double offset = std::fmod( position - in, 2 * length );
+				if( offset < 0 )
+					offset += 2 * length;
+				if( offset <= length )
+					return in + offset;
+				*reflected = true;
+				return in + 2 * length - offset;
+			}
+			default:
+				return std::min( std::max( position, in ), out );
+		}
+	}
+
+	void Transport::rebase()
+	{
+		// Following a clock, the anchor is the clock's
+		if( mClock )
+			return;
+		bool reflected;
+		mAnchorTime = getTime( 0, &reflected );
+		if( reflected )
+			mAnchorDirection = -mAnchorDirection;
+		mAnchorClock = Clock::now();
+	}
+
+} } // namespace cinder::hap
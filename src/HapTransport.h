@@ -0,0 +1,95 @@
+/*
+ *  HapTransport.h
+ *
+ *  Playback position of a movie as a function of wall time, with exact seeks, any rate in either direction and looping.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "HapPlaybackClock.h"
+
+#include <chrono>
+
+namespace cinder { namespace hap {
+
+	enum class LoopMode {
+		NONE,
+		//! Wraps around from the end of the segment to its start, or the other way when playing backwards.
+		LOOP,
+		//! Plays the segment forth and back, ping-pong.
+		BOUNCE
+	};
+
+	//! Derives the position from the time elapsed since the last play, seek or change of rate, so frames are picked straight
+	//! from the clock and never drift however often the position is queried. Not thread-safe.
+	class Transport {
+	public:
+		Transport();
+
+		//! Follows \a clock, folding its time into the segment: play(), stop(), setRate() and seek() then act on the clock,
+		//! and so on every transport following it. Null returns to the transport's own timing, from the current position.
+		void		setClock( const PlaybackClockRef &clock );
+		const PlaybackClockRef&	getClock() const { return mClock; }
+
+		//! Sets the length of the media, which bounds playback unless a segment is set.
+		void		setDuration( double seconds );
+		double		getDuration() const { return mDuration; }
+		//! Restricts playback and looping to [\a inSeconds, \a outSeconds].
+		void		setSegment( double inSeconds, double outSeconds );
+		void		resetSegment();
+		double		getSegmentIn() const { return mIn; }
+		double		getSegmentOut() const { return mOut < 0 ? mDuration : mOut; }
+
+		void		setLoopMode( LoopMode mode );
+		LoopMode	getLoopMode() const { return mLoopMode; }
+
+		//! Starts playing from the current position, or over from the start of the segment (its end for negative rates) when done.
+		void		play();
+		void		stop();
+		bool		isPlaying() const { return mClock ? mClock->isPlaying() : mPlaying; }
+		//! Returns true once playback without looping reached the end of the segment, or its start for negative rates.
+		bool		isDone() const;
+
+		//! Sets the speed relative to real time, ie. 4 for four times as fast, negative values playing backwards. Defaults to 1.
+		void		setRate( double rate );
+		double		getRate() const { return mClock ? mClock->getRate() : mRate; }
+		//! Returns the direction the position currently moves in, 1 or -1. Follows the bounce legs while playing, and the last
+		//! seek while stopped, so scrubbing backwards counts as moving backwards.
+		int			getDirection() const;
+
+		//! Moves to \a seconds, clamped to the segment. Exact, the position then reads back as \a seconds.
+		void		seek( double seconds );
+		//! Returns the current position in seconds, inside the segment.
+		double		getTime() const;
+		//! Returns the position \a secondsFromNow seconds from now, ie. when the next frame will be displayed, if nothing changes meanwhile.
+		double		getTimeIn( double secondsFromNow ) const;
+
+	protected:
+		typedef std::chrono::steady_clock Clock;
+
+		//! Returns the position \a secondsFromNow, folded into the segment. \a reflected is set when the position runs backwards
+		//! from how it ran at the anchor, on the other leg of a bounce loop.
+		double		getTime( double secondsFromNow, bool *reflected ) const;
+		//! Returns the position \a secondsFromNow before folding.
+		double		getPosition( double secondsFromNow ) const;
+		//! Makes the current position the anchor, so the settings can change without the position jumping.
+		void		rebase();
+
+		double		mDuration;
+		double		mIn, mOut;
+		LoopMode	mLoopMode;
+		bool		mPlaying;
+		double		mRate;
+
+		//! Position at mAnchorClock, and the direction it moves in from there, on top of the rate's sign.
+		double				mAnchorTime;
+		int					mAnchorDirection;
+		Clock::time_point	mAnchorClock;
+		//! Direction of the last seek, -1 when it went backwards.
+		int					mSeekDirection;
+
+		PlaybackClockRef	mClock;
+	};
+
+} } // namespace cinder::hap
@@ -0,0 +1,89 @@
+/*
+ *  HapTripleBuffer.h
+ *
+ *  Wait-free single-producer/single-consumer hand-off of the latest value, used to pass decoded frames to the render thread.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace cinder { namespace hap {
+
+	struct HandoffStats {
+		HandoffStats() : mNumPublished( 0 ), mNumAcquired( 0 ), mNumOverwritten( 0 ), mNumLockContentions( 0 ) {}
+
+		//! Frames handed over by the producer.
+		uint64_t	mNumPublished;
+		//! Frames picked up by the consumer.
+		uint64_t	mNumAcquired;
+		//! Frames replaced by a newer one before the consumer picked them up.
+		uint64_t	mNumOverwritten;
+		//! Times a thread found the movie mutex already held and had to wait for it.
+		uint64_t	mNumLockContentions;
+	};
+
+	//! Three slots: the producer writes the back one, the consumer reads the front one, and the middle one is swapped
+	//! atomically between them. Neither side ever waits. publish() must only be called from one thread, and acquire() from one thread.
+	template<typename T>
+	class TripleBuffer {
+	public:
+		TripleBuffer() : mMiddle( 1 ), mBack( 0 ), mFront( 2 ), mNumPublished( 0 ), mNumAcquired( 0 ), mNumOverwritten( 0 ) {}
+
+		//! Producer side: makes \a value the latest one. Returns true if it replaced a value the consumer never acquired.
+		bool publish( T value )
+		{
+			mSlots[mBack] = std::move( value );
+			const uint8_t previous = mMiddle.exchange( mBack | kFresh, std::memory_order_acq_rel );
+			mBack = previous & kIndexMask;
+			mNumPublished.fetch_add( 1, std::memory_order_relaxed );
+			if( previous & kFresh ) {
+				mNumOverwritten.fetch_add( 1, std::memory_order_relaxed );
+				return true;
+			}
+			return false;
+		}
+
+		//! Consumer side: returns the latest published value, or the one returned last time when nothing new was published.
+		//! \a isNew, if given, tells which one it was.
+		const T& acquire( bool *isNew = nullptr )
+		{
+			if( isNew )
+				*isNew = false;
+			// Only the consumer clears kFresh, so it can't disappear between the load and the exchange
+			if( mMiddle.load( std::memory_order_relaxed ) & kFresh ) {
+				mFront = mMiddle.exchange( mFront, std::memory_order_acq_rel ) & kIndexMask;
+				mNumAcquired.fetch_add( 1, std::memory_order_relaxed );
+				if( isNew )
+					*isNew = true;
+			}
+			return mSlots[mFront];
+		}
+
+		//! Safe to call from any thread.
+		HandoffStats getStats() const
+		{
+			HandoffStats stats;
+			stats.mNumPublished = mNumPublished.load( std::memory_order_relaxed );
+			stats.mNumAcquired = mNumAcquired.load( std::memory_order_relaxed );
+			stats.mNumOverwritten = mNumOverwritten.load( std::memory_order_relaxed );
+			return stats;
+		}
+
+	private:
+		static const uint8_t kIndexMask = 0x3;
+		static const uint8_t kFresh = 0x4;
+
+		T						mSlots[3];
+		std::atomic<uint8_t>	mMiddle;
+		// Owned by the producer and the consumer respectively
+		uint8_t					mBack;
+		uint8_t					mFront;
+
+		std::atomic<uint64_t>	mNumPublished, mNumAcquired, mNumOverwritten;
+	};
+
+} } // namespace cinder::hap
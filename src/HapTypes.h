@@ -0,0 +1,81 @@
+/*
+ *  HapTypes.h
+ *
+ *  Four-character-codes shared by the portable (QuickTime-free) parts of Cinder-Hap2.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace cinder { namespace hap {
+
+	//! Sample description four-character-codes of the Hap codecs (see kHapCodecSubType in HapSupport.c).
+	enum CodecType : uint32_t {
+		CODEC_HAP		= 0x48617031, // 'Hap1'
+		CODEC_HAP_A		= 0x48617035, // 'Hap5'
+		CODEC_HAP_Q		= 0x48617059, // 'HapY'
+		CODEC_UNKNOWN	= 0
+	};
+
+	inline bool isHapCodec( uint32_t codecType )
+	{
+		return codecType == CODEC_HAP || codecType == CODEC_HAP_A || codecType == CODEC_HAP_Q;
+	}
+
+	//! Four-character-codes of the DXT payloads a Hap frame decodes to, same values as kHapPixelFormatType* in HapSupport.h.
+	enum PixelFormat : uint32_t {
+		PIXEL_FORMAT_RGB_DXT1		= 0x44587431, // 'DXt1'
+		PIXEL_FORMAT_RGBA_DXT5		= 0x44585435, // 'DXT5'
+		PIXEL_FORMAT_YCOCG_DXT5		= 0x44597435, // 'DYt5'
+		PIXEL_FORMAT_UNKNOWN		= 0
+	};
+
+	//! Returns the pixel format frames of \a codecType decode to, or PIXEL_FORMAT_UNKNOWN if it isn't a Hap codec.
+	inline PixelFormat getPixelFormatForCodec( uint32_t codecType )
+	{
+		switch( codecType ) {
+			case CODEC_HAP: return PIXEL_FORMAT_RGB_DXT1;
+			case CODEC_HAP_A: return PIXEL_FORMAT_RGBA_DXT5;
+			case CODEC_HAP_Q: return PIXEL_FORMAT_YCOCG_DXT5;
+			default: return PIXEL_FORMAT_UNKNOWN;
+		}
+	}
+
+	//! Returns the codec whose frames decode to \a pixelFormat, or CODEC_UNKNOWN.
+	inline CodecType getCodecForPixelFormat( uint32_t pixelFormat )
+	{
+		switch( pixelFormat ) {
+			case PIXEL_FORMAT_RGB_DXT1: return CODEC_HAP;
+			case PIXEL_FORMAT_RGBA_DXT5: return CODEC_HAP_A;
+			case PIXEL_FORMAT_YCOCG_DXT5: return CODEC_HAP_Q;
+			default: return CODEC_UNKNOWN;
+		}
+	}
+
+	//! Returns 4 for DXT1 and 8 for the DXT5 variants, 0 for unknown formats.
+	inline uint32_t getBitsPerPixel( uint32_t pixelFormat )
+	{
+		switch( pixelFormat ) {
+			case PIXEL_FORMAT_RGB_DXT1: return 4;
+			case PIXEL_FORMAT_RGBA_DXT5:
+			case PIXEL_FORMAT_YCOCG_DXT5: return 8;
+			default: return 0;
+		}
+	}
+
+	//! Returns the size in bytes of a DXT image, with dimensions rounded up to whole 4x4 blocks.
+	inline size_t getDxtImageSize( uint32_t pixelFormat, int32_t width, int32_t height )
+	{
+		return size_t( ( width + 3 ) & ~3 ) * size_t( ( height + 3 ) & ~3 ) * getBitsPerPixel( pixelFormat ) / 8;
+	}
+
+	//! Builds a four-character-code from its big-endian textual form, ie. makeFourCC( "moov" ).
+	inline uint32_t makeFourCC( const char *s )
+	{
+		return ( uint32_t( uint8_t( s[0] ) ) << 24 ) | ( uint32_t( uint8_t( s[1] ) ) << 16 ) | ( uint32_t( uint8_t( s[2] ) ) << 8 ) | uint32_t( uint8_t( s[3] ) );
+	}
+
+} } // namespace cinder::hap
@@ -20,6 +20,13 @@ extern "C" {
 #include "cinder/Color.h"
 #include "cinder/gl/Context.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <mutex>
+
 
 #if defined( CINDER_MAC )
 	#include <QTKit/QTKit.h>
@@ -53,36 +60,68 @@ extern "C" {
 
 namespace cinder { namespace qtime {
 
-	// Playback Framerate
-	uint32_t _FrameCount = 0;
-	uint32_t _FpsLastSampleFrame = 0;
-	double _FpsLastSampleTime = 0;
-	float _AverageFps = 0;
-	
-	void updateMovieFPS( long time, void *ptr )
-	{
-		double now = app::getElapsedSeconds();
-		if( now > _FpsLastSampleTime + app::App::get()->getFpsSampleInterval() ) {
-			//calculate average Fps over sample interval
-			uint32_t framesPassed = _FrameCount - _FpsLastSampleFrame;
-			_AverageFps = (float)(framesPassed / (now - _FpsLastSampleTime));
-			_FpsLastSampleTime = now;
-			_FpsLastSampleFrame = _FrameCount;
+	namespace {
+		typedef std::chrono::steady_clock Clock;
+		
+		// How far ahead of the playhead samples are paged in
+		const double kAdviseAheadSeconds = 0.5;
+		// How far ahead of the playhead samples are read in the background by default
+		const double kDefaultReadAheadSeconds = 0.5;
+		// How much of a loop's head is kept resident by default
+		const double kDefaultLoopCacheSeconds = 1.0;
+		// Longest gap between presentation times still taken as the display's refresh period
+		const double kMaxPresentationInterval = 0.25;
+		// How far QuickTime's audio may wander from the playback clock before it is put back in step
+		const double kMaxAudioDriftSeconds = 0.04;
+		
+		// Sidecar index settings, see MovieGlHap::setSidecarIndex()
+		std::mutex	sSidecarMutex;
+		bool		sSidecarEnabled = true;
+		fs::path	sSidecarDirectory;
+		
+		// Memory taken by resident samples, see MovieGlHap::setResidentMemoryBudget()
+		std::mutex	sResidentMutex;
+		size_t		sResidentBudget = std::numeric_limits<size_t>::max();
+		size_t		sResidentUsage = 0;
+		
+		double secondsSince( Clock::time_point start )
+		{
+			return std::chrono::duration<double>( Clock::now() - start ).count();
 		}
-		_FrameCount++;
-	}
-	
+	} // anonymous namespace
+
 	float MovieGlHap::getPlaybackFramerate() const
 	{
-		return _AverageFps;
+		return mObj->mStats.getFramerate();
 	}
 	
 	gl::GlslProgRef MovieGlHap::Obj::sHapQShader = nullptr;
 	
 	MovieGlHap::Obj::Obj()
 	: MovieBase::Obj()
-	, mDefaultShader( gl::getStockShader( gl::ShaderDef().texture() ) )
+	, mSampleIndex( std::numeric_limits<size_t>::max() )
+	, mPrerolledIndex( std::numeric_limits<size_t>::max() )
+	, mPrerollingIndex( std::numeric_limits<size_t>::max() )
+	, mLastPresentationTime( -1 )
+	, mPresentationInterval( 1.0 / 60.0 )
+	, mClockDrift( 0 )
+	, mQuickTimeRate( 1.0f )
+	, mAdvisedUntil( 0 )
+	, mReleasePlayedFrames( false )
+	, mUploadMode( hap::UploadMode::CLIENT_MEMORY )
+	, mUploadRingDepth( 3 )
+	, mSwapChainLength( 2 )
+	, mSwapFront( 0 )
+	, mNumSwapStalls( 0 )
+	, mNumLockContentions( 0 )
 	{
+		mDecoder.setThreadPool( hap::ThreadPool::getShared() );
+	}
+	
+	void MovieGlHap::Obj::ensureShaders()
+	{
+		if( ! mDefaultShader )
+			mDefaultShader = gl::getStockShader( gl::ShaderDef().texture() );
 		std::call_once( mHapQOnceFlag, []() {
 			MovieGlHap::Obj::sHapQShader = gl::GlslProg::create( app::loadResource(RES_HAP_VERT),  app::loadResource(RES_HAP_FRAG) );
 		} );
@@ -92,47 +131,177 @@ namespace cinder { namespace qtime {
 	{
 		// see note on prepareForDestruction()
 		prepareForDestruction();
-		mTexture.reset();
+		mUploader.reset();
+		mSwapChain.clear();
 	}
 	
 	
 	MovieGlHap::MovieGlHap( const MovieLoader &loader )
-	: MovieBase(), mObj( new Obj() )
+	: MovieBase(), mObj( new Obj() ), mCodec( Codec::UNSUPPORTED ), mReadAheadSeconds( kDefaultReadAheadSeconds ), mNativeDecode( false ),
+	  mLooping( false ), mLoopIn( 0 ), mLoopOut( -1 ), mLoopCacheFrames( std::numeric_limits<size_t>::max() ), mLoopCacheDecoded( false ),
+	  mResidentMode( hap::ResidentMode::NONE ), mResidentReserved( 0 )
 	{
 		MovieBase::initFromLoader( loader );
 		allocateVisualContext();
 	}
 	
 	MovieGlHap::MovieGlHap( const fs::path &path )
-	: MovieBase(), mObj( new Obj() )
+	: MovieGlHap( path, nullptr )
+	{
+	}
+	
+	MovieGlHap::MovieGlHap( const fs::path &path, OpenProgress *progress )
+	: MovieBase(), mObj( new Obj() ), mCodec( Codec::UNSUPPORTED ), mReadAheadSeconds( kDefaultReadAheadSeconds ), mNativeDecode( false ),
+	  mLooping( false ), mLoopIn( 0 ), mLoopOut( -1 ), mLoopCacheFrames( std::numeric_limits<size_t>::max() ), mLoopCacheDecoded( false ),
+	  mResidentMode( hap::ResidentMode::NONE ), mResidentReserved( 0 )
 	{
 		MovieBase::initFromPath( path );
+		if( progress ) {
+			progress->mProgress = 0.3f;
+			if( progress->isCancelled() )
+				return;
+		}
+		initSampleTable( [&] { return hap::MovieSource::create( path ); }, path );
+		if( progress ) {
+			progress->mProgress = 0.6f;
+			if( progress->isCancelled() )
+				return;
+		}
 		allocateVisualContext();
 	}
 	
+	std::future<MovieGlHapRef> MovieGlHap::createAsync( const fs::path &path, const OpenProgressRef &progress, hap::ResidentMode residentMode )
+	{
+		auto promise = std::make_shared<std::promise<MovieGlHapRef>>();
+		std::future<MovieGlHapRef> future = promise->get_future();
+		const OpenProgressRef state = progress ? progress : std::make_shared<OpenProgress>();
+		app::App *app = app::App::get();
+		
+		hap::ThreadPool::getShared()->submit( [promise, state, path, app, residentMode] {
+			// QuickTime only serves threads that entered it, and each movie only the thread it is attached to
+			::EnterMoviesOnThread( 0 );
+			MovieGlHapRef movie;
+			try {
+				if( ! state->isCancelled() )
+					movie = MovieGlHapRef( new MovieGlHap( path, state.get() ) );
+				if( movie && ! state->isCancelled() && residentMode != hap::ResidentMode::NONE ) {
+					movie->setResidentMode( residentMode );
+					state->mProgress = 0.8f;
+				}
+				if( movie && ! state->isCancelled() ) {
+					movie->prerollFirstFrame();
+					state->mProgress = 0.9f;
+				}
+				if( state->isCancelled() )
+					movie.reset();
+				if( movie )
+					::DetachMovieFromCurrentThread( movie->getObj()->mMovie );
+			}
+			catch( ... ) {
+				::ExitMoviesOnThread();
+				promise->set_exception( std::current_exception() );
+				return;
+			}
+			::ExitMoviesOnThread();
+			
+			// Handed over on the main thread, so the movie is attached there before anyone can use it
+			auto deliver = [promise, state, movie] {
+				if( movie )
+					::AttachMovieToCurrentThread( movie->getObj()->mMovie );
+				state->mProgress = 1.0f;
+				promise->set_value( state->isCancelled() ? MovieGlHapRef() : movie );
+			};
+			if( app )
+				app->dispatchAsync( deliver );
+			else
+				deliver();
+		}, hap::TaskPriority::PREROLL );
+		
+		return future;
+	}
+	
 	MovieGlHap::MovieGlHap( const void *data, size_t dataSize, const std::string &fileNameHint, const std::string &mimeTypeHint )
-	: MovieBase(), mObj( new Obj() )
+	: MovieBase(), mObj( new Obj() ), mCodec( Codec::UNSUPPORTED ), mReadAheadSeconds( kDefaultReadAheadSeconds ), mNativeDecode( false ),
+	  mLooping( false ), mLoopIn( 0 ), mLoopOut( -1 ), mLoopCacheFrames( std::numeric_limits<size_t>::max() ), mLoopCacheDecoded( false ),
+	  mResidentMode( hap::ResidentMode::NONE ), mResidentReserved( 0 )
 	{
 		MovieBase::initFromMemory( data, dataSize, fileNameHint, mimeTypeHint );
+		initSampleTable( [&] { return hap::MovieSource::create( data, dataSize ); } );
 		allocateVisualContext();
 	}
 	
 	MovieGlHap::MovieGlHap( DataSourceRef dataSource, const std::string mimeTypeHint )
-	: MovieBase(), mObj( new Obj() )
+	: MovieBase(), mObj( new Obj() ), mCodec( Codec::UNSUPPORTED ), mReadAheadSeconds( kDefaultReadAheadSeconds ), mNativeDecode( false ),
+	  mLooping( false ), mLoopIn( 0 ), mLoopOut( -1 ), mLoopCacheFrames( std::numeric_limits<size_t>::max() ), mLoopCacheDecoded( false ),
+	  mResidentMode( hap::ResidentMode::NONE ), mResidentReserved( 0 )
 	{
 		MovieBase::initFromDataSource( dataSource, mimeTypeHint );
+		initSampleTable( [&] { return hap::MovieSource::create( dataSource ); } );
 		allocateVisualContext();
 	}
 	
 	MovieGlHap::~MovieGlHap()
 	{
 		CI_LOG_I( "Detroying movie hap." );
+		finishPreroll();
+		releaseResidentSamples();
+	}
+	
+	void MovieGlHap::setSidecarIndex( bool enabled, const fs::path &directory )
+	{
+		std::lock_guard<std::mutex> lock( sSidecarMutex );
+		sSidecarEnabled = enabled;
+		sSidecarDirectory = directory;
+	}
+	
+	void MovieGlHap::initSampleTable( const std::function<hap::MovieSourceRef ()> &createSource, const fs::path &path )
+	{
+		bool sidecarEnabled;
+		fs::path sidecarDirectory;
+		{
+			std::lock_guard<std::mutex> lock( sSidecarMutex );
+			sidecarEnabled = sSidecarEnabled;
+			sidecarDirectory = sSidecarDirectory;
+		}
+		
+		// Parsing only reads the atom headers and the movie atom, a valid sidecar spares even that and building the tables
+		try {
+			if( sidecarEnabled && ! path.empty() )
+				mSampleTable = hap::SampleTable::createIndexed( createSource(), path, hap::SampleTable::getIndexPath( path, sidecarDirectory ) );
+			else
+				mSampleTable = hap::SampleTable::create( createSource() );
+		}
+		catch( const std::exception &exc ) {
+			CI_LOG_W( "HAP WARNING :: couldn't index movie natively, using QuickTime track info: " << exc.what() );
+			mSampleTable.reset();
+		}
+	}
+	
+	static MovieGlHap::Codec codecFromType( uint32_t codecType )
+	{
+		switch( codecType ) {
+			case hap::CODEC_HAP: return MovieGlHap::Codec::HAP;
+			case hap::CODEC_HAP_A: return MovieGlHap::Codec::HAP_A;
+			case hap::CODEC_HAP_Q: return MovieGlHap::Codec::HAP_Q;
+			default: return MovieGlHap::Codec::UNSUPPORTED;
+		}
 	}
 
 	void MovieGlHap::allocateVisualContext()
 	{
+		// Decode natively whenever we could index a Hap track; QuickTime then only provides the clock and audio
+		mNativeDecode = mSampleTable && mSampleTable->isHap();
+		if( mNativeDecode ) {
+			mReadAhead = hap::ReadAhead::create( mSampleTable, mReadAheadSeconds );
+			mTransport.setDuration( mSampleTable->getDurationSeconds() );
+		}
+		else {
+			// Only needed to follow a playback clock
+			mTransport.setDuration( getDuration() );
+		}
+		
 		// Load HAP Movie
-		if( HapQTQuickTimeMovieHasHapTrackPlayable( getObj()->mMovie ) )
+		if( ! mNativeDecode && HapQTQuickTimeMovieHasHapTrackPlayable( getObj()->mMovie ) )
 		{
 			// QT Visual Context attributes
 			OSStatus err = noErr;
@@ -158,31 +327,27 @@ namespace cinder { namespace qtime {
 			}
 		}
 		
-		// Get codec name
-		for (long i = 1; i <= GetMovieTrackCount(getObj()->mMovie); i++) {
-            Track track = GetMovieIndTrack(getObj()->mMovie, i);
-            Media media = GetTrackMedia(track);
-            OSType mediaType;
-            GetMediaHandlerDescription(media, &mediaType, NULL, NULL);
-            if (mediaType == VideoMediaType)
-            {
-                // Get the codec-type of this track
-                ImageDescriptionHandle imageDescription = (ImageDescriptionHandle)NewHandle(0); // GetMediaSampleDescription will resize it
-                GetMediaSampleDescription(media, 1, (SampleDescriptionHandle)imageDescription);
-                OSType codecType = (*imageDescription)->cType;
-                DisposeHandle((Handle)imageDescription);
-                
-                switch (codecType) {
-                    case 'Hap1': mCodec = Codec::HAP; break;
-                    case 'Hap5': mCodec = Codec::HAP_A; break;
-                    case 'HapY': mCodec = Codec::HAP_Q; break;
-                    default: mCodec = Codec::UNSUPPORTED; break;
+		// Get codec name, from the native index when we have one
+		if( mSampleTable ) {
+			mCodec = codecFromType( mSampleTable->getCodecType() );
+		}
+		else {
+			for( long i = 1; i <= GetMovieTrackCount( getObj()->mMovie ); i++ ) {
+				Track track = GetMovieIndTrack( getObj()->mMovie, i );
+				Media media = GetTrackMedia( track );
+				OSType mediaType;
+				GetMediaHandlerDescription( media, &mediaType, NULL, NULL );
+				if( mediaType == VideoMediaType ) {
+					// Get the codec-type of this track
+					ImageDescriptionHandle imageDescription = (ImageDescriptionHandle)NewHandle( 0 ); // GetMediaSampleDescription will resize it
+					GetMediaSampleDescription( media, 1, (SampleDescriptionHandle)imageDescription );
+					OSType codecType = (*imageDescription)->cType;
+					DisposeHandle( (Handle)imageDescription );
+					
+					mCodec = codecFromType( codecType );
 				}
-            }
-        }
-
-		// Set framerate callback
-		this->setNewFrameCallback( updateMovieFPS, (void*)this );
+			}
+		}
 	}
 	
 //#if defined( CINDER_MAC )
@@ -213,63 +378,86 @@ namespace cinder { namespace qtime {
 			GLuint roundedWidth = width + extraRight;
 			GLuint roundedHeight = height + extraBottom;
 			
-			// Valid DXT will be a multiple of 4 wide and high
-			CI_ASSERT( !(roundedWidth % 4 != 0 || roundedHeight % 4 != 0) );
 			OSType newPixelFormat = ::CVPixelBufferGetPixelFormatType( cvImage );
-			GLenum internalFormat;
-			unsigned int bitsPerPixel;
-			switch (newPixelFormat) {
-				case kHapPixelFormatTypeRGB_DXT1:
-					internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
-					bitsPerPixel = 4;
-					break;
-				case kHapPixelFormatTypeRGBA_DXT5:
-				case kHapPixelFormatTypeYCoCg_DXT5:
-					internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-					bitsPerPixel = 8;
-					break;
-				default:
-					CI_ASSERT_MSG( false, "We don't support non-DXT pixel buffers." );
-					return;
-					break;
-			}
+			size_t actualBufferSize = ::CVPixelBufferGetDataSize( cvImage );
+			GLvoid *baseAddress = ::CVPixelBufferGetBaseAddress( cvImage );
+			
+			mStats.frameDecoded();
+			uploadFrame( newPixelFormat, width, height, roundedWidth, roundedHeight, baseAddress, actualBufferSize );
+		}
+		
+		::CVPixelBufferUnlockBaseAddress( cvImage, kCVPixelBufferLock_ReadOnly );
+		::CVPixelBufferRelease(cvImage);
+	}
+	
+	void MovieGlHap::Obj::uploadFrame( uint32_t pixelFormat, GLuint width, GLuint height, GLuint roundedWidth, GLuint roundedHeight, const GLvoid *data, size_t dataSize )
+	{
+		// Valid DXT will be a multiple of 4 wide and high
+		CI_ASSERT( !(roundedWidth % 4 != 0 || roundedHeight % 4 != 0) );
+		GLenum internalFormat;
+		unsigned int bitsPerPixel;
+		switch (pixelFormat) {
+			case kHapPixelFormatTypeRGB_DXT1:
+				internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+				bitsPerPixel = 4;
+				break;
+			case kHapPixelFormatTypeRGBA_DXT5:
+			case kHapPixelFormatTypeYCoCg_DXT5:
+				internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+				bitsPerPixel = 8;
+				break;
+			default:
+				CI_ASSERT_MSG( false, "We don't support non-DXT pixel buffers." );
+				return;
+				break;
+		}
+		
+		// Ignore the value for CVPixelBufferGetBytesPerRow()
+		size_t	bytesPerRow = (roundedWidth * bitsPerPixel) / 8;
+		GLsizei	dataLength = bytesPerRow * roundedHeight; // usually not the full length of the buffer
+		
+		// Check the buffer is as large as we expect it to be
+		CI_ASSERT( dataLength <= dataSize );
+		
+		const Clock::time_point uploadStart = Clock::now();
+		
+		// Upload into the texture after the front one, which draws issued since the last frame may still sample
+		const size_t back = acquireBackTexture();
+		gl::Texture2dRef &texture = mSwapChain[back].mTexture;
+		// Textures adopted from another movie are kept when they match
+		if( texture && ( texture->getWidth() != (GLint)width || texture->getHeight() != (GLint)height || texture->getInternalFormat() != (GLint)internalFormat ) )
+			texture.reset();
+		if ( !texture ) {
+			// On NVIDIA hardware there is a massive slowdown if DXT textures aren't POT-dimensioned, so we use POT-dimensioned backing
+			/*GLuint backingWidth = 1;
+			while (backingWidth < roundedWidth) backingWidth <<= 1;
 			
-			// Ignore the value for CVPixelBufferGetBytesPerRow()
-			size_t	bytesPerRow = (roundedWidth * bitsPerPixel) / 8;
-			GLsizei	dataLength = bytesPerRow * roundedHeight; // usually not the full length of the buffer
-			size_t	actualBufferSize = ::CVPixelBufferGetDataSize( cvImage );
+			GLuint backingHeight = 1;
+			while (backingHeight < roundedHeight) backingHeight <<= 1;*/
 			
-			// Check the buffer is as large as we expect it to be
-			CI_ASSERT( dataLength < actualBufferSize );
+			// We allocate the texture with no pixel data, then use CompressedTexSubImage to update the content region
+			gl::Texture2d::Format format;
+			format.wrap( GL_CLAMP_TO_EDGE ).magFilter( GL_LINEAR ).minFilter( GL_LINEAR ).internalFormat( internalFormat ).dataType( GL_UNSIGNED_INT_8_8_8_8_REV ).immutableStorage();// .pixelDataFormat( GL_BGRA );
+			// BL mTexture = gl::Texture2d::create(backingWidth, backingHeight, format);
+			texture = gl::Texture2d::create(width, height, format);
+			texture->setCleanBounds(Area(0, 0, width, height));
+			
+			CI_LOG_I( "Created texture." );
 			
-			GLvoid *baseAddress = ::CVPixelBufferGetBaseAddress( cvImage );
-						
-			if ( !mTexture ) {
-				// On NVIDIA hardware there is a massive slowdown if DXT textures aren't POT-dimensioned, so we use POT-dimensioned backing
-				/*GLuint backingWidth = 1;
-				while (backingWidth < roundedWidth) backingWidth <<= 1;
-				
-				GLuint backingHeight = 1;
-				while (backingHeight < roundedHeight) backingHeight <<= 1;*/
-				
-				// We allocate the texture with no pixel data, then use CompressedTexSubImage to update the content region
-				gl::Texture2d::Format format;
-				format.wrap( GL_CLAMP_TO_EDGE ).magFilter( GL_LINEAR ).minFilter( GL_LINEAR ).internalFormat( internalFormat ).dataType( GL_UNSIGNED_INT_8_8_8_8_REV ).immutableStorage();// .pixelDataFormat( GL_BGRA );
-				// BL mTexture = gl::Texture2d::create(backingWidth, backingHeight, format);
-				mTexture = gl::Texture2d::create(width, height, format);
-				mTexture->setCleanBounds(Area(0, 0, width, height));
-				
-				CI_LOG_I( "Created texture." );
-				
 #if defined( CINDER_MAC )
-				/// There is no default format GL_TEXTURE_STORAGE_HINT_APPLE param so we fill it manually
-				gl::ScopedTextureBind bind( mTexture->getTarget(), mTexture->getId() );
-				glTexParameteri( mTexture->getTarget(), GL_TEXTURE_STORAGE_HINT_APPLE, GL_STORAGE_SHARED_APPLE );
+			/// There is no default format GL_TEXTURE_STORAGE_HINT_APPLE param so we fill it manually
+			gl::ScopedTextureBind bind( texture->getTarget(), texture->getId() );
+			glTexParameteri( texture->getTarget(), GL_TEXTURE_STORAGE_HINT_APPLE, GL_STORAGE_SHARED_APPLE );
 #endif
-			}
-			gl::ScopedTextureBind bind( mTexture );
+		}
+		// Stream through pixel-unpack buffers so the driver doesn't copy client memory synchronously
+		if( ensureUploader() ) {
+			mUploader->upload( texture, roundedWidth, roundedHeight, data, dataLength );
+		}
+		else {
+			gl::ScopedTextureBind bind( texture );
 #if defined( CINDER_MAC )
-			glTextureRangeAPPLE( mTexture->getTarget(), dataLength, baseAddress );
+			glTextureRangeAPPLE( texture->getTarget(), dataLength, (GLvoid*)data );
 			/* WARNING: Even though it is present here:
 			 * https://github.com/Vidvox/hap-quicktime-playback-demo/blob/master/HapQuickTimePlayback/HapPixelBufferTexture.m#L186
 			 * the following call does not appear necessary. Furthermore, it corrupts display
@@ -277,52 +465,793 @@ namespace cinder { namespace qtime {
 			 */
 //			glPixelStorei( GL_UNPACK_CLIENT_STORAGE_APPLE, 1 );
 #endif
-			glCompressedTexSubImage2D(mTexture->getTarget(),
+			glCompressedTexSubImage2D(texture->getTarget(),
 									  0,
 									  0,
 									  0,
 									  roundedWidth,
 									  roundedHeight,
-									  mTexture->getInternalFormat(),
+									  texture->getInternalFormat(),
 									  dataLength,
-									  baseAddress);
+									  data);
 		}
 		
-		::CVPixelBufferUnlockBaseAddress( cvImage, kCVPixelBufferLock_ReadOnly );
-		::CVPixelBufferRelease(cvImage);
+		swapTextures( back );
+		
+		mStats.frameUploaded();
+		mStats.recordLatency( hap::PlaybackStats::STAGE_UPLOAD, secondsSince( uploadStart ) );
 	}
 	
-	gl::TextureRef MovieGlHap::getTexture()
+	size_t MovieGlHap::Obj::acquireBackTexture()
+	{
+		if( mSwapChain.size() != mSwapChainLength ) {
+			// The current front texture stays alive in mFrontTexture until the next swap
+			mSwapChain.clear();
+			mSwapChain.resize( mSwapChainLength );
+			mSwapFront = mSwapChainLength - 1;
+		}
+		
+		const size_t back = ( mSwapFront + 1 ) % mSwapChain.size();
+		SwapTexture &target = mSwapChain[back];
+		if( target.mReleaseFence ) {
+			GLenum status = target.mReleaseFence->clientWaitSync( GL_SYNC_FLUSH_COMMANDS_BIT, 0 );
+			if( status == GL_TIMEOUT_EXPIRED ) {
+				++mNumSwapStalls;
+				do {
+					status = target.mReleaseFence->clientWaitSync( 0, 1000000 );
+				} while( status == GL_TIMEOUT_EXPIRED );
+			}
+			target.mReleaseFence.reset();
+		}
+		return back;
+	}
+	
+	void MovieGlHap::Obj::swapTextures( size_t back )
 	{
-		updateFrame();
+		// Commands already issued against the old front texture complete before this fence signals
+		if( mSwapChain.size() > 1 && mSwapChain[mSwapFront].mTexture )
+			mSwapChain[mSwapFront].mReleaseFence = gl::Sync::create();
+		mSwapFront = back;
+		if( mFrontTexture.publish( mSwapChain[back].mTexture ) )
+			mStats.framesDropped( 1 );
+	}
+	
+	void MovieGlHap::Obj::lockCounted()
+	{
+		if( ! mMutex.try_lock() ) {
+			++mNumLockContentions;
+			mMutex.lock();
+		}
+	}
+	
+	bool MovieGlHap::Obj::ensureUploader()
+	{
+		if( mUploadMode == hap::UploadMode::CLIENT_MEMORY )
+			return false;
+		if( ! mUploader || mUploader->getRequestedMode() != mUploadMode || mUploader->getRingDepth() != mUploadRingDepth )
+			mUploader = hap::TextureUploader::create( mUploadMode, mUploadRingDepth );
+		return true;
+	}
+	
+	void MovieGlHap::updateTexture()
+	{
+		followClock();
+		if( mNativeDecode )
+			updateNativeFrame();
+		else
+			updateFrame();
+	}
+	
+	void MovieGlHap::updateNativeFrame()
+	{
+		if( mSampleTable->getNumSamples() == 0 )
+			return;
 		
-		mObj->lock();
-		auto texture = mObj->mTexture;
+		// The transport is the clock, QuickTime only plays the audio
+		const double time = mTransport.getTime();
+		presentSample( getTransportSampleIndex() );
+		recordClockDrift( time );
+	}
+	
+	void MovieGlHap::updateTextureForTime( double presentationTime )
+	{
+		if( ! mNativeDecode ) {
+			updateTexture();
+			return;
+		}
+		if( mSampleTable->getNumSamples() == 0 )
+			return;
+		
+		// Successive presentation times give the refresh period, ignoring gaps where the app stalled or stopped drawing
+		const double interval = presentationTime - mObj->mLastPresentationTime;
+		if( mObj->mLastPresentationTime >= 0 && interval > 0 && interval < kMaxPresentationInterval )
+			mObj->mPresentationInterval = interval;
+		mObj->mLastPresentationTime = presentationTime;
+		
+		followClock();
+		const double lead = presentationTime - app::getElapsedSeconds();
+		presentSample( getTransportSampleIndex( lead ) );
+		recordClockDrift( mTransport.getTimeIn( lead ) );
+		
+		// The frame due at the following vsync decodes while this one is shown, so the next call only uploads it
+		const size_t next = getTransportSampleIndex( lead + mObj->mPresentationInterval );
+		if( next != mObj->mSampleIndex )
+			prerollSample( next );
+	}
+	
+	void MovieGlHap::presentSample( size_t index )
+	{
+		finishPreroll();
+		const size_t previous = mObj->mSampleIndex;
+		if( index == previous )
+			return;
+		
+		const GLuint width = mSampleTable->getWidth();
+		const GLuint height = mSampleTable->getHeight();
+		const size_t capacity = hap::getDxtImageSize( hap::PIXEL_FORMAT_RGBA_DXT5, width, height );
+		
+		uint8_t *output = nullptr;
+		hap::FrameInfo info;
+		const bool prerolled = index == mObj->mPrerolledIndex;
+		mObj->mPrerolledIndex = std::numeric_limits<size_t>::max();
+		if( prerolled ) {
+			// Decoded ahead, while the movie was opening or the previous frame was shown, only the upload is left
+			output = mObj->mFrameBuffer.data();
+			info = mObj->mPrerolledInfo;
+		}
+		else {
+			// With a persistently mapped uploader the chunks decompress straight into GPU-visible memory
+			mObj->lockCounted();
+			if( mObj->ensureUploader() )
+				output = (uint8_t*)mObj->mUploader->acquireWritePointer( capacity );
+			mObj->unlock();
+			if( ! output ) {
+				mObj->mFrameBuffer.resize( capacity );
+				output = mObj->mFrameBuffer.data();
+			}
+			if( ! decodeSample( index, output, capacity, &info, getPlayheadVelocity() ) )
+				return;
+		}
+		// Samples the clock jumped over while playing never got decoded. Above normal speed they are skipped on purpose
+		if( mTransport.isPlaying() && std::abs( mTransport.getRate() ) <= 1 && previous != std::numeric_limits<size_t>::max() ) {
+			if( mTransport.getDirection() > 0 && previous < index )
+				mObj->mStats.framesDropped( index - previous - 1 );
+			else if( mTransport.getDirection() < 0 && previous > index )
+				mObj->mStats.framesDropped( previous - index - 1 );
+		}
+		
+		mObj->lockCounted();
+		mObj->uploadFrame( info.mPixelFormat, width, height, ( width + 3 ) & ~3, ( height + 3 ) & ~3, output, info.mDecodedSize );
 		mObj->unlock();
 		
+		mObj->mSampleIndex = index;
+	}
+	
+	bool MovieGlHap::decodeSample( size_t index, uint8_t *output, size_t capacity, hap::FrameInfo *info, double velocity )
+	{
+		// Samples come from the resident samples or the loop cache, the read-ahead window, or in place from mapped and in-memory
+		// sources, or are read into mSampleBuffer
+		const hap::MovieSourceRef &source = mSampleTable->getSource();
+		const hap::SampleTable::Sample &sample = mSampleTable->getSample( index );
+		std::shared_ptr<const uint8_t> resident;
+		if( mReadAhead ) {
+			mReadAhead->setPlayhead( index, velocity );
+			resident = mReadAhead->getSample( index );
+		}
+		
+		const uint8_t *frame = nullptr;
+		const hap::FrameCacheRef &cache = mResidentCache ? mResidentCache : mLoopCache;
+		if( cache ) {
+			// Decoded frames only need copying to the upload buffer
+			const uint8_t *decoded = cache->getFrame( index, info );
+			if( decoded && info->mDecodedSize <= capacity ) {
+				std::memcpy( output, decoded, info->mDecodedSize );
+				mObj->mStats.frameDecoded();
+				return true;
+			}
+			size_t size;
+			frame = cache->getSample( index, &size );
+		}
+		if( ! frame )
+			frame = resident ? resident.get() : source->getPointer( sample.mOffset, sample.mSize );
+		if( ! frame ) {
+			mObj->mSampleBuffer.resize( sample.mSize );
+			const Clock::time_point readStart = Clock::now();
+			if( source->read( sample.mOffset, mObj->mSampleBuffer.data(), sample.mSize ) != sample.mSize ) {
+				CI_LOG_E( "HAP ERROR :: couldn't read sample " << index << "." );
+				return false;
+			}
+			mObj->mStats.recordLatency( hap::PlaybackStats::STAGE_READ, secondsSince( readStart ) );
+			frame = mObj->mSampleBuffer.data();
+		}
+		if( ! mResidentCache )
+			adviseSource( index, velocity );
+		
+		hap::DecodeResult result = mObj->mDecoder.decode( frame, sample.mSize, output, capacity, info );
+		if( result != hap::DecodeResult::SUCCESS ) {
+			CI_LOG_E( "HAP ERROR :: couldn't decode sample " << index << ": " << hap::toString( result ) << "." );
+			return false;
+		}
+		if( info->mDecodedSize < hap::getDxtImageSize( info->mPixelFormat, mSampleTable->getWidth(), mSampleTable->getHeight() ) ) {
+			CI_LOG_E( "HAP ERROR :: sample " << index << " is smaller than the track dimensions." );
+			return false;
+		}
+		mObj->mStats.frameDecoded();
+		mObj->mStats.recordLatency( hap::PlaybackStats::STAGE_DECOMPRESS, mObj->mDecoder.getLastDecodeSeconds() );
+		return true;
+	}
+	
+	void MovieGlHap::prerollFirstFrame()
+	{
+		if( ! mNativeDecode || mSampleTable->getNumSamples() == 0 )
+			return;
+		
+		const size_t index = getTransportSampleIndex();
+		mObj->mFrameBuffer.resize( hap::getDxtImageSize( hap::PIXEL_FORMAT_RGBA_DXT5, mSampleTable->getWidth(), mSampleTable->getHeight() ) );
+		if( decodeSample( index, mObj->mFrameBuffer.data(), mObj->mFrameBuffer.size(), &mObj->mPrerolledInfo, getPlayheadVelocity() ) )
+			mObj->mPrerolledIndex = index;
+	}
+	
+	void MovieGlHap::prerollSample( size_t index )
+	{
+		finishPreroll();
+		if( index == mObj->mPrerolledIndex )
+			return;
+		
+		// Only this task touches the decode path until finishPreroll() collects it
+		mObj->mPrerolledIndex = std::numeric_limits<size_t>::max();
+		mObj->mFrameBuffer.resize( hap::getDxtImageSize( hap::PIXEL_FORMAT_RGBA_DXT5, mSampleTable->getWidth(), mSampleTable->getHeight() ) );
+		auto promise = std::make_shared<std::promise<bool>>();
+		mObj->mPrerolling = promise->get_future();
+		mObj->mPrerollingIndex = index;
+		const double velocity = getPlayheadVelocity();
+		hap::ThreadPool::getShared()->submit( [this, promise, index, velocity] {
+			bool decoded = false;
+			try {
+				decoded = decodeSample( index, mObj->mFrameBuffer.data(), mObj->mFrameBuffer.size(), &mObj->mPrerolledInfo, velocity );
+			}
+			catch( const std::exception &exc ) {
+				CI_LOG_E( "HAP ERROR :: couldn't decode sample " << index << " ahead: " << exc.what() );
+			}
+			promise->set_value( decoded );
+		}, mObj->mDecoder.getPriority() );
+	}
+	
+	void MovieGlHap::finishPreroll() const
+	{
+		if( ! mObj->mPrerolling.valid() )
+			return;
+		if( mObj->mPrerolling.get() )
+			mObj->mPrerolledIndex = mObj->mPrerollingIndex;
+		mObj->mPrerollingIndex = std::numeric_limits<size_t>::max();
+	}
+	
+	double MovieGlHap::getPlayheadVelocity() const
+	{
+		// Scrubbing reads around the playhead at normal speed, in the direction of the last seek
+		const double speed = mTransport.isPlaying() ? std::abs( mTransport.getRate() ) : 1.0;
+		return speed * mTransport.getDirection();
+	}
+	
+	void MovieGlHap::play()
+	{
+		mTransport.play();
+		MovieBase::play();
+		if( mTransport.getRate() != 1 )
+			MovieBase::setRate( (float)mTransport.getRate() );
+	}
+	
+	void MovieGlHap::stop()
+	{
+		mTransport.stop();
+		MovieBase::stop();
+	}
+	
+	bool MovieGlHap::isPlaying() const
+	{
+		return mNativeDecode ? mTransport.isPlaying() : MovieBase::isPlaying();
+	}
+	
+	bool MovieGlHap::isDone() const
+	{
+		return mNativeDecode ? mTransport.isDone() : MovieBase::isDone();
+	}
+	
+	void MovieGlHap::setRate( float rate )
+	{
+		// QuickTime starts playing on any rate but 0, so it only hears about it while playing
+		const bool reversed = ( rate < 0 ) != ( mTransport.getRate() < 0 );
+		mTransport.setRate( rate );
+		if( mTransport.isPlaying() || ! mNativeDecode )
+			MovieBase::setRate( rate );
+		if( reversed )
+			updateLoopCache();
+	}
+	
+	float MovieGlHap::getCurrentTime() const
+	{
+		return mNativeDecode ? (float)mTransport.getTime() : MovieBase::getCurrentTime();
+	}
+	
+	void MovieGlHap::seekTransport( double seconds )
+	{
+		mTransport.seek( seconds );
+		MovieBase::seekToTime( (float)mTransport.getTime() );
+	}
+	
+	void MovieGlHap::seekToTime( float seconds )
+	{
+		if( mNativeDecode )
+			seekTransport( seconds );
+		else
+			MovieBase::seekToTime( seconds );
+	}
+	
+	void MovieGlHap::seekToFrame( int frame )
+	{
+		if( ! mNativeDecode ) {
+			MovieBase::seekToFrame( frame );
+			return;
+		}
+		if( mSampleTable->getNumSamples() == 0 )
+			return;
+		// Straight to the sample's own timestamp, so the frame shown is exactly the one asked for
+		const size_t index = std::min<size_t>( std::max( frame, 0 ), mSampleTable->getNumSamples() - 1 );
+		seekTransport( mSampleTable->getSampleSeconds( index ) );
+	}
+	
+	void MovieGlHap::seekToStart()
+	{
+		if( mNativeDecode )
+			seekTransport( mTransport.getSegmentIn() );
+		else
+			MovieBase::seekToStart();
+	}
+	
+	void MovieGlHap::seekToEnd()
+	{
+		if( ! mNativeDecode ) {
+			MovieBase::seekToEnd();
+			return;
+		}
+		if( mSampleTable->getNumSamples() == 0 )
+			return;
+		// To the start of the segment's last sample, since a looping transport folds the out point back onto the in point
+		const double out = mTransport.getSegmentOut();
+		size_t index = mSampleTable->getSampleIndexForSeconds( out );
+		if( index > 0 && mSampleTable->getSampleSeconds( index ) >= out )
+			--index;
+		seekTransport( std::max( mSampleTable->getSampleSeconds( index ), mTransport.getSegmentIn() ) );
+	}
+	
+	void MovieGlHap::stepForward()
+	{
+		if( mNativeDecode )
+			seekToFrame( int( getTransportSampleIndex() + 1 ) );
+		else
+			MovieBase::stepForward();
+	}
+	
+	void MovieGlHap::stepBackward()
+	{
+		if( mNativeDecode )
+			seekToFrame( int( getTransportSampleIndex() ) - 1 );
+		else
+			MovieBase::stepBackward();
+	}
+	
+	size_t MovieGlHap::getCurrentFrameIndex() const
+	{
+		return mNativeDecode ? getTransportSampleIndex() : 0;
+	}
+	
+	void MovieGlHap::setPlaybackClock( const hap::PlaybackClockRef &clock )
+	{
+		mTransport.setClock( clock );
+		mObj->mQuickTimeRate = (float)mTransport.getRate();
+	}
+	
+	double MovieGlHap::getAudioDrift() const
+	{
+		return mNativeDecode || mTransport.getClock() ? MovieBase::getCurrentTime() - mTransport.getTime() : 0.0;
+	}
+	
+	void MovieGlHap::followClock()
+	{
+		if( ! mTransport.getClock() )
+			return;
+		
+		// Other followers start, stop and change the rate of the clock without this movie's QuickTime hearing about it
+		const bool playing = mTransport.isPlaying();
+		const float rate = (float)mTransport.getRate();
+		if( playing != MovieBase::isPlaying() ) {
+			if( playing ) {
+				MovieBase::seekToTime( (float)mTransport.getTime() );
+				MovieBase::play();
+				MovieBase::setRate( rate );
+				mObj->mQuickTimeRate = rate;
+			}
+			else {
+				MovieBase::stop();
+			}
+		}
+		else if( playing && rate != mObj->mQuickTimeRate ) {
+			MovieBase::setRate( rate );
+			mObj->mQuickTimeRate = rate;
+		}
+		
+		// Audio keeps its own clock, a seek now and then brings it back to the frames
+		if( playing && std::abs( getAudioDrift() ) > kMaxAudioDriftSeconds )
+			MovieBase::seekToTime( (float)mTransport.getTime() );
+	}
+	
+	void MovieGlHap::recordClockDrift( double time )
+	{
+		// Positive when the frame on screen lags behind the position, negative when it is ahead
+		double drift = 0;
+		const size_t index = mObj->mSampleIndex;
+		if( index < mSampleTable->getNumSamples() ) {
+			const double start = mSampleTable->getSampleSeconds( index );
+			const double end = start + mSampleTable->getSample( index ).mDuration / (double)mSampleTable->getTimeScale();
+			if( time < start )
+				drift = time - start;
+			else if( time > end )
+				drift = time - end;
+		}
+		mObj->mClockDrift = drift;
+		if( const hap::PlaybackClockRef &clock = mTransport.getClock() )
+			clock->recordDrift( drift );
+	}
+	
+	size_t MovieGlHap::getTransportSampleIndex( double secondsFromNow ) const
+	{
+		// The segment's out point is where its last sample ends, the sample starting there lies outside of it
+		const double time = mTransport.getTimeIn( secondsFromNow );
+		size_t index = mSampleTable->getSampleIndexForSeconds( time );
+		if( index > 0 && time >= mTransport.getSegmentOut() && mSampleTable->getSampleSeconds( index ) >= mTransport.getSegmentOut() )
+			--index;
+		return index;
+	}
+	
+	void MovieGlHap::setLoop( bool loop, bool palindrome )
+	{
+		MovieBase::setLoop( loop, palindrome );
+		mTransport.setLoopMode( loop ? ( palindrome ? hap::LoopMode::BOUNCE : hap::LoopMode::LOOP ) : hap::LoopMode::NONE );
+		mLooping = loop;
+		updateLoopCache();
+	}
+	
+	void MovieGlHap::setLoopPoints( double inSeconds, double outSeconds )
+	{
+		// The transport loops over the segment, QuickTime over its active segment
+		mLoopIn = std::max( inSeconds, 0.0 );
+		mLoopOut = std::max( outSeconds, mLoopIn );
+		mTransport.setSegment( mLoopIn, mLoopOut );
+		setActiveSegment( (float)mLoopIn, (float)( mLoopOut - mLoopIn ) );
+		updateLoopCache();
+	}
+	
+	void MovieGlHap::clearLoopPoints()
+	{
+		mLoopIn = 0;
+		mLoopOut = -1;
+		mTransport.resetSegment();
+		resetActiveSegment();
+		updateLoopCache();
+	}
+	
+	void MovieGlHap::setLoopCache( size_t numFrames, bool decoded )
+	{
+		mLoopCacheFrames = numFrames;
+		mLoopCacheDecoded = decoded;
+		updateLoopCache();
+	}
+	
+	void MovieGlHap::updateLoopCache()
+	{
+		finishPreroll();
+		size_t numFrames = mLoopCacheFrames;
+		if( numFrames == std::numeric_limits<size_t>::max() )
+			numFrames = mSampleTable ? std::max<size_t>( size_t( mSampleTable->getFramerate() * kDefaultLoopCacheSeconds ), 1 ) : 0;
+		// Resident samples already cover the loop, and bouncing never jumps
+		if( ! mNativeDecode || ! mLooping || numFrames == 0 || mResidentCache || mTransport.getLoopMode() == hap::LoopMode::BOUNCE ) {
+			mLoopCache.reset();
+			return;
+		}
+		
+		// Never past the other end of the loop, those frames are played right before the wrap and the read-ahead covers them
+		const size_t in = mSampleTable->getSampleIndexForSeconds( mLoopIn );
+		const size_t out = mLoopOut >= 0 ? std::max( mSampleTable->getSampleIndexForSeconds( mLoopOut ), in ) : mSampleTable->getNumSamples() - 1;
+		numFrames = std::min( numFrames, out - in + 1 );
+		const size_t first = mTransport.getRate() < 0 ? out + 1 - numFrames : in;
+		if( mLoopCache && mLoopCache->getFirst() == first && mLoopCache->getCount() == numFrames && mLoopCache->isDecoded() == mLoopCacheDecoded )
+			return;
+		mLoopCache = hap::FrameCache::create( mSampleTable, first, numFrames, mLoopCacheDecoded );
+	}
+	
+	hap::ResidentMode MovieGlHap::setResidentMode( hap::ResidentMode mode )
+	{
+		if( ! mNativeDecode ) {
+			if( mode != hap::ResidentMode::NONE )
+				CI_LOG_W( "HAP WARNING :: resident samples need native decoding." );
+			return hap::ResidentMode::NONE;
+		}
+		if( mode == mResidentMode )
+			return mode;
+		finishPreroll();
+		releaseResidentSamples();
+		
+		// Reserve the budget for the fullest mode that fits before allocating anything
+		const size_t numSamples = mSampleTable->getNumSamples();
+		const hap::ResidentMode requested = mode;
+		size_t size = 0;
+		{
+			std::lock_guard<std::mutex> lock( sResidentMutex );
+			const size_t available = sResidentUsage < sResidentBudget ? sResidentBudget - sResidentUsage : 0;
+			if( mode == hap::ResidentMode::DECODED && hap::FrameCache::getArenaSize( mSampleTable, 0, numSamples, true ) > available )
+				mode = hap::ResidentMode::COMPRESSED;
+			if( mode == hap::ResidentMode::COMPRESSED && hap::FrameCache::getArenaSize( mSampleTable, 0, numSamples, false ) > available )
+				mode = hap::ResidentMode::NONE;
+			if( mode != hap::ResidentMode::NONE ) {
+				size = hap::FrameCache::getArenaSize( mSampleTable, 0, numSamples, mode == hap::ResidentMode::DECODED );
+				sResidentUsage += size;
+				mResidentReserved = size;
+			}
+		}
+		if( mode == hap::ResidentMode::NONE ) {
+			if( requested != hap::ResidentMode::NONE )
+				CI_LOG_W( "HAP WARNING :: movie doesn't fit in the resident memory budget, playing from storage." );
+		}
+		else {
+			if( mode != requested )
+				CI_LOG_W( "HAP WARNING :: decoded movie doesn't fit in the resident memory budget, keeping it compressed." );
+			
+			const hap::FrameCacheRef cache = hap::FrameCache::create( mSampleTable, 0, numSamples, mode == hap::ResidentMode::DECODED, true );
+			if( cache->isReady() ) {
+				mResidentCache = cache;
+				mResidentMode = mode;
+			}
+			else {
+				CI_LOG_E( "HAP ERROR :: couldn't load the movie's " << size << " bytes of samples, playing from storage." );
+				releaseResidentSamples();
+			}
+		}
+		
+		// The reader and the loop cache step aside while every sample is resident
+		if( mResidentCache )
+			mReadAhead.reset();
+		else if( ! mReadAhead && mReadAheadSeconds > 0 )
+			mReadAhead = hap::ReadAhead::create( mSampleTable, mReadAheadSeconds );
+		updateLoopCache();
+		return mResidentMode;
+	}
+	
+	void MovieGlHap::releaseResidentSamples()
+	{
+		mResidentCache.reset();
+		mResidentMode = hap::ResidentMode::NONE;
+		if( mResidentReserved ) {
+			std::lock_guard<std::mutex> lock( sResidentMutex );
+			sResidentUsage -= mResidentReserved;
+			mResidentReserved = 0;
+		}
+	}
+	
+	void MovieGlHap::setResidentMemoryBudget( size_t bytes )
+	{
+		std::lock_guard<std::mutex> lock( sResidentMutex );
+		sResidentBudget = bytes;
+	}
+	
+	size_t MovieGlHap::getResidentMemoryBudget()
+	{
+		std::lock_guard<std::mutex> lock( sResidentMutex );
+		return sResidentBudget;
+	}
+	
+	size_t MovieGlHap::getResidentMemoryUsage()
+	{
+		std::lock_guard<std::mutex> lock( sResidentMutex );
+		return sResidentUsage;
+	}
+	
+	void MovieGlHap::adviseSource( size_t index, double velocity )
+	{
+		const hap::MovieSourceRef &source = mSampleTable->getSource();
+		const hap::SampleTable::Sample *samples = mSampleTable->getSamples();
+		const size_t previous = mObj->mSampleIndex;
+		const bool reverse = velocity < 0;
+		const bool forward = ! reverse && previous < index;
+		
+		// Page in the samples about to play. Moving forward only the far end of the window is new, after a seek or backwards all
+		// of it is
+		const size_t window = std::max<size_t>( size_t( mSampleTable->getFramerate() * kAdviseAheadSeconds * std::max( std::abs( velocity ), 1.0 ) ), 2 );
+		size_t first, last;
+		if( reverse ) {
+			first = index > window ? index - window : 0;
+			last = index;
+		}
+		else {
+			first = index + 1;
+			last = std::min( index + window, mSampleTable->getNumSamples() - 1 );
+			if( forward && mObj->mAdvisedUntil >= index && mObj->mAdvisedUntil < last )
+				first = mObj->mAdvisedUntil + 1;
+		}
+		
+		// Samples are usually laid out back to back, so contiguous ones go out as a single hint
+		uint64_t rangeStart = 0, rangeEnd = 0;
+		for( size_t i = first; i <= last; ++i ) {
+			if( samples[i].mOffset != rangeEnd ) {
+				if( rangeEnd > rangeStart )
+					source->adviseWillNeed( rangeStart, rangeEnd - rangeStart );
+				rangeStart = samples[i].mOffset;
+			}
+			rangeEnd = samples[i].mOffset + samples[i].mSize;
+		}
+		if( rangeEnd > rangeStart )
+			source->adviseWillNeed( rangeStart, rangeEnd - rangeStart );
+		mObj->mAdvisedUntil = reverse ? index : last;
+		
+		if( mObj->mReleasePlayedFrames && forward ) {
+			for( size_t i = previous; i < index; ++i )
+				source->adviseDontNeed( samples[i].mOffset, samples[i].mSize );
+		}
+		else if( mObj->mReleasePlayedFrames && reverse && previous != std::numeric_limits<size_t>::max() && previous > index ) {
+			for( size_t i = index + 1; i <= previous; ++i )
+				source->adviseDontNeed( samples[i].mOffset, samples[i].mSize );
+		}
+	}
+	
+	static fs::path getSourceFilePath( const hap::MovieSourceRef &source )
+	{
+		if( auto mapped = std::dynamic_pointer_cast<hap::MovieSourceMapped>( source ) )
+			return mapped->getFilePath();
+		if( auto file = std::dynamic_pointer_cast<hap::MovieSourceFile>( source ) )
+			return file->getFilePath();
+		return fs::path();
+	}
+	
+	void MovieGlHap::setUnbufferedReads( bool unbuffered )
+	{
+		if( ! mNativeDecode || isUsingUnbufferedReads() == unbuffered )
+			return;
+		finishPreroll();
+		
+		const fs::path path = getSourceFilePath( mSampleTable->getSource() );
+		if( path.empty() ) {
+			CI_LOG_W( "HAP WARNING :: unbuffered reads need a movie file." );
+			return;
+		}
+		mSampleTable->setSource( unbuffered ? hap::MovieSource::createUnbuffered( path ) : hap::MovieSource::create( path ) );
+		
+		// The reader keeps the source it started with, and sizes its buffer pool from it
+		if( mReadAhead )
+			mReadAhead = hap::ReadAhead::create( mSampleTable, mReadAheadSeconds );
+	}
+	
+	bool MovieGlHap::isUsingUnbufferedReads() const
+	{
+		return mSampleTable && mSampleTable->getSource()->getReadAlignment() > 1;
+	}
+	
+	void MovieGlHap::setReadAheadSeconds( double seconds )
+	{
+		if( ! mNativeDecode )
+			return;
+		finishPreroll();
+		mReadAheadSeconds = std::max( seconds, 0.0 );
+		if( seconds <= 0 || mResidentCache )
+			mReadAhead.reset();
+		else if( mReadAhead )
+			mReadAhead->setWindowSeconds( seconds );
+		else
+			mReadAhead = hap::ReadAhead::create( mSampleTable, seconds );
+	}
+	
+	void MovieGlHap::setUploadMode( hap::UploadMode mode, size_t ringDepth )
+	{
+		mObj->lockCounted();
+		mObj->mUploadMode = mode;
+		mObj->mUploadRingDepth = std::max<size_t>( ringDepth, 1 );
+		mObj->unlock();
+	}
+	
+	void MovieGlHap::setTextureSwapChainLength( size_t length )
+	{
+		mObj->lockCounted();
+		mObj->mSwapChainLength = std::max<size_t>( length, 1 );
+		mObj->unlock();
+	}
+	
+	hap::UploadStats MovieGlHap::getUploadStats() const
+	{
+		mObj->lockCounted();
+		hap::UploadStats stats = mObj->mUploader ? mObj->mUploader->getStats() : hap::UploadStats();
+		mObj->unlock();
+		return stats;
+	}
+	
+	void MovieGlHap::adoptTextures( MovieGlHap &previous )
+	{
+		previous.mObj->lockCounted();
+		mObj->lockCounted();
+		// The previous front texture keeps its place in the chain, so the next upload goes to another one
+		if( previous.mObj->mSwapChain.size() == mObj->mSwapChainLength ) {
+			mObj->mSwapChain = std::move( previous.mObj->mSwapChain );
+			mObj->mSwapFront = previous.mObj->mSwapFront;
+		}
+		previous.mObj->mSwapChain.clear();
+		if( previous.mObj->mUploader && previous.mObj->mUploadMode == mObj->mUploadMode && previous.mObj->mUploadRingDepth == mObj->mUploadRingDepth )
+			mObj->mUploader = std::move( previous.mObj->mUploader );
+		previous.mObj->mUploader.reset();
+		mObj->unlock();
+		previous.mObj->unlock();
+	}
+	
+	hap::HandoffStats MovieGlHap::getHandoffStats() const
+	{
+		hap::HandoffStats stats = mObj->mFrontTexture.getStats();
+		stats.mNumLockContentions = mObj->mNumLockContentions;
+		return stats;
+	}
+	
+	gl::TextureRef MovieGlHap::getTexture()
+	{
+		updateTexture();
+		
+		return acquireFrontTexture();
+	}
+	
+	const gl::Texture2dRef& MovieGlHap::acquireFrontTexture()
+	{
+		bool isNew;
+		const gl::Texture2dRef &texture = mObj->mFrontTexture.acquire( &isNew );
+		if( isNew )
+			mObj->mStats.framePresented( app::getElapsedSeconds(), app::App::get()->getFpsSampleInterval() );
 		return texture;
 	}
 	
 	gl::GlslProgRef MovieGlHap::getGlsl() const
 	{
+		mObj->ensureShaders();
 		return isHapQ() ? MovieGlHap::Obj::sHapQShader : mObj->mDefaultShader;
 	}
 	
+	gl::Texture2dRef MovieGlHap::getTextureForTime( double presentationTime )
+	{
+		updateTextureForTime( presentationTime );
+		
+		return acquireFrontTexture();
+	}
+	
+	void MovieGlHap::draw( double presentationTime )
+	{
+		updateTextureForTime( presentationTime );
+		
+		drawFrontTexture();
+	}
+	
 	void MovieGlHap::draw()
 	{
-		updateFrame();
+		updateTexture();
 		
-		mObj->lock();
-		if( mObj->mTexture ) {
-			Rectf centeredRect = Rectf(0, 0, mObj->mTexture->getWidth(), mObj->mTexture->getHeight()).getCenteredFit(app::getWindowBounds(), true);
+		drawFrontTexture();
+	}
+	
+	void MovieGlHap::drawFrontTexture()
+	{
+		const gl::Texture2dRef &texture = acquireFrontTexture();
+		if( texture ) {
+			mObj->ensureShaders();
+			Rectf centeredRect = Rectf(0, 0, texture->getWidth(), texture->getHeight()).getCenteredFit(app::getWindowBounds(), true);
 			gl::color( Color::white() );
 			
 			auto drawRect = [&]() {
-				gl::ScopedTextureBind tex( mObj->mTexture );
-				float cw = mObj->mTexture->getWidth();
-				float ch = mObj->mTexture->getHeight();
-				float w = mObj->mTexture->getActualWidth();
-				float h = mObj->mTexture->getActualHeight();
+				gl::ScopedTextureBind tex( texture );
+				float cw = texture->getWidth();
+				float ch = texture->getHeight();
+				float w = texture->getActualWidth();
+				float h = texture->getActualHeight();
 				gl::drawSolidRect( centeredRect, vec2( 0, 0 ), vec2( cw / w, ch / h ) );
 			};
 			
@@ -334,6 +1263,5 @@ namespace cinder { namespace qtime {
 				drawRect();
 			}
 		}
-		mObj->unlock();
 	}
 } } //namespace cinder::qtime
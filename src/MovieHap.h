@@ -18,6 +18,19 @@
 #endif
 #include "cinder/qtime/QuicktimeGl.h"
 
+#include "HapDecoder.h"
+#include "HapFrameCache.h"
+#include "HapPlaybackClock.h"
+#include "HapPlaybackStats.h"
+#include "HapReadAhead.h"
+#include "HapSampleTable.h"
+#include "HapTextureUploader.h"
+#include "HapTransport.h"
+#include "HapTripleBuffer.h"
+
+#include <atomic>
+#include <future>
+
 namespace cinder { namespace qtime {
 	
 	typedef std::shared_ptr<class MovieGlHap> MovieGlHapRef;
@@ -26,47 +39,306 @@ namespace cinder { namespace qtime {
 	public:
 		enum class Codec { HAP, HAP_A, HAP_Q, UNSUPPORTED };
 		
+		//! Progress of createAsync(), shared between the opening worker and the caller. Thread-safe.
+		class OpenProgress {
+		public:
+			OpenProgress() : mProgress( 0 ), mCancelled( false ) {}
+			
+			//! Returns how far the open got, from 0 to 1.
+			float	getProgress() const { return mProgress; }
+			//! Abandons the open once the current stage completes, the future then yields a null movie.
+			void	cancel() { mCancelled = true; }
+			bool	isCancelled() const { return mCancelled; }
+			
+		protected:
+			std::atomic<float>	mProgress;
+			std::atomic<bool>	mCancelled;
+			
+			friend class MovieGlHap;
+		};
+		typedef std::shared_ptr<OpenProgress> OpenProgressRef;
+		
 		~MovieGlHap();
 		MovieGlHap( const fs::path &path );
 		MovieGlHap( const class MovieLoader &loader );
 		MovieGlHap( const void *data, size_t dataSize, const std::string &fileNameHint, const std::string &mimeTypeHint = "" );
 		MovieGlHap( DataSourceRef dataSource, const std::string mimeTypeHint = "" );
 		
+		//! getTexture() and draw() hand frames over without locking, so they must be called from a single render thread.
 		gl::Texture2dRef getTexture();
 		gl::GlslProgRef getGlsl() const;
 		void draw();
+		//! Returns the frame due at \a presentationTime, the predicted display time of the next vsync on the app::getElapsedSeconds()
+		//! timeline, rather than the one due now. When decoding natively the frame for the vsync after that is decoded in the
+		//! background meanwhile, so each call only uploads, and frames follow the display's cadence exactly. Use instead of
+		//! getTexture() and draw(), from the same thread.
+		gl::Texture2dRef getTextureForTime( double presentationTime );
+		//! Draws the frame due at \a presentationTime like draw(), see getTextureForTime().
+		void draw( double presentationTime );
 		
 		bool			isHap() const { return mCodec == Codec::HAP; }
 		bool			isHapA() const { return mCodec == Codec::HAP_A; }
 		bool			isHapQ() const { return mCodec == Codec::HAP_Q; }
 		
 		const Codec&	getCodecName() const { return mCodec; }
+		//! Returns the rate at which new frames reached getTexture() or draw() over the last app fps sample interval.
 		float			getPlaybackFramerate() const;
+		//! Returns this movie's frame counters, stage latencies and framerate. Cheap to query from any thread.
+		const hap::PlaybackStats&	getPlaybackStats() const { return mObj->mStats; }
+		
+		//! Returns the natively parsed video track index, or null when the container couldn't be parsed (ie. movies loaded from a URL)
+		const hap::SampleTableRef&	getSampleTable() const { return mSampleTable; }
+		//! Keeps a ".hapidx" sidecar index next to each movie opened from a path, or in \a directory for read-only media, so the next
+		//! open maps it instead of parsing the container. Stale indices are detected and rewritten in the background. Enabled by
+		//! default, applies to movies created afterwards.
+		static void		setSidecarIndex( bool enabled, const fs::path &directory = fs::path() );
+		//! Returns true when frames are read and decoded by hap::Decoder rather than by the QuickTime Hap codec
+		bool			isDecodingNatively() const { return mNativeDecode; }
+		//! Decompresses the chunks of multi-chunk frames across \a pool when decoding natively. Defaults to hap::ThreadPool::getShared(),
+		//! which every movie shares; a null pool decodes on the calling thread.
+		void			setDecodeThreadPool( const hap::ThreadPoolRef &pool ) { finishPreroll(); mObj->mDecoder.setThreadPool( pool ); }
+		//! Ranks this movie's decode tasks against other movies' on the same pool, ie. PREROLL for a layer that isn't visible yet.
+		void			setDecodePriority( hap::TaskPriority priority ) { finishPreroll(); mObj->mDecoder.setPriority( priority ); }
+		hap::TaskPriority	getDecodePriority() const { return mObj->mDecoder.getPriority(); }
+		//! Returns the duration of the last native frame decode, in seconds. Call from the thread that calls getTexture() or draw().
+		double			getLastDecodeSeconds() const { finishPreroll(); return mObj->mDecoder.getLastDecodeSeconds(); }
+		//! Returns the per-chunk timings of the last native frame decode. Call from the thread that calls getTexture() or draw().
+		const std::vector<hap::Decoder::ChunkTiming>&	getDecodeChunkTimings() const { finishPreroll(); return mObj->mDecoder.getChunkTimings(); }
+		
+		//! Keeps the compressed samples playing within \a seconds after the playhead resident, reading them on a background thread.
+		//! Defaults to half a second when decoding natively, 0 disables it. Call from the thread that calls getTexture() or draw().
+		void			setReadAheadSeconds( double seconds );
+		//! Returns the background reader, with its queue depth and read latencies, or null when disabled.
+		const hap::ReadAheadRef&	getReadAhead() const { return mReadAhead; }
+		
+		//! Reads samples bypassing the OS cache (O_DIRECT and equivalents) into a pool of aligned buffers when decoding natively
+		//! from a file, so high bitrate movies neither evict the rest of the cache nor cause writeback stalls. Best combined with
+		//! read-ahead, which then reads straight into the pool. Call from the thread that calls getTexture() or draw().
+		void			setUnbufferedReads( bool unbuffered = true );
+		bool			isUsingUnbufferedReads() const;
+		
+		//! Evicts each frame's compressed sample from the page cache once played past, when decoding natively from a mapped file.
+		//! Keeps the memory footprint of long movies flat at the cost of re-reading loops from disk. Disabled by default.
+		void			setReleasePlayedFrames( bool release = true ) { mObj->mReleasePlayedFrames = release; }
+		
+		//! When decoding natively, frames are picked by index from a hap::Transport rather than from QuickTime's clock, so seeks
+		//! land exactly on the requested frame, rates can be negative or many times normal speed and loops can bounce, all
+		//! without QuickTime seeking. QuickTime follows along for the audio. Otherwise these defer to MovieBase.
+		void			play();
+		void			stop();
+		bool			isPlaying() const;
+		bool			isDone() const;
+		//! Sets the speed, ie. 4 for four times as fast, negative values playing backwards. Takes effect at once when playing.
+		void			setRate( float rate );
+		float			getRate() const { return (float)mTransport.getRate(); }
+		float			getCurrentTime() const;
+		void			seekToTime( float seconds );
+		//! Moves to the very first time frame \a frame is displayed.
+		void			seekToFrame( int frame );
+		void			seekToStart();
+		void			seekToEnd();
+		void			stepForward();
+		void			stepBackward();
+		//! Returns the index of the frame at the current position, 0 when not decoding natively.
+		size_t			getCurrentFrameIndex() const;
+		
+		//! Follows \a clock, along with every other movie following it, so when decoding natively they all start, pause, seek and
+		//! loop on the same frame for as long as they play. Transport calls on this movie then act on the clock. QuickTime follows
+		//! the clock too, for the audio or the frames it decodes, put back in step whenever it wanders off. Null returns to the
+		//! movie's own timing.
+		void			setPlaybackClock( const hap::PlaybackClockRef &clock );
+		const hap::PlaybackClockRef&	getPlaybackClock() const { return mTransport.getClock(); }
+		//! Returns how far the frame last shown was from the position it was shown for, in seconds, 0 when it was the right
+		//! one. Also recorded by the clock followed, see hap::PlaybackClock::getMaxDrift().
+		double			getClockDrift() const { return mObj->mClockDrift; }
+		//! Returns how far QuickTime's audio is ahead of the frames, in seconds.
+		double			getAudioDrift() const;
+		
+		//! Loops like MovieBase::setLoop(), bouncing back and forth when \a palindrome. Keeps the frames playback wraps around to
+		//! resident when decoding natively, see setLoopCache().
+		void			setLoop( bool loop = true, bool palindrome = false );
+		//! Loops between \a inSeconds and \a outSeconds rather than over the whole movie once setLoop() is enabled.
+		void			setLoopPoints( double inSeconds, double outSeconds );
+		void			clearLoopPoints();
+		double			getLoopIn() const { return mLoopIn; }
+		//! Returns the loop's out point, or a negative value when looping over the whole movie.
+		double			getLoopOut() const { return mLoopOut; }
+		//! Keeps the \a numFrames frames playback wraps around to resident while looping, from the loop's in point or, playing
+		//! backwards, up to its out point. Compressed or, when \a decoded, as DXT, so wrapping around never waits on storage or
+		//! decompression. Bouncing loops need none. Defaults to one second of compressed frames, 0 disables.
+		void			setLoopCache( size_t numFrames, bool decoded = false );
+		//! Returns the resident frames at the loop's in point, or null when not looping.
+		const hap::FrameCacheRef&	getLoopCache() const { return mLoopCache; }
+		
+		//! Loads every video sample into one arena, compressed or, with hap::ResidentMode::DECODED, as DXT, so playback, seeking
+		//! and reverse play never touch storage again; read-ahead and the loop cache are then idle. Blocks until loaded. Checked
+		//! against setResidentMemoryBudget(), DECODED falls back to COMPRESSED when only that fits and neither is used when
+		//! nothing does. Returns the mode in effect, always NONE when not decoding natively.
+		hap::ResidentMode	setResidentMode( hap::ResidentMode mode );
+		hap::ResidentMode	getResidentMode() const { return mResidentMode; }
+		//! Returns the bytes held by the resident samples, 0 when not resident.
+		size_t				getResidentMemoryFootprint() const { return mResidentCache ? mResidentCache->getMemoryFootprint() : 0; }
+		//! Caps the memory all movies' resident samples may take together. Unlimited by default, only checked by later setResidentMode() calls.
+		static void			setResidentMemoryBudget( size_t bytes );
+		static size_t		getResidentMemoryBudget();
+		//! Returns the memory taken by all movies' resident samples.
+		static size_t		getResidentMemoryUsage();
+		
+		//! Selects how frames reach the texture. PBO modes cycle through \a ringDepth pixel-unpack buffers. Takes effect on the next frame.
+		void				setUploadMode( hap::UploadMode mode, size_t ringDepth = 3 );
+		hap::UploadMode		getUploadMode() const { return mObj->mUploadMode; }
+		//! Returns upload counts and the time spent waiting for the GPU to release a ring slot.
+		hap::UploadStats	getUploadStats() const;
+		
+		//! Sets how many textures frames rotate through. Each frame is uploaded into a texture other than the one last returned
+		//! by getTexture(), once a fence confirms the GPU finished sampling it. 1 updates a single texture in place. Defaults to 2.
+		void				setTextureSwapChainLength( size_t length );
+		size_t				getTextureSwapChainLength() const { return mObj->mSwapChainLength; }
+		//! Returns how many frames had to wait for the GPU to stop sampling the texture they were about to overwrite.
+		uint64_t			getTextureSwapStalls() const { return mObj->mNumSwapStalls; }
+		
+		//! Takes over the textures and upload buffers of \a previous, which stops showing frames, so switching clips of the same
+		//! dimensions and format allocates nothing. Textures that don't match are recreated on the first upload. Call from the
+		//! thread that calls getTexture() or draw().
+		void				adoptTextures( MovieGlHap &previous );
+		
+		//! Returns frame hand-off counters between the decode and render sides. getTexture() and draw() never take the movie mutex,
+		//! mNumLockContentions counts the waits left on the producer side and in the configuration calls.
+		hap::HandoffStats	getHandoffStats() const;
 		
 		static MovieGlHapRef create( const fs::path &path ) { return MovieGlHapRef( new MovieGlHap( path ) ); }
+		//! Opens \a path on a worker of hap::ThreadPool::getShared(): QuickTime setup, container indexing and decoding of the first
+		//! frame all happen there, textures and shaders are only created by the first getTexture() or draw(). The future becomes
+		//! ready on the app's main thread, which the movie is then attached to. Yields null when cancelled, rethrows open errors.
+		//! A \a residentMode other than NONE is applied on the worker too, see setResidentMode().
+		static std::future<MovieGlHapRef> createAsync( const fs::path &path, const OpenProgressRef &progress = OpenProgressRef(), hap::ResidentMode residentMode = hap::ResidentMode::NONE );
 		static MovieGlHapRef create( const MovieLoaderRef &loader );
 		static MovieGlHapRef create( const void *data, size_t dataSize, const std::string &fileNameHint, const std::string &mimeTypeHint = "" )
 		{ return MovieGlHapRef( new MovieGlHap( data, dataSize, fileNameHint, mimeTypeHint ) ); }
 		static MovieGlHapRef create( DataSourceRef dataSource, const std::string mimeTypeHint = "" )
 		{ return MovieGlHapRef( new MovieGlHap( dataSource, mimeTypeHint ) ); }
 	protected:
+		//! Opens \a path in stages, reporting to \a progress and stopping early if it gets cancelled.
+		MovieGlHap( const fs::path &path, OpenProgress *progress );
 		
 		void allocateVisualContext();
+		//! \a path is the movie file when opened from one, whose sidecar index is then used.
+		void initSampleTable( const std::function<hap::MovieSourceRef ()> &createSource, const fs::path &path = fs::path() );
+		void updateTexture();
+		void updateNativeFrame();
+		void updateTextureForTime( double presentationTime );
+		//! Decodes sample \a index unless it was decoded ahead, and uploads it.
+		void presentSample( size_t index );
+		//! Reads sample \a index and decodes it into \a output, returning false on failure. \a velocity is the signed speed
+		//! the playhead moves at, see getPlayheadVelocity(). Runs on a pool worker for frames decoded ahead.
+		bool decodeSample( size_t index, uint8_t *output, size_t capacity, hap::FrameInfo *info, double velocity );
+		//! Returns the rate and direction samples are reached at, normal speed while scrubbing.
+		double getPlayheadVelocity() const;
+		//! Decodes the frame at the current time ahead of the first getTexture() or draw(), which then only upload it.
+		void prerollFirstFrame();
+		//! Starts decoding sample \a index into mFrameBuffer on a pool worker, so presenting it only needs an upload.
+		void prerollSample( size_t index );
+		//! Waits for the background decode of prerollSample(). Called before anything the decode path reads changes.
+		void finishPreroll() const;
+		//! Rebuilds mLoopCache to match the loop settings.
+		void updateLoopCache();
+		//! Drops the resident samples and returns their share of the budget.
+		void releaseResidentSamples();
+		//! Hints the movie source about the samples ahead of and behind sample \a index, which is about to be shown, in the direction of play.
+		void adviseSource( size_t index, double velocity );
+		//! Returns the sample at the transport's position \a secondsFromNow, the last one of the segment at its very end.
+		size_t getTransportSampleIndex( double secondsFromNow = 0 ) const;
+		//! Measures how far the frame shown is from \a time, the position it was due at.
+		void recordClockDrift( double time );
+		//! Keeps QuickTime playing along with the playback clock.
+		void followClock();
+		//! Moves the transport to \a seconds and QuickTime along with it.
+		void seekTransport( double seconds );
+		//! Picks up the latest front texture, counting it as presented when it is new.
+		const gl::Texture2dRef& acquireFrontTexture();
+		//! Draws the latest front texture centered in the window.
+		void drawFrontTexture();
 
 		struct Obj : public MovieBase::Obj {
 			Obj();
 			~Obj();
 			virtual void		releaseFrame();
 			virtual void		newFrame( CVImageBufferRef cvImage );
-			gl::Texture2dRef	mTexture;
+			//! Returns the swap chain index of the texture to upload the next frame into, once the GPU no longer samples it.
+			size_t				acquireBackTexture();
+			//! Makes \a back the front texture, fencing the previous one.
+			void				swapTextures( size_t back );
+			//! Locks the movie mutex, counting the times it was already held.
+			void				lockCounted();
+			//! Creates or recreates mUploader to match mUploadMode; returns false in CLIENT_MEMORY mode.
+			bool				ensureUploader();
+			void				uploadFrame( uint32_t pixelFormat, GLuint width, GLuint height, GLuint roundedWidth, GLuint roundedHeight, const GLvoid *data, size_t dataSize );
+			//! Creates the shaders on first use from the GL thread, movies may be opened on another one.
+			void				ensureShaders();
 			gl::GlslProgRef		mDefaultShader;
 			static gl::GlslProgRef	sHapQShader;
 			std::once_flag			mHapQOnceFlag;
+			
+			// Native decoding
+			hap::Decoder			mDecoder;
+			std::vector<uint8_t>	mSampleBuffer;
+			std::vector<uint8_t>	mFrameBuffer;
+			size_t					mSampleIndex;
+			//! Sample decoded into mFrameBuffer by prerollFirstFrame() and not uploaded yet, or SIZE_MAX.
+			size_t					mPrerolledIndex;
+			hap::FrameInfo			mPrerolledInfo;
+			//! Background decode of prerollSample(), which becomes mPrerolledIndex once finished.
+			std::future<bool>		mPrerolling;
+			size_t					mPrerollingIndex;
+			//! Last time passed to getTextureForTime(), and the interval between such times, ie. the display's refresh period.
+			double					mLastPresentationTime, mPresentationInterval;
+			double					mClockDrift;
+			//! Rate QuickTime was last told to play at while following a clock.
+			float					mQuickTimeRate;
+			size_t					mAdvisedUntil;
+			std::atomic<bool>		mReleasePlayedFrames;
+			
+			// Texture upload
+			hap::UploadMode			mUploadMode;
+			size_t					mUploadRingDepth;
+			hap::TextureUploaderRef	mUploader;
+			
+			// Texture swap chain, the front texture being handed to the render thread through mFrontTexture
+			struct SwapTexture {
+				gl::Texture2dRef	mTexture;
+				gl::SyncRef			mReleaseFence;
+			};
+			std::vector<SwapTexture>	mSwapChain;
+			size_t					mSwapChainLength;
+			size_t					mSwapFront;
+			uint64_t				mNumSwapStalls;
+			hap::TripleBuffer<gl::Texture2dRef>	mFrontTexture;
+			std::atomic<uint64_t>	mNumLockContentions;
+			hap::PlaybackStats		mStats;
 		};
 		std::unique_ptr<Obj>		mObj;
 		virtual MovieBase::Obj*		getObj() const { return mObj.get(); }
 		
 		Codec						mCodec;
+		hap::SampleTableRef			mSampleTable;
+		hap::ReadAheadRef			mReadAhead;
+		//! Read-ahead window as last set, kept while resident samples replace the reader.
+		double						mReadAheadSeconds;
+		bool						mNativeDecode;
+		
+		hap::Transport				mTransport;
+		
+		// Looping
+		bool						mLooping;
+		double						mLoopIn, mLoopOut;
+		size_t						mLoopCacheFrames;
+		bool						mLoopCacheDecoded;
+		hap::FrameCacheRef			mLoopCache;
+		
+		// Resident samples, mResidentReserved being their share of the budget
+		hap::ResidentMode			mResidentMode;
+		hap::FrameCacheRef			mResidentCache;
+		size_t						mResidentReserved;
 	};
 
 } } //namespace cinder::qtime
@@ -0,0 +1,201 @@
+/*
+ *  MovieHapPlaylist.cpp
+ *
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+
+#include "MovieHapPlaylist.h"
+
+#include "cinder/Log.h"
+#include "cinder/app/App.h"
+
+namespace cinder { namespace qtime {
+
+	MovieGlHapPlaylist::MovieGlHapPlaylist()
+	: mLoop( false ), mPlaying( false ), mDone( false ), mCurrentIndex( 0 ), mCurrentStart( 0 ), mNextIndex( 0 ), mNextLate( false ),
+	  mNumConsecutiveFailures( 0 ), mNumLateSwitches( 0 ), mNumFailedEntries( 0 )
+	{
+	}
+
+	MovieGlHapPlaylist::~MovieGlHapPlaylist()
+	{
+		// The open finishes in the background and its movie is dropped on delivery
+		if( mNextProgress )
+			mNextProgress->cancel();
+	}
+
+	void MovieGlHapPlaylist::add( const fs::path &path )
+	{
+		mEntries.push_back( path );
+		if( mPlaying )
+			openNext();
+	}
+
+	void MovieGlHapPlaylist::clear()
+	{
+		stop();
+		if( mNextProgress )
+			mNextProgress->cancel();
+		mNextProgress.reset();
+		mNextLoading = std::future<MovieGlHapRef>();
+		mNext.reset();
+		mCurrent.reset();
+		mEntries.clear();
+		mCurrentIndex = 0;
+		mDone = false;
+	}
+
+	void MovieGlHapPlaylist::play()
+	{
+		if( mEntries.empty() )
+			return;
+		if( mDone ) {
+			mCurrent.reset();
+			mCurrentIndex = 0;
+			mDone = false;
+		}
+		mPlaying = true;
+		if( mCurrent ) {
+			mCurrentStart = app::getElapsedSeconds() - mCurrent->getCurrentTime();
+			mCurrent->play();
+		}
+		openNext();
+	}
+
+	void MovieGlHapPlaylist::stop()
+	{
+		mPlaying = false;
+		if( mCurrent )
+			mCurrent->stop();
+	}
+
+	size_t MovieGlHapPlaylist::getFollowingIndex( size_t index ) const
+	{
+		if( index + 1 < mEntries.size() )
+			return index + 1;
+		return mLoop ? 0 : mEntries.size();
+	}
+
+	void MovieGlHapPlaylist::openNext()
+	{
+		if( mNext || mNextLoading.valid() )
+			return;
+		const size_t index = mCurrent ? getFollowingIndex( mCurrentIndex ) : mCurrentIndex;
+		openEntry( index );
+	}
+
+	void MovieGlHapPlaylist::openEntry( size_t index )
+	{
+		if( index >= mEntries.size() )
+			return;
+		mNextIndex = index;
+		mNextProgress = std::make_shared<MovieGlHap::OpenProgress>();
+		mNextLoading = MovieGlHap::createAsync( mEntries[index], mNextProgress );
+	}
+
+	void MovieGlHapPlaylist::pollNext()
+	{
+		if( ! mNextLoading.valid() || mNextLoading.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+			return;
+
+		try {
+			mNext = mNextLoading.get();
+		}
+		catch( const std::exception &exc ) {
+			CI_LOG_E( "HAP ERROR :: couldn't open playlist entry " << mEntries[mNextIndex] << ": " << exc.what() );
+		}
+		mNextLoading = std::future<MovieGlHapRef>();
+		mNextProgress.reset();
+		if( mNext ) {
+			mNumConsecutiveFailures = 0;
+			return;
+		}
+
+		// Skip to the entry after the failed one, giving up once every entry failed in a row. A movie already playing
+		// finishes first, update() then ends the playlist since nothing follows it
+		++mNumFailedEntries;
+		if( ++mNumConsecutiveFailures < mEntries.size() )
+			openEntry( getFollowingIndex( mNextIndex ) );
+		else if( ! mCurrent ) {
+			mPlaying = false;
+			mDone = true;
+		}
+	}
+
+	void MovieGlHapPlaylist::switchToNext( double offset )
+	{
+		if( mCurrent ) {
+			mNext->adoptTextures( *mCurrent );
+			mCurrent->stop();
+		}
+		mCurrent = mNext;
+		mCurrentIndex = mNextIndex;
+		mNext.reset();
+		mNextLate = false;
+
+		if( offset > 0 )
+			mCurrent->seekToTime( (float)offset );
+		mCurrent->play();
+		openNext();
+	}
+
+	double MovieGlHapPlaylist::getMovieDuration( const MovieGlHapRef &movie )
+	{
+		// The native index has the exact duration, QuickTime's is rounded to a float
+		const hap::SampleTableRef &table = movie->getSampleTable();
+		return table ? table->getDurationSeconds() : movie->getDuration();
+	}
+
+	void MovieGlHapPlaylist::update()
+	{
+		if( ! mPlaying )
+			return;
+
+		pollNext();
+		const double now = app::getElapsedSeconds();
+		if( ! mCurrent ) {
+			if( mNext ) {
+				mCurrentStart = now;
+				switchToNext( 0 );
+			}
+			return;
+		}
+
+		const double end = mCurrentStart + getMovieDuration( mCurrent );
+		if( now < end )
+			return;
+
+		if( mNext ) {
+			// On time, the next entry starts exactly where the current one ended. Late, it starts now
+			const double start = mNextLate ? now : end;
+			mCurrentStart = start;
+			switchToNext( now - start );
+		}
+		else if( ! mNextLoading.valid() ) {
+			mPlaying = false;
+			mDone = true;
+		}
+		else if( ! mNextLate ) {
+			mNextLate = true;
+			++mNumLateSwitches;
+		}
+	}
+
+	gl::Texture2dRef MovieGlHapPlaylist::getTexture()
+	{
+		return mCurrent ? mCurrent->getTexture() : gl::Texture2dRef();
+	}
+
+	gl::GlslProgRef MovieGlHapPlaylist::getGlsl() const
+	{
+		return mCurrent ? mCurrent->getGlsl() : gl::GlslProgRef();
+	}
+
+	void MovieGlHapPlaylist::draw()
+	{
+		if( mCurrent )
+			mCurrent->draw();
+	}
+
+} } // namespace cinder::qtime
@@ -0,0 +1,93 @@
+/*
+ *  MovieHapPlaylist.h
+ *
+ *  Gapless playback of a list of Hap movies, each opened and prerolled while its predecessor plays.
+ *  Released under the Modified BSD License, same as Cinder.
+ *
+ */
+#pragma once
+
+#include "MovieHap.h"
+
+#include <vector>
+
+namespace cinder { namespace qtime {
+
+	typedef std::shared_ptr<class MovieGlHapPlaylist> MovieGlHapPlaylistRef;
+
+	//! Plays movies back to back. The next entry is opened with MovieGlHap::createAsync() as soon as the current one starts, so
+	//! its first frame is decoded by the time it is due, and takes over the current movie's textures when it starts. Entries
+	//! switch when the previous one has been shown for its full duration, measured on the app clock, so they keep the cadence
+	//! of the whole list rather than drifting by a frame at each switch. All calls must come from the thread that draws.
+	class MovieGlHapPlaylist {
+	public:
+		static MovieGlHapPlaylistRef create() { return MovieGlHapPlaylistRef( new MovieGlHapPlaylist() ); }
+		~MovieGlHapPlaylist();
+
+		//! Appends \a path to the list. Entries are only opened when their turn approaches.
+		void		add( const fs::path &path );
+		void		clear();
+		size_t		getNumEntries() const { return mEntries.size(); }
+		const fs::path&	getEntry( size_t index ) const { return mEntries[index]; }
+
+		//! Wraps around to the first entry after the last one. Disabled by default.
+		void		setLoop( bool loop = true ) { mLoop = loop; }
+		bool		isLooping() const { return mLoop; }
+
+		//! Starts playback from the current entry, the first one initially. It begins once that entry is open.
+		void		play();
+		void		stop();
+		bool		isPlaying() const { return mPlaying; }
+		//! Returns true once the last entry finished playing, when not looping.
+		bool		isDone() const { return mDone; }
+
+		//! Advances the list, switching entries on their boundaries. Call once per frame before getTexture() or draw().
+		void		update();
+		//! Returns the texture of the current entry, or its predecessor's last frame until it has one.
+		gl::Texture2dRef	getTexture();
+		gl::GlslProgRef		getGlsl() const;
+		void				draw();
+
+		//! Returns the movie currently shown, null until the first entry is open.
+		const MovieGlHapRef&	getCurrentMovie() const { return mCurrent; }
+		//! Returns the index of the entry currently shown.
+		size_t		getCurrentIndex() const { return mCurrentIndex; }
+
+		//! Returns how many times an entry wasn't open yet when it was due, holding the previous entry's last frame meanwhile.
+		uint64_t	getNumLateSwitches() const { return mNumLateSwitches; }
+		//! Returns how many entries failed to open and were skipped.
+		uint64_t	getNumFailedEntries() const { return mNumFailedEntries; }
+
+	protected:
+		MovieGlHapPlaylist();
+
+		//! Returns the entry after \a index, wrapping around when looping, or the number of entries past the end.
+		size_t		getFollowingIndex( size_t index ) const;
+		//! Starts opening the entry after the current one, unless it is already.
+		void		openNext();
+		void		openEntry( size_t index );
+		//! Collects the next entry once it is open.
+		void		pollNext();
+		//! Makes the next entry current, \a offset seconds past its start.
+		void		switchToNext( double offset );
+		static double	getMovieDuration( const MovieGlHapRef &movie );
+
+		std::vector<fs::path>	mEntries;
+		bool					mLoop, mPlaying, mDone;
+
+		MovieGlHapRef			mCurrent;
+		size_t					mCurrentIndex;
+		//! App time at which the current entry's first frame was due.
+		double					mCurrentStart;
+
+		MovieGlHapRef						mNext;
+		size_t								mNextIndex;
+		std::future<MovieGlHapRef>			mNextLoading;
+		MovieGlHap::OpenProgressRef			mNextProgress;
+		bool								mNextLate;
+
+		size_t					mNumConsecutiveFailures;
+		uint64_t				mNumLateSwitches, mNumFailedEntries;
+	};
+
+} } // namespace cinder::qtime